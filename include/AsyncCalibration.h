@@ -0,0 +1,140 @@
+/*****************************************************************************
+* Application :		Camera Calibration Application
+*					using OpenCV3 (http://opencv.org/)
+*
+* Author      :		Michael Stengel <virtuellerealitaet@gmail.com>
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+*    1. Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*
+*    2. Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <string>
+#include <thread>
+#include <stdio.h>
+
+#include <opencv2/core.hpp>
+
+// Runs a calibration solve on a worker thread, so a live loop can keep showing
+// and detecting frames while calibrateCamera works. The solve writes its results
+// into storage of its own, the loop takes them over once finished() reported
+// the solve done.
+// The destructor joins a running solve, so an instance has to be declared after
+// everything its solve writes or captures by reference; locals are destroyed in
+// reverse order and the solve must not outlive its storage.
+class AsyncCalibration
+{
+public:
+	// returns whether the calibration succeeded
+	typedef std::function<bool()> Solve;
+
+	// a quiet instance does not announce its solves on the console
+	AsyncCalibration(bool verbose = true)
+		: _verbose(verbose), _running(false), _finished(false), _succeeded(false), _startTicks(0)
+	{
+	}
+
+	~AsyncCalibration()
+	{
+		wait();
+	}
+
+	// returns false if the previous solve is still running
+	bool start(const Solve& solve, int views)
+	{
+		if (_running)
+			return false;
+		wait();
+
+		_running = true;
+		_finished = false;
+		_succeeded = false;
+		_startTicks = cv::getTickCount();
+
+		if (_verbose)
+			printf("Calibrating %d views in the background\n", views);
+		_thread = std::thread([this, solve]()
+		{
+			bool ok = false;
+			try
+			{
+				ok = solve();
+			}
+			catch (const std::exception& e)
+			{
+				// cv::Exception as well as bad_alloc, an escaping exception would terminate
+				fprintf(stderr, "Calibration failed: %s\n", e.what());
+			}
+			// the result is published before the solve stops counting as running,
+			// so a loop that polls isRunning() finds it in finished() right away
+			_succeeded = ok;
+			_finished = true;
+			_running = false;
+		});
+		return true;
+	}
+
+	bool isRunning() const { return _running; }
+
+	// true once per finished solve, its results may be read from then on
+	bool finished(bool& succeeded)
+	{
+		if (!_finished.exchange(false))
+			return false;
+		wait();
+		succeeded = _succeeded;
+		return true;
+	}
+
+	// blocks until the running solve is done
+	void wait()
+	{
+		if (_thread.joinable())
+			_thread.join();
+	}
+
+	double elapsedSeconds() const
+	{
+		return _running ? (cv::getTickCount() - _startTicks) / cv::getTickFrequency() : 0.;
+	}
+
+	// short status for the live view
+	std::string progress() const
+	{
+		return cv::format("Solving %.1fs", elapsedSeconds());
+	}
+
+private:
+	bool _verbose;
+	std::thread _thread;
+	std::atomic<bool> _running;
+	std::atomic<bool> _finished;
+	std::atomic<bool> _succeeded;
+	int64 _startTicks;
+};
@@ -0,0 +1,182 @@
+/*****************************************************************************
+* Application :		Camera Calibration Application
+*					using OpenCV3 (http://opencv.org/)
+*
+* Author      :		Michael Stengel <virtuellerealitaet@gmail.com>
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+*    1. Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*
+*    2. Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <stdio.h>
+
+#include <opencv2/core.hpp>
+
+// Processes the inputs 0..count-1 on a pool of worker threads and hands the
+// results to the calling thread strictly in input order.
+// Workers never run more than 'window' inputs ahead of the oldest result that
+// was not consumed yet, so at most 'window' results (e.g. decoded images) are
+// held in memory at a time.
+template <typename Result>
+class BatchProcessor
+{
+public:
+	// runs on the worker threads, must only touch its own result
+	typedef std::function<void(size_t index, Result& result)> Producer;
+	// runs on the calling thread, in input order
+	typedef std::function<void(size_t index, Result& result)> Consumer;
+
+	// threads <= 0 uses one worker per hardware thread, window <= 0 twice the number of workers
+	BatchProcessor(int threads = 0, int window = 0)
+	{
+		_threads = threads > 0 ? threads : (int)std::thread::hardware_concurrency();
+		if (_threads <= 0)
+			_threads = 1;
+		_window = window > 0 ? (size_t)window : 2 * (size_t)_threads;
+	}
+
+	int threads() const { return _threads; }
+
+	// called from the consumer: no further inputs are started, results that are
+	// already being produced are dropped and run returns after this consumer call
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_count = _next;
+			_stopped = true;
+		}
+		_slotFree.notify_all();
+	}
+
+	void run(size_t count, const Producer& producer, const Consumer& consumer)
+	{
+		_slots.assign(_window, Result());
+		_ready.assign(_window, 0);
+		_next = 0;
+		_consumed = 0;
+		_count = count;
+		_stopped = false;
+
+		std::vector<std::thread> workers;
+		for (int i = 0; i < _threads; i++)
+			workers.push_back(std::thread(&BatchProcessor::work, this, std::cref(producer)));
+
+		try
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				Result result;
+				{
+					std::unique_lock<std::mutex> lock(_mutex);
+					_resultReady.wait(lock, [&] { return _ready[i % _window] != 0; });
+					std::swap(result, _slots[i % _window]);
+					_ready[i % _window] = 0;
+					_consumed = i + 1;
+				}
+				_slotFree.notify_all();
+
+				consumer(i, result);
+				if (_stopped)
+					break;
+			}
+		}
+		catch (...)
+		{
+			// a throwing consumer must not leave joinable threads behind,
+			// stop handing out inputs and let the workers finish their current one
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_count = _next;
+			}
+			_slotFree.notify_all();
+			join(workers);
+			throw;
+		}
+
+		join(workers);
+	}
+
+private:
+	static void join(std::vector<std::thread>& workers)
+	{
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+	}
+
+	void work(const Producer& producer)
+	{
+		for (;;)
+		{
+			size_t index;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_slotFree.wait(lock, [&] { return _next >= _count || _next < _consumed + _window; });
+				if (_next >= _count)
+					return;
+				index = _next++;
+			}
+
+			Result result;
+			try
+			{
+				producer(index, result);
+			}
+			catch (const cv::Exception& e)
+			{
+				// a broken input must not stall the ordered hand-over
+				fprintf(stderr, "Input %d failed: %s\n", (int)index, e.what());
+				result = Result();
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				std::swap(_slots[index % _window], result);
+				_ready[index % _window] = 1;
+			}
+			_resultReady.notify_all();
+		}
+	}
+
+	int _threads;
+	size_t _window;
+
+	std::mutex _mutex;
+	std::condition_variable _resultReady;
+	std::condition_variable _slotFree;
+
+	std::vector<Result> _slots;
+	std::vector<char> _ready;
+	size_t _next;
+	size_t _consumed;
+	size_t _count;
+	bool _stopped;
+};
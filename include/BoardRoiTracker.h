@@ -0,0 +1,111 @@
+/*****************************************************************************
+* Application :		Camera Calibration Application
+*					using OpenCV3 (http://opencv.org/)
+*
+* Author      :		Michael Stengel <virtuellerealitaet@gmail.com>
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+*    1. Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*
+*    2. Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+#include <opencv2/core.hpp>
+
+// Restricts the board search of a live stream to the neighbourhood of the
+// corners found in the previous frame. The region is the bounding box of the
+// last corners, grown by a margin that leaves room for the quiet zone around
+// the board and for the motion between two frames. Corners found in the region
+// are shifted back to frame coordinates. If the board is not found there, the
+// same frame is searched in full before the track counts as lost.
+class BoardRoiTracker
+{
+public:
+	// searches a gray image (or a region of it) and returns the corners in its coordinates
+	typedef std::function<bool(const cv::Mat& image, std::vector<cv::Point2f>& corners)> Finder;
+
+	// margin is relative to the longer side of the last bounding box
+	BoardRoiTracker(float margin = 0.3f, int minMargin = 16)
+		: _margin(margin), _minMargin(minMargin), _roiFrames(0), _fullFrames(0), _lostCount(0)
+	{
+	}
+
+	void reset() { _roi = cv::Rect(); }
+	bool isTracking() const { return _roi.area() > 0; }
+	const cv::Rect& roi() const { return _roi; }
+
+	bool find(const cv::Mat& image, std::vector<cv::Point2f>& corners, const Finder& finder)
+	{
+		cv::Rect imageRect(0, 0, image.cols, image.rows);
+
+		if (isTracking())
+		{
+			cv::Rect roi = _roi & imageRect;
+			if (roi.area() > 0 && finder(image(roi), corners))
+			{
+				cv::Point2f offset((float)roi.x, (float)roi.y);
+				for (size_t i = 0; i < corners.size(); i++)
+					corners[i] += offset;
+				_roiFrames++;
+				update(corners, imageRect);
+				return true;
+			}
+			_lostCount++;
+		}
+
+		_fullFrames++;
+		if (!finder(image, corners))
+		{
+			_roi = cv::Rect();
+			return false;
+		}
+		update(corners, imageRect);
+		return true;
+	}
+
+	size_t roiFrames() const { return _roiFrames; }
+	size_t fullFrames() const { return _fullFrames; }
+	size_t lostCount() const { return _lostCount; }
+
+private:
+	void update(const std::vector<cv::Point2f>& corners, const cv::Rect& imageRect)
+	{
+		cv::Rect box = cv::boundingRect(corners);
+		int margin = std::max(_minMargin, cvRound(_margin * std::max(box.width, box.height)));
+		_roi = cv::Rect(box.x - margin, box.y - margin, box.width + 2 * margin, box.height + 2 * margin) & imageRect;
+	}
+
+	float _margin;
+	int _minMargin;
+	cv::Rect _roi;
+
+	size_t _roiFrames;
+	size_t _fullFrames;
+	size_t _lostCount;
+};
@@ -0,0 +1,115 @@
+/*****************************************************************************
+* Application :		Camera Calibration Application
+*					using OpenCV3 (http://opencv.org/)
+*
+* Author      :		Michael Stengel <virtuellerealitaet@gmail.com>
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+*    1. Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*
+*    2. Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+// Queue between two pipeline stages. By default it never blocks the producer:
+// when it is full, push() drops the oldest item, so a live stage always works
+// on the most recent data instead of falling further behind. Without
+// dropOldest, push() waits for space instead, for inputs where every item
+// counts (e.g. the frames of a video file).
+template <typename T>
+class BoundedQueue
+{
+public:
+	BoundedQueue(size_t capacity = 2, bool dropOldest = true)
+		: _capacity(capacity > 0 ? capacity : 1), _dropOldest(dropOldest), _closed(false), _dropped(0)
+	{
+	}
+
+	// returns false once the queue is closed
+	bool push(T item)
+	{
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			if (!_dropOldest)
+				_space.wait(lock, [&] { return _closed || _items.size() < _capacity; });
+			if (_closed)
+				return false;
+			if (_items.size() >= _capacity)
+			{
+				_items.pop_front();
+				_dropped++;
+			}
+			_items.push_back(std::move(item));
+		}
+		_available.notify_one();
+		return true;
+	}
+
+	// blocks until an item is available, returns false once the queue is closed and empty
+	bool pop(T& item)
+	{
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_available.wait(lock, [&] { return _closed || !_items.empty(); });
+			if (_items.empty())
+				return false;
+			item = std::move(_items.front());
+			_items.pop_front();
+		}
+		_space.notify_one();
+		return true;
+	}
+
+	// wakes all waiting consumers and producers, the items already queued can still be popped
+	void close()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_closed = true;
+		}
+		_available.notify_all();
+		_space.notify_all();
+	}
+
+	size_t dropped() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _dropped;
+	}
+
+private:
+	size_t _capacity;
+	bool _dropOldest;
+	bool _closed;
+	size_t _dropped;
+
+	mutable std::mutex _mutex;
+	std::condition_variable _available;
+	std::condition_variable _space;
+	std::deque<T> _items;
+};
@@ -0,0 +1,145 @@
+/*****************************************************************************
+* Application :		Camera Calibration Application
+*					using OpenCV3 (http://opencv.org/)
+*
+* Author      :		Michael Stengel <virtuellerealitaet@gmail.com>
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+*    1. Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*
+*    2. Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <opencv2/core.hpp>
+
+#include "MappedFile.h"
+
+// Binary calibration container (*.calib), written by runAndSave instead of the
+// FileStorage YAML/XML output when the output file name ends in .calib, for
+// consumers that load large calibrations at startup.
+// The file is a fixed header followed by raw arrays in native byte order,
+// each starting at an 8 byte aligned offset given in the header, so a
+// mapped file can be read in place without parsing:
+//
+//   distortion coefficients    double[distCount]
+//   per view errors            float[views]
+//   extrinsics                 double[views][6]   rotation + translation vector
+//   image points               float[pointViews][pointsPerView][2]
+//   residuals                  float[pointViews][pointsPerView][2]   detected - projected
+//
+// Sections that were not written have offset 0.
+namespace calibcore
+{
+	const uint32_t CALIBRATION_BINARY_VERSION = 1;
+
+	struct BinaryCalibrationHeader
+	{
+		char magic[8];              // "CALIBBIN"
+		uint32_t version;
+		uint32_t headerSize;
+		int32_t imageWidth;
+		int32_t imageHeight;
+		int32_t boardWidth;
+		int32_t boardHeight;
+		float squareSize;
+		float aspectRatio;
+		int32_t flags;
+		int32_t distCount;
+		int32_t views;
+		int32_t pointViews;
+		int32_t pointsPerView;
+		int32_t reserved;
+		double avgReprojectionError;
+		double cameraMatrix[9];
+		uint64_t distOffset;
+		uint64_t viewErrorsOffset;
+		uint64_t extrinsicsOffset;
+		uint64_t pointsOffset;
+		uint64_t residualsOffset;
+		uint64_t fileSize;
+	};
+
+	// everything a calibration file holds, empty members are not written
+	struct CalibrationData
+	{
+		CalibrationData() : squareSize(1.f), aspectRatio(1.f), flags(0), avgReprojectionError(0) {}
+
+		cv::Size imageSize;
+		cv::Size boardSize;
+		float squareSize;
+		float aspectRatio;
+		int flags;
+		double avgReprojectionError;
+		cv::Mat cameraMatrix;
+		cv::Mat distCoeffs;
+		std::vector<float> perViewErrors;
+		std::vector<cv::Mat> rvecs, tvecs;
+		std::vector<std::vector<cv::Point2f> > imagePoints;
+		std::vector<std::vector<cv::Point2f> > residuals;
+	};
+
+	// true for file names ending in .calib
+	bool isBinaryCalibrationFile(const std::string& filename);
+
+	bool saveCalibrationBinary(const std::string& filename, const CalibrationData& data);
+
+	// maps a file written by saveCalibrationBinary and compares every value
+	// with the data it was written from
+	bool verifyCalibrationBinary(const std::string& filename, const CalibrationData& data);
+
+	// Read-only mapping of a binary calibration file. The matrices returned by
+	// the accessors point into the mapping and are only valid while it is open.
+	class MappedCalibration
+	{
+	public:
+		// maps the file and checks the header and section bounds
+		bool open(const std::string& filename);
+		void close() { _file.close(); }
+		bool isOpen() const { return _file.isOpen(); }
+
+		const BinaryCalibrationHeader& header() const { return *(const BinaryCalibrationHeader*)_file.data(); }
+		cv::Size imageSize() const { return cv::Size(header().imageWidth, header().imageHeight); }
+		cv::Size boardSize() const { return cv::Size(header().boardWidth, header().boardHeight); }
+
+		cv::Mat cameraMatrix() const;    // 3x3 CV_64F
+		cv::Mat distCoeffs() const;      // distCount x 1 CV_64F
+		cv::Mat perViewErrors() const;   // views x 1 CV_32F
+		cv::Mat extrinsics() const;      // views x 6 CV_64F
+		cv::Mat imagePoints() const;     // pointViews x pointsPerView CV_32FC2
+		cv::Mat residuals() const;       // pointViews x pointsPerView CV_32FC2
+
+		// deep copy of the mapped contents
+		void read(CalibrationData& data) const;
+
+	private:
+		cv::Mat section(uint64_t offset, int rows, int cols, int type) const;
+
+		MappedFile _file;
+	};
+}
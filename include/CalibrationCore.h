@@ -0,0 +1,104 @@
+/*****************************************************************************
+* Application :		Camera Calibration Application
+*					using OpenCV3 (http://opencv.org/)
+*
+* Author      :		Michael Stengel <virtuellerealitaet@gmail.com>
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+*    1. Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*
+*    2. Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+class CalibrationReport;
+
+// Board geometry, pinhole solve, error evaluation and calibration file I/O
+// shared by the calibration tools (calibcore library). The tools only add
+// their capture loops and, where they use a different camera model, their
+// own solve.
+namespace calibcore
+{
+	enum Pattern { CHESSBOARD, CIRCLES_GRID, ASYMMETRIC_CIRCLES_GRID };
+
+	// object points of the board in board coordinates (z = 0)
+	void calcChessboardCorners(cv::Size boardSize, float squareSize, std::vector<cv::Point3f>& corners,
+		Pattern patternType = CHESSBOARD);
+
+	// RMS error over all points, perViewErrors gets the RMS error of every view
+	double computeReprojectionErrors(const std::vector<std::vector<cv::Point3f> >& objectPoints,
+		const std::vector<std::vector<cv::Point2f> >& imagePoints,
+		const std::vector<cv::Mat>& rvecs, const std::vector<cv::Mat>& tvecs,
+		const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs,
+		std::vector<float>& perViewErrors, bool fisheye = false);
+
+	// pinhole calibration of all views, starting from scratch
+	bool runCalibration(const std::vector<std::vector<cv::Point2f> >& imagePoints,
+		cv::Size imageSize, cv::Size boardSize, Pattern patternType,
+		float squareSize, float aspectRatio,
+		int flags, cv::Mat& cameraMatrix, cv::Mat& distCoeffs,
+		std::vector<cv::Mat>& rvecs, std::vector<cv::Mat>& tvecs,
+		std::vector<float>& reprojErrs,
+		double& totalAvgErr);
+
+	// Solves, then drops the views and the points that do not fit the solution and
+	// solves again, starting from the previous intrinsics. A view is dropped when its
+	// error exceeds threshold times the median view error, a point when its residual
+	// exceeds threshold times the overall error. keptViews returns the indices of the
+	// views used in the last solve.
+	bool runRobustCalibration(const std::vector<std::vector<cv::Point2f> >& imagePoints,
+		cv::Size imageSize, cv::Size boardSize, Pattern patternType,
+		float squareSize, float aspectRatio, int flags,
+		int rounds, float threshold,
+		cv::Mat& cameraMatrix, cv::Mat& distCoeffs,
+		std::vector<cv::Mat>& rvecs, std::vector<cv::Mat>& tvecs,
+		std::vector<float>& reprojErrs, double& totalAvgErr,
+		std::vector<int>& keptViews);
+
+	void saveCameraParams(const std::string& filename,
+		cv::Size imageSize, cv::Size boardSize,
+		float squareSize, float aspectRatio, int flags,
+		const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs,
+		const std::vector<cv::Mat>& rvecs, const std::vector<cv::Mat>& tvecs,
+		const std::vector<float>& reprojErrs,
+		const std::vector<std::vector<cv::Point2f> >& imagePoints,
+		double totalAvgErr);
+
+	// reads the image list written by imagelist_creator
+	bool readStringList(const std::string& filename, std::vector<std::string>& l);
+
+	// calibrates (robustly if robustRounds > 0) and writes the calibration file,
+	// a binary container (CalibrationBinary.h) if its name ends in .calib
+	bool runAndSave(const std::string& outputFilename,
+		const std::vector<std::vector<cv::Point2f> >& imagePoints,
+		cv::Size imageSize, cv::Size boardSize, Pattern patternType, float squareSize,
+		float aspectRatio, int flags, cv::Mat& cameraMatrix,
+		cv::Mat& distCoeffs, bool writeExtrinsics, bool writePoints,
+		CalibrationReport* report = 0, int robustRounds = 0, float robustThreshold = 3.f);
+}
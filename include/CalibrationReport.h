@@ -0,0 +1,120 @@
+/*****************************************************************************
+* Application :		Camera Calibration Application
+*					using OpenCV3 (http://opencv.org/)
+*
+* Author      :		Michael Stengel <virtuellerealitaet@gmail.com>
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+*    1. Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*
+*    2. Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#pragma once
+
+#include <string>
+#include <stdio.h>
+
+#include <opencv2/core.hpp>
+
+// Summary of a headless calibration run. The tools count their frames into it,
+// runAndSave fills in the calibration result, and finish() prints the summary
+// and writes it next to the calibration file.
+class CalibrationReport
+{
+public:
+	CalibrationReport(const std::string& tool = std::string())
+		: tool(tool), framesProcessed(0), framesUnreadable(0), framesSkipped(0), framesWithPattern(0), framesUsed(0),
+		  calibrated(false), avgReprojectionError(0), calibrationSeconds(0)
+	{
+		_startTicks = cv::getTickCount();
+	}
+
+	// calibration_data.yml -> calibration_data_report.yml
+	static std::string reportFilename(const std::string& outputFilename)
+	{
+		std::string::size_type dot = outputFilename.find_last_of('.');
+		std::string::size_type slash = outputFilename.find_last_of("/\\");
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+			return outputFilename + "_report.yml";
+		return outputFilename.substr(0, dot) + "_report.yml";
+	}
+
+	void setCalibration(bool ok, double avgError, double seconds)
+	{
+		calibrated = ok;
+		avgReprojectionError = avgError;
+		calibrationSeconds = seconds;
+	}
+
+	void finish(const std::string& outputFilename)
+	{
+		double totalSeconds = (cv::getTickCount() - _startTicks) / cv::getTickFrequency();
+		double detectionSeconds = totalSeconds - calibrationSeconds;
+
+		printf("\n%s summary\n", tool.c_str());
+		printf("  frames processed       : %d (%d not readable)\n", framesProcessed, framesUnreadable);
+		printf("  frames skipped early   : %d\n", framesSkipped);
+		printf("  frames with pattern    : %d\n", framesWithPattern);
+		printf("  frames used            : %d\n", framesUsed);
+		printf("  calibration            : %s\n", calibrated ? "succeeded" : "failed");
+		if (calibrated)
+			printf("  avg reprojection error : %.4f\n", avgReprojectionError);
+		printf("  detection time         : %.2f s (%.1f frames/s)\n", detectionSeconds,
+			detectionSeconds > 0 ? framesProcessed / detectionSeconds : 0.);
+		printf("  calibration time       : %.2f s\n", calibrationSeconds);
+
+		std::string filename = reportFilename(outputFilename);
+		cv::FileStorage fs(filename, cv::FileStorage::WRITE);
+		if (!fs.isOpened())
+		{
+			printf("Could not write the report %s\n", filename.c_str());
+			return;
+		}
+
+		fs << "tool" << tool;
+		fs << "calibration_file" << outputFilename;
+		fs << "frames_processed" << framesProcessed;
+		fs << "frames_unreadable" << framesUnreadable;
+		fs << "frames_skipped" << framesSkipped;
+		fs << "frames_with_pattern" << framesWithPattern;
+		fs << "frames_used" << framesUsed;
+		fs << "calibrated" << (int)calibrated;
+		fs << "avg_reprojection_error" << avgReprojectionError;
+		fs << "detection_seconds" << detectionSeconds;
+		fs << "calibration_seconds" << calibrationSeconds;
+		printf("Report written to %s\n", filename.c_str());
+	}
+
+	std::string tool;
+	int framesProcessed;
+	int framesUnreadable;
+	int framesSkipped;       // rejected by the board pre-check
+	int framesWithPattern;
+	int framesUsed;
+	bool calibrated;
+	double avgReprojectionError;
+	double calibrationSeconds;
+
+private:
+	int64 _startTicks;
+};
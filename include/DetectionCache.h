@@ -0,0 +1,182 @@
+/*****************************************************************************
+* Application :		Camera Calibration Application
+*					using OpenCV3 (http://opencv.org/)
+*
+* Author      :		Michael Stengel <virtuellerealitaet@gmail.com>
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+*    1. Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*
+*    2. Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+
+#include <opencv2/core.hpp>
+
+// Sidecar file with the pattern detection results of an image list.
+// Every result is stored under a hash of the image file content and of the
+// detector settings, so changing only the calibration flags reuses all
+// detections, while an edited image or a different board or detector setting
+// is detected again. The map is not locked: lookups may run on several threads
+// at once, but store() must not run while any lookup does, so batch callers
+// collect new entries and store them after the batch.
+class DetectionCache
+{
+public:
+	struct Entry
+	{
+		Entry() : found(false) {}
+
+		bool found;
+		cv::Size imageSize;
+		std::vector<cv::Point2f> points;
+	};
+
+	// settings describes everything the detection depends on besides the image
+	DetectionCache(const std::string& filename, const std::string& settings)
+		: _filename(filename), _settings(settings), _modified(false)
+	{
+	}
+
+	const std::string& filename() const { return _filename; }
+
+	size_t size() const { return _entries.size(); }
+
+	// returns false if there is no cache file yet
+	bool load()
+	{
+		_entries.clear();
+		_modified = false;
+
+		cv::FileStorage fs(_filename, cv::FileStorage::READ);
+		if (!fs.isOpened())
+			return false;
+
+		cv::FileNode detections = fs["detections"];
+		for (cv::FileNodeIterator it = detections.begin(); it != detections.end(); ++it)
+		{
+			Entry entry;
+			int found = 0;
+			(*it)["found"] >> found;
+			(*it)["width"] >> entry.imageSize.width;
+			(*it)["height"] >> entry.imageSize.height;
+			(*it)["points"] >> entry.points;
+			entry.found = found != 0;
+			_entries[(std::string)(*it)["key"]] = entry;
+		}
+		return true;
+	}
+
+	// writes the file if entries were added since load()
+	bool save()
+	{
+		if (!_modified)
+			return true;
+
+		cv::FileStorage fs(_filename, cv::FileStorage::WRITE);
+		if (!fs.isOpened())
+			return false;
+
+		fs << "detections" << "[";
+		for (std::map<std::string, Entry>::const_iterator it = _entries.begin(); it != _entries.end(); ++it)
+		{
+			fs << "{" << "key" << it->first
+				<< "found" << (int)it->second.found
+				<< "width" << it->second.imageSize.width
+				<< "height" << it->second.imageSize.height
+				<< "points" << it->second.points << "}";
+		}
+		fs << "]";
+
+		_modified = false;
+		return true;
+	}
+
+	// FNV-1a over the file content followed by the detector settings. The content is
+	// mixed in 64 bit words, hashing must not cost more than decoding the image.
+	std::string key(const std::vector<uchar>& fileContent) const
+	{
+		const cv::uint64 prime = 1099511628211ULL;
+		cv::uint64 hash = 14695981039346656037ULL;
+
+		size_t words = fileContent.size() / sizeof(cv::uint64);
+		for (size_t i = 0; i < words; i++)
+		{
+			cv::uint64 word;
+			memcpy(&word, &fileContent[i * sizeof(cv::uint64)], sizeof(word));
+			hash = (hash ^ word) * prime;
+		}
+		for (size_t i = words * sizeof(cv::uint64); i < fileContent.size(); i++)
+			hash = (hash ^ fileContent[i]) * prime;
+		hash = (hash ^ fileContent.size()) * prime;
+		for (size_t i = 0; i < _settings.size(); i++)
+			hash = (hash ^ (uchar)_settings[i]) * prime;
+
+		char buf[32];
+		sprintf(buf, "%016llx", (unsigned long long)hash);
+		return buf;
+	}
+
+	bool lookup(const std::string& key, Entry& entry) const
+	{
+		std::map<std::string, Entry>::const_iterator it = _entries.find(key);
+		if (it == _entries.end())
+			return false;
+		entry = it->second;
+		return true;
+	}
+
+	void store(const std::string& key, const Entry& entry)
+	{
+		_entries[key] = entry;
+		_modified = true;
+	}
+
+	static bool readFile(const std::string& filename, std::vector<uchar>& content)
+	{
+		std::ifstream file(filename.c_str(), std::ios::binary);
+		if (!file)
+			return false;
+		file.seekg(0, std::ios::end);
+		std::streamoff length = file.tellg();
+		if (length <= 0)
+			return false;
+		content.resize((size_t)length);
+		file.seekg(0, std::ios::beg);
+		return (bool)file.read((char*)&content[0], length);
+	}
+
+private:
+	std::string _filename;
+	std::string _settings;
+	std::map<std::string, Entry> _entries;
+	bool _modified;
+};
@@ -0,0 +1,84 @@
+/*****************************************************************************
+* Application :		Camera Calibration Application
+*					using OpenCV3 (http://opencv.org/)
+*
+* Author      :		Michael Stengel <virtuellerealitaet@gmail.com>
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+*    1. Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*
+*    2. Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+// Cheap per-frame image quality measures used to reject frames before the
+// pattern search.
+class FrameQuality
+{
+public:
+	// variance of the Laplacian of an image (or of a region of it), color images
+	// are converted to gray first. Blur and motion blur take out the high
+	// frequencies and lower it; the scale depends on the scene, useful thresholds
+	// are found by looking at a few frames.
+	static double sharpness(const cv::Mat& image, cv::Rect roi = cv::Rect())
+	{
+		cv::Mat region = roi.area() > 0 ? image(roi & cv::Rect(0, 0, image.cols, image.rows)) : image;
+		if (region.empty())
+			return 0;
+		if (region.channels() == 3)
+			cv::cvtColor(region, region, cv::COLOR_BGR2GRAY);
+
+		cv::Mat laplacian;
+		cv::Laplacian(region, laplacian, CV_16S);
+		cv::Scalar mean, stddev;
+		cv::meanStdDev(laplacian, mean, stddev);
+		return stddev[0] * stddev[0];
+	}
+
+	// sharpness of the board only, the background does not count
+	static double boardSharpness(const cv::Mat& image, const std::vector<cv::Point2f>& corners)
+	{
+		if (corners.empty())
+			return 0;
+		return sharpness(image, cv::boundingRect(corners));
+	}
+
+	// mean displacement of the corners between two detections of the board,
+	// -1 if there is no previous detection to compare with
+	static double cornerMotion(const std::vector<cv::Point2f>& previous, const std::vector<cv::Point2f>& corners)
+	{
+		if (previous.empty() || previous.size() != corners.size())
+			return -1;
+
+		double sum = 0;
+		for (size_t i = 0; i < corners.size(); i++)
+			sum += cv::norm(corners[i] - previous[i]);
+		return sum / corners.size();
+	}
+};
@@ -0,0 +1,157 @@
+/*****************************************************************************
+* Application :		Camera Calibration Application
+*					using OpenCV3 (http://opencv.org/)
+*
+* Author      :		Michael Stengel <virtuellerealitaet@gmail.com>
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+*    1. Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*
+*    2. Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+#pragma once
+
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "BoundedQueue.h"
+
+struct LiveFrame
+{
+	LiveFrame() : index(0), found(false) {}
+
+	size_t index;
+	cv::Mat view;
+	bool found;
+	std::vector<cv::Point2f> points;
+};
+
+// Capture and pattern detection of a live stream on threads of their own.
+// One thread grabs frames into a short queue, a pool of workers takes the
+// newest frames from it and detects the board, and the calling thread picks
+// up the detected frames to draw and show them. Both queues drop their oldest
+// frame when a stage falls behind, so no stage waits for a slower one and the
+// shown frames stay current. Results that arrive after a newer frame was
+// handed out are dropped as well.
+class LivePipeline
+{
+public:
+	// returns false when the stream ended
+	typedef std::function<bool(cv::Mat& view)> Grabber;
+	// runs on the workers with a gray buffer per worker, may modify the view (e.g. flip it)
+	typedef std::function<bool(cv::Mat& view, cv::Mat& gray, std::vector<cv::Point2f>& points)> Detector;
+
+	// threads <= 0 uses one worker per hardware thread
+	LivePipeline(const Grabber& grabber, const Detector& detector, int threads = 0, size_t queueSize = 2)
+		: _grabber(grabber), _detector(detector), _frames(queueSize), _results(queueSize),
+		  _stop(false), _nextIndex(0), _stale(0)
+	{
+		_threads = threads > 0 ? threads : (int)std::thread::hardware_concurrency();
+		if (_threads <= 0)
+			_threads = 1;
+		_running = _threads;
+
+		_capture = std::thread(&LivePipeline::capture, this);
+		for (int i = 0; i < _threads; i++)
+			_workers.push_back(std::thread(&LivePipeline::detect, this));
+	}
+
+	~LivePipeline()
+	{
+		_stop = true;
+		_frames.close();
+		_results.close();
+		_capture.join();
+		for (size_t i = 0; i < _workers.size(); i++)
+			_workers[i].join();
+	}
+
+	int threads() const { return _threads; }
+
+	// blocks until the next detected frame, returns false once the stream ended
+	bool next(LiveFrame& frame)
+	{
+		while (_results.pop(frame))
+		{
+			if (frame.index >= _nextIndex)
+			{
+				_nextIndex = frame.index + 1;
+				return true;
+			}
+			_stale++;
+		}
+		return false;
+	}
+
+	size_t framesDropped() const { return _frames.dropped() + _results.dropped() + _stale; }
+
+private:
+	void capture()
+	{
+		for (size_t index = 0; !_stop; index++)
+		{
+			LiveFrame frame;
+			frame.index = index;
+			if (!_grabber(frame.view) || frame.view.empty())
+				break;
+			_frames.push(std::move(frame));
+		}
+		_frames.close();
+	}
+
+	void detect()
+	{
+		cv::Mat gray;
+		LiveFrame frame;
+		while (_frames.pop(frame))
+		{
+			frame.found = _detector(frame.view, gray, frame.points);
+			_results.push(std::move(frame));
+			frame = LiveFrame();
+		}
+
+		// the last worker ends the stream for the consumer
+		if (--_running == 0)
+			_results.close();
+	}
+
+	Grabber _grabber;
+	Detector _detector;
+	int _threads;
+
+	BoundedQueue<LiveFrame> _frames;
+	BoundedQueue<LiveFrame> _results;
+
+	std::thread _capture;
+	std::vector<std::thread> _workers;
+	std::atomic<bool> _stop;
+	std::atomic<int> _running;
+
+	size_t _nextIndex;
+	size_t _stale;
+};
@@ -0,0 +1,176 @@
+/*****************************************************************************
+* Application :		Camera Calibration Application
+*					using OpenCV3 (http://opencv.org/)
+*
+* Author      :		Michael Stengel <virtuellerealitaet@gmail.com>
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+*    1. Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*
+*    2. Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/calib3d.hpp>
+#include <opencv2/features2d.hpp>
+
+// Coarse-to-fine pattern detection for high-resolution input.
+// The board is searched on a copy of the image that is downscaled until its longer
+// side fits maxDetectionSize, the corners or circle centers found there are mapped
+// back and refined on the full-resolution gray image. Search and refinement both
+// run on the one gray image the caller converted, the color view is not touched.
+// The default blob detector is created once per instance. It only holds its
+// parameters, so one instance can be shared by several detection threads.
+class PatternDetector
+{
+public:
+	// maxDetectionSize <= 0 searches at full resolution
+	PatternDetector(int maxDetectionSize = 0)
+		: _maxDetectionSize(maxDetectionSize), _blobDetector(cv::SimpleBlobDetector::create())
+	{
+	}
+
+	int maxDetectionSize() const { return _maxDetectionSize; }
+
+	// factor from full resolution to the detection level, 1 if the image is small enough
+	double detectionScale(cv::Size imageSize) const
+	{
+		int longerSide = std::max(imageSize.width, imageSize.height);
+		if (_maxDetectionSize <= 0 || longerSide <= _maxDetectionSize)
+			return 1.0;
+		return (double)_maxDetectionSize / longerSide;
+	}
+
+	bool findChessboard(const cv::Mat& viewGray, cv::Size boardSize,
+		std::vector<cv::Point2f>& corners, int flags) const
+	{
+		double scale = detectionScale(viewGray.size());
+
+		cv::Mat small;
+		if (!cv::findChessboardCorners(downscale(viewGray, scale, small), boardSize, corners, flags))
+			return false;
+		upscale(corners, scale);
+
+		// the window has to cover the error of the coarse level
+		int halfWindow = std::max(11, cvCeil(2.0 / scale));
+		cv::cornerSubPix(viewGray, corners, cv::Size(halfWindow, halfWindow), cv::Size(-1, -1),
+			cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 30, 0.1));
+		return true;
+	}
+
+	// the blob detector works on the detection level, blobColor is the one it looks for,
+	// an empty blobDetector uses the default one of the instance
+	bool findCirclesGrid(const cv::Mat& viewGray, cv::Size boardSize,
+		std::vector<cv::Point2f>& centers, int flags,
+		const cv::Ptr<cv::FeatureDetector>& blobDetector = cv::Ptr<cv::FeatureDetector>(),
+		int blobColor = 0) const
+	{
+		double scale = detectionScale(viewGray.size());
+
+		cv::Mat small;
+		if (!cv::findCirclesGrid(downscale(viewGray, scale, small), boardSize, centers, flags,
+			blobDetector.empty() ? _blobDetector : blobDetector))
+			return false;
+
+		if (scale < 1.0)
+		{
+			upscale(centers, scale);
+			refineCircleCenters(viewGray, centers, blobColor);
+		}
+		return true;
+	}
+
+	// moves every center to the centroid of the circle it lies in, the window is
+	// sized from the distance to the closest neighbour so it holds a single circle
+	static void refineCircleCenters(const cv::Mat& gray, std::vector<cv::Point2f>& centers, int blobColor = 0)
+	{
+		cv::Rect imageRect(0, 0, gray.cols, gray.rows);
+		cv::Mat mask;
+		std::vector<std::vector<cv::Point> > contours;
+
+		for (size_t i = 0; i < centers.size(); i++)
+		{
+			float closest = FLT_MAX;
+			for (size_t j = 0; j < centers.size(); j++)
+				if (j != i)
+					closest = std::min(closest, (float)cv::norm(centers[i] - centers[j]));
+			if (closest == FLT_MAX)
+				return;
+
+			int radius = cvRound(0.35f * closest);
+			if (radius < 2)
+				continue;
+
+			cv::Rect window = cv::Rect(cvRound(centers[i].x) - radius, cvRound(centers[i].y) - radius,
+				2 * radius + 1, 2 * radius + 1) & imageRect;
+			if (window.area() == 0)
+				continue;
+
+			cv::threshold(gray(window), mask, 0, 255,
+				(blobColor == 0 ? cv::THRESH_BINARY_INV : cv::THRESH_BINARY) | cv::THRESH_OTSU);
+			cv::findContours(mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
+
+			cv::Point2f local = centers[i] - cv::Point2f((float)window.x, (float)window.y);
+			for (size_t c = 0; c < contours.size(); c++)
+			{
+				if (cv::pointPolygonTest(contours[c], local, false) < 0)
+					continue;
+
+				cv::Moments m = cv::moments(contours[c]);
+				if (m.m00 > 0)
+					centers[i] = cv::Point2f((float)(m.m10 / m.m00) + window.x, (float)(m.m01 / m.m00) + window.y);
+				break;
+			}
+		}
+	}
+
+private:
+	static const cv::Mat& downscale(const cv::Mat& view, double scale, cv::Mat& small)
+	{
+		if (scale >= 1.0)
+			return view;
+		cv::resize(view, small, cv::Size(), scale, scale, cv::INTER_AREA);
+		return small;
+	}
+
+	// pixel centers map as (p + 0.5) / scale - 0.5
+	static void upscale(std::vector<cv::Point2f>& points, double scale)
+	{
+		if (scale >= 1.0)
+			return;
+		float inverse = (float)(1.0 / scale);
+		float offset = 0.5f * inverse - 0.5f;
+		for (size_t i = 0; i < points.size(); i++)
+			points[i] = points[i] * inverse + cv::Point2f(offset, offset);
+	}
+
+	int _maxDetectionSize;
+	cv::Ptr<cv::FeatureDetector> _blobDetector;
+};
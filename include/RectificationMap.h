@@ -0,0 +1,109 @@
+/*****************************************************************************
+* Application :		Camera Calibration Application
+*					using OpenCV3 (http://opencv.org/)
+*
+* Author      :		Michael Stengel <virtuellerealitaet@gmail.com>
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+*    1. Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*
+*    2. Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <opencv2/core.hpp>
+
+#include "MappedFile.h"
+
+// Undistortion/rectification maps (CV_16SC2 + CV_16UC1, as built by
+// initUndistortRectifyMap) with a cache on disk. The maps are stored in
+// <directory>/<key>.map, the key is a hash of everything the maps depend on:
+// camera model, camera matrix, distortion, rectification R, projection P and
+// image size. The parameters are stored in the file as well and compared on
+// load, so a key collision rebuilds the maps instead of using wrong ones.
+// A cached file is mapped into memory and used in place, so a
+// tool that starts with a known calibration does not build or parse maps.
+namespace calibcore
+{
+	const uint32_t RECTIFICATION_MAP_VERSION = 2;
+
+	struct RectificationMapHeader
+	{
+		char magic[8];              // "RECTMAP\0"
+		uint32_t version;
+		uint32_t headerSize;
+		int32_t width;
+		int32_t height;
+		int32_t map1Type;
+		int32_t map2Type;
+		uint64_t key;
+		uint64_t paramsOffset;       // double[paramsCount], the hashed parameters
+		uint64_t paramsCount;
+		uint64_t map1Offset;
+		uint64_t map2Offset;
+		uint64_t fileSize;
+	};
+
+	class RectificationMap
+	{
+	public:
+		enum Model { PINHOLE_MODEL, FISHEYE_MODEL };
+
+		RectificationMap() : _fromCache(false) {}
+
+		// FNV-1a hash of the map parameters, names the cache file
+		static uint64_t key(const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs,
+			const cv::Mat& R, const cv::Mat& P, cv::Size imageSize, Model model = PINHOLE_MODEL);
+
+		// maps the cached maps for these parameters, or builds them and adds them to the
+		// cache. An empty directory builds the maps without a cache.
+		bool init(const std::string& directory, const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs,
+			const cv::Mat& R, const cv::Mat& P, cv::Size imageSize, Model model = PINHOLE_MODEL);
+
+		void release();
+
+		bool isValid() const { return !_map1.empty(); }
+		bool fromCache() const { return _fromCache; }
+
+		// read-only when they come from the cache
+		const cv::Mat& map1() const { return _map1; }
+		const cv::Mat& map2() const { return _map2; }
+
+		void apply(const cv::Mat& src, cv::Mat& dst) const;
+
+	private:
+		bool load(const std::string& filename, cv::Size imageSize, const std::vector<double>& params);
+		static bool save(const std::string& filename, const cv::Mat& map1, const cv::Mat& map2,
+			const std::vector<double>& params);
+
+		MappedFile _file;
+		cv::Mat _map1;
+		cv::Mat _map2;
+		bool _fromCache;
+	};
+}
@@ -0,0 +1,153 @@
+/*****************************************************************************
+* Application :		Camera Calibration Application
+*					using OpenCV3 (http://opencv.org/)
+*
+* Author      :		Michael Stengel <virtuellerealitaet@gmail.com>
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+*    1. Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*
+*    2. Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+#pragma once
+
+#include <vector>
+#include <math.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/calib3d.hpp>
+
+// Reprojection errors of a calibration, evaluated for all views in parallel.
+// The projected points and residuals are kept in buffers that are reused by
+// the next compute() call, so repeated evaluations on the same view set (e.g.
+// in outlier rejection rounds) do not allocate.
+class ReprojectionErrors
+{
+public:
+	enum Model { PINHOLE_MODEL, FISHEYE_MODEL };
+
+	ReprojectionErrors(Model model = PINHOLE_MODEL)
+		: _model(model), _totalAvgErr(0)
+	{
+	}
+
+	// returns the RMS error over all points
+	double compute(const std::vector<std::vector<cv::Point3f> >& objectPoints,
+		const std::vector<std::vector<cv::Point2f> >& imagePoints,
+		const std::vector<cv::Mat>& rvecs, const std::vector<cv::Mat>& tvecs,
+		const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs)
+	{
+		size_t views = objectPoints.size();
+		_projected.resize(views);
+		_residuals.resize(views);
+		_squaredErrors.resize(views);
+		_perViewErrors.resize(views);
+
+		Invoker invoker(*this, objectPoints, imagePoints, rvecs, tvecs, cameraMatrix, distCoeffs);
+		cv::parallel_for_(cv::Range(0, (int)views), invoker);
+
+		// summed in view order, the result does not depend on the thread schedule
+		double totalErr = 0;
+		size_t totalPoints = 0;
+		for (size_t i = 0; i < views; i++)
+		{
+			size_t n = objectPoints[i].size();
+			_perViewErrors[i] = n > 0 ? (float)sqrt(_squaredErrors[i] / n) : 0.f;
+			totalErr += _squaredErrors[i];
+			totalPoints += n;
+		}
+
+		_totalAvgErr = totalPoints > 0 ? sqrt(totalErr / totalPoints) : 0.;
+		return _totalAvgErr;
+	}
+
+	double totalAvgErr() const { return _totalAvgErr; }
+
+	// RMS error of every view
+	const std::vector<float>& perViewErrors() const { return _perViewErrors; }
+
+	// detected minus projected position of every point
+	const std::vector<std::vector<cv::Point2f> >& residuals() const { return _residuals; }
+
+	const std::vector<std::vector<cv::Point2f> >& projectedPoints() const { return _projected; }
+
+private:
+	class Invoker : public cv::ParallelLoopBody
+	{
+	public:
+		Invoker(ReprojectionErrors& errors,
+			const std::vector<std::vector<cv::Point3f> >& objectPoints,
+			const std::vector<std::vector<cv::Point2f> >& imagePoints,
+			const std::vector<cv::Mat>& rvecs, const std::vector<cv::Mat>& tvecs,
+			const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs)
+			: errors(errors), objectPoints(objectPoints), imagePoints(imagePoints),
+			  rvecs(rvecs), tvecs(tvecs), cameraMatrix(cameraMatrix), distCoeffs(distCoeffs)
+		{
+		}
+
+		void operator()(const cv::Range& range) const
+		{
+			for (int i = range.start; i < range.end; i++)
+			{
+				std::vector<cv::Point2f>& projected = errors._projected[i];
+				std::vector<cv::Point2f>& residuals = errors._residuals[i];
+
+				if (errors._model == FISHEYE_MODEL)
+					cv::fisheye::projectPoints(objectPoints[i], projected, rvecs[i], tvecs[i], cameraMatrix, distCoeffs);
+				else
+					cv::projectPoints(objectPoints[i], rvecs[i], tvecs[i], cameraMatrix, distCoeffs, projected);
+
+				const std::vector<cv::Point2f>& detected = imagePoints[i];
+				size_t n = detected.size();
+				residuals.resize(n);
+				double sum = 0;
+				for (size_t j = 0; j < n; j++)
+				{
+					cv::Point2f d = detected[j] - projected[j];
+					residuals[j] = d;
+					sum += (double)d.x * d.x + (double)d.y * d.y;
+				}
+				errors._squaredErrors[i] = sum;
+			}
+		}
+
+	private:
+		Invoker& operator=(const Invoker&);
+
+		ReprojectionErrors& errors;
+		const std::vector<std::vector<cv::Point3f> >& objectPoints;
+		const std::vector<std::vector<cv::Point2f> >& imagePoints;
+		const std::vector<cv::Mat>& rvecs;
+		const std::vector<cv::Mat>& tvecs;
+		const cv::Mat& cameraMatrix;
+		const cv::Mat& distCoeffs;
+	};
+
+	Model _model;
+	double _totalAvgErr;
+	std::vector<std::vector<cv::Point2f> > _projected;
+	std::vector<std::vector<cv::Point2f> > _residuals;
+	std::vector<double> _squaredErrors;
+	std::vector<float> _perViewErrors;
+};
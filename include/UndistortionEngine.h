@@ -0,0 +1,128 @@
+/*****************************************************************************
+* Application :		Camera Calibration Application
+*					using OpenCV3 (http://opencv.org/)
+*
+* Author      :		Michael Stengel <virtuellerealitaet@gmail.com>
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+*    1. Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*
+*    2. Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/calib3d.hpp>
+
+#include "RectificationMap.h"
+
+// Undistorts frames with a pair of fixed-point CV_16SC2 maps that are built once
+// per calibration result. undistort() and fisheye::undistortImage() rebuild the
+// maps on every call, here a frame only costs one remap. With a cache directory
+// the maps of a calibration seen before are mapped from disk (RectificationMap).
+class UndistortionEngine
+{
+public:
+	enum Model { PINHOLE_MODEL, FISHEYE_MODEL };
+
+	// alpha in [0,1] is the free scaling of getOptimalNewCameraMatrix (the balance of
+	// the fisheye model), a negative alpha keeps the camera matrix like undistort() does
+	UndistortionEngine(Model model = PINHOLE_MODEL, double alpha = 1.0)
+		: _model(model), _alpha(alpha)
+	{
+	}
+
+	// an empty directory (the default) builds the maps in memory only
+	void setCacheDirectory(const std::string& directory) { _cacheDirectory = directory; }
+
+	// rebuilds the maps if the calibration or the image size changed since the last call,
+	// returns true if the maps are valid
+	bool update(const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs, cv::Size imageSize)
+	{
+		if (cameraMatrix.empty() || imageSize.area() == 0)
+			return false;
+
+		if (_maps.isValid() && imageSize == _imageSize &&
+			sameMat(cameraMatrix, _cameraMatrix) && sameMat(distCoeffs, _distCoeffs))
+			return true;
+
+		cameraMatrix.copyTo(_cameraMatrix);
+		distCoeffs.copyTo(_distCoeffs);
+		_imageSize = imageSize;
+
+		if (_model == FISHEYE_MODEL)
+		{
+			if (_alpha < 0)
+				_cameraMatrix.copyTo(_newCameraMatrix);
+			else
+				cv::fisheye::estimateNewCameraMatrixForUndistortRectify(_cameraMatrix, _distCoeffs, imageSize,
+					cv::Matx33d::eye(), _newCameraMatrix, _alpha);
+			return _maps.init(_cacheDirectory, _cameraMatrix, _distCoeffs, cv::Mat::eye(3, 3, CV_64F),
+				_newCameraMatrix, imageSize, calibcore::RectificationMap::FISHEYE_MODEL);
+		}
+
+		if (_alpha < 0)
+			_cameraMatrix.copyTo(_newCameraMatrix);
+		else
+			_newCameraMatrix = cv::getOptimalNewCameraMatrix(_cameraMatrix, _distCoeffs, imageSize, _alpha);
+		return _maps.init(_cacheDirectory, _cameraMatrix, _distCoeffs, cv::Mat(), _newCameraMatrix, imageSize);
+	}
+
+	// drops the maps, e.g. when the calibration is thrown away
+	void reset()
+	{
+		_maps.release();
+	}
+
+	bool isValid() const { return _maps.isValid(); }
+
+	const cv::Mat& newCameraMatrix() const { return _newCameraMatrix; }
+
+	// src must have the size passed to update(), dst must not share its data
+	void apply(const cv::Mat& src, cv::Mat& dst) const
+	{
+		CV_Assert(isValid() && src.size() == _imageSize);
+		_maps.apply(src, dst);
+	}
+
+private:
+	static bool sameMat(const cv::Mat& a, const cv::Mat& b)
+	{
+		if (a.size() != b.size() || a.type() != b.type())
+			return false;
+		return a.empty() || cv::norm(a, b, cv::NORM_INF) == 0;
+	}
+
+	Model _model;
+	double _alpha;
+
+	cv::Mat _cameraMatrix;
+	cv::Mat _distCoeffs;
+	cv::Size _imageSize;
+
+	cv::Mat _newCameraMatrix;
+	std::string _cacheDirectory;
+	calibcore::RectificationMap _maps;
+};
@@ -0,0 +1,150 @@
+/*****************************************************************************
+* Application :		Camera Calibration Application
+*					using OpenCV3 (http://opencv.org/)
+*
+* Author      :		Michael Stengel <virtuellerealitaet@gmail.com>
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+*    1. Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*
+*    2. Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+#pragma once
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "BoundedQueue.h"
+
+// Decodes a video file on a thread of its own, so decoding overlaps with the
+// pattern search of the calling thread. Only every step-th frame is handed
+// out: the frames in between are grabbed without being converted, or with
+// seek the stream jumps straight to the next sampled frame (the decoder then
+// starts at the keyframe before it, which pays off for steps longer than the
+// keyframe interval). An optional filter runs on the decode thread and drops
+// frames that are not worth a full pattern search.
+class VideoStream
+{
+public:
+	struct Frame
+	{
+		Frame() : index(0), msec(0) {}
+
+		int index;      // frame number in the file
+		double msec;    // position on the video clock
+		cv::Mat view;
+	};
+
+	// returns false for frames that can be skipped
+	typedef std::function<bool(const cv::Mat& view)> Filter;
+
+	VideoStream(int step = 1, bool seek = false, size_t queueSize = 4)
+		: _step(step > 1 ? step : 1), _seek(seek), _frames(queueSize, false),
+		  _stop(false), _decoded(0), _rejected(0)
+	{
+	}
+
+	~VideoStream()
+	{
+		close();
+	}
+
+	bool open(const std::string& filename, const Filter& filter = Filter())
+	{
+		if (!_capture.open(filename))
+			return false;
+		_filter = filter;
+		_thread = std::thread(&VideoStream::decode, this);
+		return true;
+	}
+
+	// blocks until the next sampled frame that passed the filter, false at the end of the file
+	bool next(Frame& frame) { return _frames.pop(frame); }
+
+	// stops and joins the decode thread, the counters are final afterwards
+	void close()
+	{
+		_stop = true;
+		_frames.close();
+		if (_thread.joinable())
+			_thread.join();
+	}
+
+	int framesDecoded() const { return _decoded; }
+	int framesRejected() const { return _rejected; }
+
+private:
+	void decode()
+	{
+		for (int index = 0; !_stop; index += _step)
+		{
+			if (_seek && index > 0 && !_capture.set(cv::CAP_PROP_POS_FRAMES, index))
+				break;
+
+			// the capture reuses its buffer for the next frame
+			Frame frame;
+			cv::Mat view0;
+			if (!_capture.read(view0) || view0.empty())
+				break;
+			view0.copyTo(frame.view);
+			frame.index = index;
+			frame.msec = _capture.get(cv::CAP_PROP_POS_MSEC);
+			_decoded++;
+
+			if (!_seek)
+			{
+				bool more = true;
+				for (int i = 1; i < _step && more; i++)
+					more = _capture.grab();
+				if (!more)
+					_stop = true;
+			}
+
+			if (_filter && !_filter(frame.view))
+			{
+				_rejected++;
+				continue;
+			}
+			if (!_frames.push(std::move(frame)))
+				break;
+		}
+		_frames.close();
+	}
+
+	int _step;
+	bool _seek;
+	cv::VideoCapture _capture;
+	Filter _filter;
+
+	BoundedQueue<Frame> _frames;
+	std::thread _thread;
+	std::atomic<bool> _stop;
+	std::atomic<int> _decoded;
+	std::atomic<int> _rejected;
+};
@@ -0,0 +1,184 @@
+/*****************************************************************************
+* Application :		Camera Calibration Application
+*					using OpenCV3 (http://opencv.org/)
+*
+* Author      :		Michael Stengel <virtuellerealitaet@gmail.com>
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+*    1. Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*
+*    2. Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <math.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/calib3d.hpp>
+
+// Decides which detected board views are worth keeping for the calibration.
+// Each candidate is posed with solvePnP under the current intrinsics guess.
+// A view is dropped when an accepted view already has nearly the same pose and
+// it covers no new part of the image. The selection is complete once the
+// boards cover most of the image and are tilted far enough around both axes.
+class ViewSelector
+{
+public:
+	ViewSelector(const std::vector<cv::Point3f>& objectPoints,
+		double minAngleDegrees = 10, double coverageGoal = 0.8, double tiltGoalDegrees = 40,
+		int minViews = 8, int gridCols = 8, int gridRows = 6)
+		: _objectPoints(objectPoints), _minAngle(minAngleDegrees), _coverageGoal(coverageGoal),
+		  _tiltGoal(tiltGoalDegrees), _minViews(minViews), _gridSize(gridCols, gridRows)
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		_imageSize = cv::Size();
+		_covered = cv::Mat::zeros(_gridSize, CV_8U);
+		_normals.clear();
+		_positions.clear();
+		_tiltMin = cv::Point2d(0, 0);
+		_tiltMax = cv::Point2d(0, 0);
+	}
+
+	// rough pinhole guess for when no calibration is available yet
+	static cv::Mat defaultCameraMatrix(cv::Size imageSize)
+	{
+		double f = std::max(imageSize.width, imageSize.height);
+		return (cv::Mat_<double>(3, 3) << f, 0, 0.5 * (imageSize.width - 1), 0, f, 0.5 * (imageSize.height - 1), 0, 0, 1);
+	}
+
+	// returns true if the view should be added, cameraMatrix may be empty
+	bool consider(const std::vector<cv::Point2f>& imagePoints, cv::Size imageSize,
+		const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs)
+	{
+		if (imagePoints.size() != _objectPoints.size())
+			return false;
+		if (imageSize != _imageSize)
+		{
+			reset();
+			_imageSize = imageSize;
+		}
+
+		cv::Mat K = cameraMatrix.empty() ? defaultCameraMatrix(imageSize) : cameraMatrix;
+		cv::Mat rvec, tvec;
+		if (!cv::solvePnP(_objectPoints, imagePoints, K, distCoeffs, rvec, tvec))
+			return false;
+
+		cv::Mat R;
+		cv::Rodrigues(rvec, R);
+		cv::Point3d normal(R.at<double>(0, 2), R.at<double>(1, 2), R.at<double>(2, 2));
+		if (normal.z < 0)
+			normal = -normal;
+		cv::Point3d position(tvec.at<double>(0), tvec.at<double>(1), tvec.at<double>(2));
+
+		cv::Mat cells = coveredCells(imagePoints);
+		int newCells = cv::countNonZero(cells & ~_covered);
+
+		if (newCells == 0)
+		{
+			double cosMinAngle = cos(_minAngle * CV_PI / 180);
+			for (size_t i = 0; i < _normals.size(); i++)
+			{
+				// same orientation, and the board moved by less than a tenth of its distance
+				if (normal.dot(_normals[i]) > cosMinAngle &&
+					cv::norm(position - _positions[i]) < 0.1 * cv::norm(_positions[i]))
+					return false;
+			}
+		}
+
+		_covered |= cells;
+		_normals.push_back(normal);
+		_positions.push_back(position);
+
+		cv::Point2d tilt(atan2(normal.x, normal.z) * 180 / CV_PI, atan2(normal.y, normal.z) * 180 / CV_PI);
+		if (_normals.size() == 1)
+			_tiltMin = _tiltMax = tilt;
+		_tiltMin = cv::Point2d(std::min(_tiltMin.x, tilt.x), std::min(_tiltMin.y, tilt.y));
+		_tiltMax = cv::Point2d(std::max(_tiltMax.x, tilt.x), std::max(_tiltMax.y, tilt.y));
+		return true;
+	}
+
+	// fraction of the image grid cells covered by an accepted board
+	double coverage() const
+	{
+		return (double)cv::countNonZero(_covered) / _covered.total();
+	}
+
+	// smaller of the tilt ranges around the two image axes, in degrees
+	double tiltSpread() const
+	{
+		return std::min(_tiltMax.x - _tiltMin.x, _tiltMax.y - _tiltMin.y);
+	}
+
+	int views() const { return (int)_normals.size(); }
+
+	bool complete() const
+	{
+		return views() >= _minViews && coverage() >= _coverageGoal && tiltSpread() >= _tiltGoal;
+	}
+
+	std::string status() const
+	{
+		return cv::format("cov %d%% tilt %d", cvRound(coverage() * 100), cvRound(tiltSpread()));
+	}
+
+private:
+	cv::Mat coveredCells(const std::vector<cv::Point2f>& imagePoints) const
+	{
+		cv::Point2f scale((float)_gridSize.width / _imageSize.width, (float)_gridSize.height / _imageSize.height);
+		std::vector<cv::Point2f> hull;
+		cv::convexHull(imagePoints, hull);
+
+		// cells whose center lies inside the board outline
+		cv::Mat cells = cv::Mat::zeros(_gridSize, CV_8U);
+		for (int y = 0; y < _gridSize.height; y++)
+			for (int x = 0; x < _gridSize.width; x++)
+			{
+				cv::Point2f center((x + 0.5f) / scale.x, (y + 0.5f) / scale.y);
+				if (cv::pointPolygonTest(hull, center, false) >= 0)
+					cells.at<uchar>(y, x) = 255;
+			}
+		return cells;
+	}
+
+	std::vector<cv::Point3f> _objectPoints;
+	double _minAngle;
+	double _coverageGoal;
+	double _tiltGoal;
+	int _minViews;
+	cv::Size _gridSize;
+
+	cv::Size _imageSize;
+	cv::Mat _covered;
+	std::vector<cv::Point3d> _normals;
+	std::vector<cv::Point3d> _positions;
+	cv::Point2d _tiltMin, _tiltMax;
+};
@@ -66,12 +66,12 @@
 #include <ctype.h>
 
  // OpenCV
-#include <opencv2\core.hpp>
-#include <opencv2\imgproc.hpp>
-#include <opencv2\calib3d.hpp>
-#include <opencv2\highgui.hpp>
-#include <opencv2\imgcodecs.hpp>
-#include <opencv2\features2d.hpp>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/calib3d.hpp>
+#include <opencv2/highgui.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/features2d.hpp>
 
 //#include "precomp.hpp"
 
@@ -106,14 +106,18 @@ private:
 class Graph
 {
 public:
-  typedef std::set<size_t> Neighbors;
+  //sorted neighbor ids
+  typedef std::vector<size_t> Neighbors;
   struct Vertex
   {
     Neighbors neighbors;
   };
-  typedef std::map<size_t, Vertex> Vertices;
+  typedef std::vector<Vertex> Vertices;
 
-  Graph(size_t n);
+  Graph(size_t n = 0);
+  //removes all edges and resizes to n vertices, the neighbor lists keep their capacity
+  void reset(size_t n);
+  size_t capacityBytes() const;
   void addVertex(size_t id);
   void addEdge(size_t id1, size_t id2);
   void removeEdge(size_t id1, size_t id2);
@@ -121,10 +125,13 @@ public:
   bool areVerticesAdjacent(size_t id1, size_t id2) const;
   size_t getVerticesCount() const;
   size_t getDegree(size_t id) const;
+  size_t getEdgesCount() const;
   const Neighbors& getNeighbors(size_t id) const;
   void floydWarshall(cv::Mat &distanceMatrix, int infinity = -1) const;
 private:
+  //vertices beyond verticesCount are spare ones kept from earlier resets
   Vertices vertices;
+  size_t verticesCount;
 };
 
 struct Path
@@ -160,6 +167,11 @@ struct CirclesGridFinderParameters
   float convexHullFactor;
   float minRNGEdgeSwitchDist;
 
+  //evaluate independent candidates (kmeans attempts, basis graph paths, above/below confidences) on the OpenCV worker pool
+  bool parallelEvaluation;
+  //every kmeans attempt i is seeded with kmeansSeed + i, so serial and parallel evaluation give identical results
+  cv::uint64 kmeansSeed;
+
   enum GridType
   {
     SYMMETRIC_GRID, ASYMMETRIC_GRID
@@ -167,12 +179,114 @@ struct CirclesGridFinderParameters
   GridType gridType;
 };
 
+//grow-only int buffer handing out matrix headers, so the matrices of later detections reuse the memory of earlier ones
+class CirclesGridMatrixArena
+{
+public:
+  //all matrices stay valid until the next call
+  void acquire(int count, int rows, int cols, std::vector<cv::Mat> &matrices);
+  size_t capacityBytes() const;
+private:
+  std::vector<int> buffer;
+};
+
+//intermediate buffers of CirclesGridFinder, cleared between detections without releasing their capacity
+struct CirclesGridFinderWorkspace
+{
+  size_t capacityBytes() const;
+
+  std::vector<cv::Point2f> vectors;
+  std::vector<cv::Point2f> tmpVectors;
+  std::vector<cv::Point2f> filteredVectors;
+  std::vector<cv::Point2f> basis;
+  std::vector<int> basisIndices;
+  Graph rng;
+  std::vector<Graph> basisGraphs;
+
+  std::vector<cv::Mat> attemptLabels;
+  std::vector<cv::Mat> attemptCenters;
+  std::vector<double> compactness;
+  CirclesGridMatrixArena labelsArena;
+  std::vector<std::vector<cv::Point2f> > clusters;
+  std::vector<std::vector<cv::Point2f> > hulls;
+
+  std::vector<cv::Mat> distanceMatrices;
+  std::vector<cv::Mat> predecessorMatrices;
+  CirclesGridMatrixArena distanceArena;
+  CirclesGridMatrixArena predecessorArena;
+  Path longestPath;
+  std::vector<size_t> holesRow;
+
+  std::vector<size_t> candidates[2];
+  std::vector<size_t> seeds[2];
+  std::vector<std::vector<size_t> > holesRowPool;
+  std::vector<size_t> vertexIds;
+};
+
+struct CirclesGridFinderStatistics
+{
+  CirclesGridFinderStatistics();
+  //findHoles calls since construction
+  size_t detections;
+  //detections that had to enlarge a buffer of the finder, stays constant once the finder is warmed up
+  size_t workspaceGrowths;
+  size_t lastGrowthDetection;
+  //capacity held by the keypoints, holes and workspace buffers
+  size_t workspaceBytes;
+};
+
+//what happened in the last findHoles call, only filled when the caller attached it with setTrace
+struct CirclesGridFinderTrace
+{
+  enum FailureReason
+  {
+    NO_FAILURE, NO_SAMPLES, NO_DENSE_SAMPLES, NO_BASIS, DEGENERATE_BASIS, WRONG_ROWS_COUNT, WRONG_ROW_SIZE,
+    DUPLICATE_HOLES, UNKNOWN_GRID_TYPE, EXCEPTION
+  };
+
+  CirclesGridFinderTrace();
+  void clear();
+  static const char* getFailureReasonName(FailureReason reason);
+  void write(std::ostream &out) const;
+
+  //wall times in milliseconds
+  double rngTime;
+  double densityFilterTime;
+  double basisTime;
+  //includes longestPathTime
+  double mcsTime;
+  double longestPathTime;
+  double detectionCheckTime;
+  double totalTime;
+
+  size_t keypointsCount;
+  //keypoints inserted for holes without a detected blob
+  size_t addedKeypointsCount;
+  size_t rngEdgesCount;
+  size_t gridVectorsCount;
+  size_t filteredVectorsCount;
+  int kmeansAttempts;
+  int bestKmeansAttempt;
+  size_t basisEdgesCount[2];
+  int longestPathLength;
+  int addedLines;
+  int rejectedLines;
+
+  FailureReason failureReason;
+};
+
 class CirclesGridFinder
 {
 public:
   CirclesGridFinder(cv::Size patternSize, const std::vector<cv::Point2f> &testKeypoints,
                     const CirclesGridFinderParameters &parameters = CirclesGridFinderParameters());
+  //persistent finder, call reset with the keypoints of every new frame before findHoles
+  CirclesGridFinder(cv::Size patternSize, const CirclesGridFinderParameters &parameters = CirclesGridFinderParameters());
+  void reset(const std::vector<cv::Point2f> &testKeypoints);
   bool findHoles();
+  const CirclesGridFinderStatistics& getStatistics() const;
+  //the trace is filled by every following findHoles call, pass 0 to stop tracing
+  void setTrace(CirclesGridFinderTrace *trace);
   static cv::Mat rectifyGrid(cv::Size detectedGridSize, const std::vector<cv::Point2f>& centers, const std::vector<
       cv::Point2f> &keypoint, std::vector<cv::Point2f> &warpedKeypoints);
 
@@ -194,7 +308,7 @@ private:
   void findMCS(const std::vector<cv::Point2f> &basis, std::vector<Graph> &basisGraphs);
   size_t findLongestPath(std::vector<Graph> &basisGraphs, Path &bestPath);
   float computeGraphConfidence(const std::vector<Graph> &basisGraphs, bool addRow, const std::vector<size_t> &points,
-                               const std::vector<size_t> &seeds);
+                               const std::vector<size_t> &seeds) const;
   void addHolesByGraph(const std::vector<Graph> &basisGraphs, bool addRow, cv::Point2f basisVec);
 
   size_t findNearestKeypoint(cv::Point2f pt) const;
@@ -205,10 +319,16 @@ private:
                           std::vector<size_t> &aboveSeeds, std::vector<size_t> &belowSeeds);
   static bool areCentersNew(const std::vector<size_t> &newCenters, const std::vector<std::vector<size_t> > &holes);
   bool isDetectionCorrect();
+  bool detectHoles();
+  void updateStatistics();
+  void setFailure(CirclesGridFinderTrace::FailureReason reason) const;
 
-  static void insertWinner(float aboveConfidence, float belowConfidence, float minConfidence, bool addRow,
-                           const std::vector<size_t> &above, const std::vector<size_t> &below, std::vector<std::vector<
-                               size_t> > &holes);
+  //moves the rows into the row pool, so their capacity is reused by later rows
+  void recycleHoles(std::vector<std::vector<size_t> > &rows);
+  void takeHolesRow(std::vector<size_t> &row);
+  void insertWinner(float aboveConfidence, float belowConfidence, float minConfidence, bool addRow,
+                    const std::vector<size_t> &above, const std::vector<size_t> &below, std::vector<std::vector<
+                        size_t> > &holes);
 
   struct Segment
   {
@@ -227,6 +347,8 @@ private:
                         std::vector<cv::Point> &firstSteps, std::vector<cv::Point> &secondSteps) const;
   static double getDirection(cv::Point2f p1, cv::Point2f p2, cv::Point2f p3);
 
+  class GraphConfidenceInvoker;
+
   std::vector<cv::Point2f> keypoints;
 
   std::vector<std::vector<size_t> > holes;
@@ -235,10 +357,76 @@ private:
   std::vector<std::vector<size_t> > *smallHoles;
 
   const cv::Size_<size_t> patternSize;
+  //findMCS adapts minGraphConfidence, reset restores the parameters of the constructor
+  const CirclesGridFinderParameters initialParameters;
   CirclesGridFinderParameters parameters;
 
+  CirclesGridFinderWorkspace workspace;
+  CirclesGridFinderStatistics statistics;
+  CirclesGridFinderTrace *trace;
+
   CirclesGridFinder& operator=(const CirclesGridFinder&);
   CirclesGridFinder(const CirclesGridFinder&);
 };
 
+struct CirclesGridTrackerParameters
+{
+  CirclesGridTrackerParameters();
+  //half size of the search window relative to the distance to the nearest neighbouring center
+  float roiScale;
+  //accepted fraction of blob pixels inside a search window
+  float minBlobAreaRatio;
+  float maxBlobAreaRatio;
+  //maximal center shift inside a search window relative to its half size
+  float maxCenterShift;
+  //maximal deviation from the grid homography relative to the distance to the nearest neighbouring center
+  float maxReprojectionError;
+  //0 for dark circles on a bright board, 255 for bright circles
+  int blobColor;
+};
+
+//follows an already detected circles grid from frame to frame: the centers of the
+//previous frame are refined in small windows of the new frame and verified against
+//the grid homography, so blob detection and the full hole search only run again
+//after the track was lost
+class CirclesGridTracker
+{
+public:
+  CirclesGridTracker(cv::Size patternSize, bool isAsymmetricGrid,
+                     const CirclesGridTrackerParameters &parameters = CirclesGridTrackerParameters());
+
+  //seeds the tracker with the ordered centers of a full detection
+  void reset(const std::vector<cv::Point2f> &centers);
+  void lose();
+  bool isTracking() const;
+
+  //refines the tracked centers in the gray frame, returns false when the track is lost
+  bool track(const cv::Mat &gray, std::vector<cv::Point2f> &centers);
+
+  //homography from ideal grid coordinates to the last tracked frame
+  const cv::Mat& getHomography() const;
+  size_t getTrackedFrames() const;
+  size_t getLostCount() const;
+
+private:
+  bool refineCenter(const cv::Mat &gray, cv::Point2f predicted, float nearestDistance, cv::Point2f &center);
+
+  cv::Size patternSize;
+  CirclesGridTrackerParameters parameters;
+
+  std::vector<cv::Point2f> idealPoints;
+  std::vector<cv::Point2f> trackedCenters;
+  std::vector<cv::Point2f> predictedCenters;
+  std::vector<cv::Point2f> refinedCenters;
+  std::vector<cv::Point2f> reprojectedCenters;
+  std::vector<float> nearestDistances;
+  cv::Point2f motion;
+  cv::Mat homography;
+  cv::Mat mask;
+
+  bool tracking;
+  size_t trackedFrames;
+  size_t lostCount;
+};
+
 #endif /* CIRCLESGRID_HPP_ */
@@ -11,8 +11,14 @@
 #include <string.h>
 #include <time.h>
 
+#include "CalibrationReport.h"
+#include "PatternDetector.h"
+#include "BoardPresence.h"
+#include "CalibrationCore.h"
+
 using namespace cv;
 using namespace std;
+using namespace calibcore;
 
 const char * usage =
 " \nexample command line for calibration from a live feed.\n"
@@ -69,6 +75,10 @@ static void help()
         "     [-V]                     # use a video file, and not an image list, uses\n"
         "                              # [input_data] string for the video file name\n"
         "     [-su]                    # show undistorted images after calibration\n"
+        "     [-ds=<pixels>]           # search the pattern on a copy downscaled to this longer side\n"
+        "                              # and refine it at full resolution (for high-resolution input)\n"
+        "     [-headless]              # no window and no drawing, capture right away and write a\n"
+        "                              # summary report next to the output file\n"
         "     [input_data]             # input data, one of the following:\n"
         "                              #  - text file with a list of the images of the board\n"
         "                              #    the text file can be generated with imagelist_creator\n"
@@ -80,219 +90,6 @@ static void help()
 }
 
 enum { DETECTION = 0, CAPTURING = 1, CALIBRATED = 2 };
-enum Pattern { CHESSBOARD, CIRCLES_GRID, ASYMMETRIC_CIRCLES_GRID };
-
-static double computeReprojectionErrors(
-        const vector<vector<Point3f> >& objectPoints,
-        const vector<vector<Point2f> >& imagePoints,
-        const vector<Mat>& rvecs, const vector<Mat>& tvecs,
-        const Mat& cameraMatrix, const Mat& distCoeffs,
-        vector<float>& perViewErrors )
-{
-    vector<Point2f> imagePoints2;
-    int i, totalPoints = 0;
-    double totalErr = 0, err;
-    perViewErrors.resize(objectPoints.size());
-
-    for( i = 0; i < (int)objectPoints.size(); i++ )
-    {
-        projectPoints(Mat(objectPoints[i]), rvecs[i], tvecs[i],
-                      cameraMatrix, distCoeffs, imagePoints2);
-        err = norm(Mat(imagePoints[i]), Mat(imagePoints2), NORM_L2);
-        int n = (int)objectPoints[i].size();
-        perViewErrors[i] = (float)std::sqrt(err*err/n);
-        totalErr += err*err;
-        totalPoints += n;
-    }
-
-    return std::sqrt(totalErr/totalPoints);
-}
-
-static void calcChessboardCorners(Size boardSize, float squareSize, vector<Point3f>& corners, Pattern patternType = CHESSBOARD)
-{
-    corners.resize(0);
-
-    switch(patternType)
-    {
-      case CHESSBOARD:
-      case CIRCLES_GRID:
-        for( int i = 0; i < boardSize.height; i++ )
-            for( int j = 0; j < boardSize.width; j++ )
-                corners.push_back(Point3f(float(j*squareSize),
-                                          float(i*squareSize), 0));
-        break;
-
-      case ASYMMETRIC_CIRCLES_GRID:
-        for( int i = 0; i < boardSize.height; i++ )
-            for( int j = 0; j < boardSize.width; j++ )
-                corners.push_back(Point3f(float((2*j + i % 2)*squareSize),
-                                          float(i*squareSize), 0));
-        break;
-
-      default:
-        CV_Error(Error::StsBadArg, "Unknown pattern type\n");
-    }
-}
-
-static bool runCalibration( vector<vector<Point2f> > imagePoints,
-                    Size imageSize, Size boardSize, Pattern patternType,
-                    float squareSize, float aspectRatio,
-                    int flags, Mat& cameraMatrix, Mat& distCoeffs,
-                    vector<Mat>& rvecs, vector<Mat>& tvecs,
-                    vector<float>& reprojErrs,
-                    double& totalAvgErr)
-{
-    cameraMatrix = Mat::eye(3, 3, CV_64F);
-    if( flags & CALIB_FIX_ASPECT_RATIO )
-        cameraMatrix.at<double>(0,0) = aspectRatio;
-
-    distCoeffs = Mat::zeros(8, 1, CV_64F);
-
-    vector<vector<Point3f> > objectPoints(1);
-    calcChessboardCorners(boardSize, squareSize, objectPoints[0], patternType);
-
-    objectPoints.resize(imagePoints.size(),objectPoints[0]);
-
-    double rms = calibrateCamera(objectPoints, imagePoints, imageSize, cameraMatrix,
-                    distCoeffs, rvecs, tvecs, flags|CALIB_FIX_K4|CALIB_FIX_K5);
-                    ///*|CALIB_FIX_K3*/|CALIB_FIX_K4|CALIB_FIX_K5);
-    printf("RMS error reported by calibrateCamera: %g\n", rms);
-
-    bool ok = checkRange(cameraMatrix) && checkRange(distCoeffs);
-
-    totalAvgErr = computeReprojectionErrors(objectPoints, imagePoints,
-                rvecs, tvecs, cameraMatrix, distCoeffs, reprojErrs);
-
-    return ok;
-}
-
-
-static void saveCameraParams( const string& filename,
-                       Size imageSize, Size boardSize,
-                       float squareSize, float aspectRatio, int flags,
-                       const Mat& cameraMatrix, const Mat& distCoeffs,
-                       const vector<Mat>& rvecs, const vector<Mat>& tvecs,
-                       const vector<float>& reprojErrs,
-                       const vector<vector<Point2f> >& imagePoints,
-                       double totalAvgErr )
-{
-    FileStorage fs( filename, FileStorage::WRITE );
-
-    time_t tt;
-    time( &tt );
-    struct tm *t2 = localtime( &tt );
-    char buf[1024];
-    strftime( buf, sizeof(buf)-1, "%c", t2 );
-
-    fs << "calibration_time" << buf;
-
-    if( !rvecs.empty() || !reprojErrs.empty() )
-        fs << "nframes" << (int)std::max(rvecs.size(), reprojErrs.size());
-    fs << "image_width" << imageSize.width;
-    fs << "image_height" << imageSize.height;
-    fs << "board_width" << boardSize.width;
-    fs << "board_height" << boardSize.height;
-    fs << "square_size" << squareSize;
-
-    if( flags & CALIB_FIX_ASPECT_RATIO )
-        fs << "aspectRatio" << aspectRatio;
-
-    if( flags != 0 )
-    {
-        sprintf( buf, "flags: %s%s%s%s",
-            flags & CALIB_USE_INTRINSIC_GUESS ? "+use_intrinsic_guess" : "",
-            flags & CALIB_FIX_ASPECT_RATIO ? "+fix_aspectRatio" : "",
-            flags & CALIB_FIX_PRINCIPAL_POINT ? "+fix_principal_point" : "",
-            flags & CALIB_ZERO_TANGENT_DIST ? "+zero_tangent_dist" : "" );
-        //cvWriteComment( *fs, buf, 0 );
-    }
-
-    fs << "flags" << flags;
-
-    fs << "camera_matrix" << cameraMatrix;
-    fs << "distortion_coefficients" << distCoeffs;
-
-    fs << "avg_reprojection_error" << totalAvgErr;
-    if( !reprojErrs.empty() )
-        fs << "per_view_reprojection_errors" << Mat(reprojErrs);
-
-    if( !rvecs.empty() && !tvecs.empty() )
-    {
-        CV_Assert(rvecs[0].type() == tvecs[0].type());
-        Mat bigmat((int)rvecs.size(), 6, rvecs[0].type());
-        for( int i = 0; i < (int)rvecs.size(); i++ )
-        {
-            Mat r = bigmat(Range(i, i+1), Range(0,3));
-            Mat t = bigmat(Range(i, i+1), Range(3,6));
-
-            CV_Assert(rvecs[i].rows == 3 && rvecs[i].cols == 1);
-            CV_Assert(tvecs[i].rows == 3 && tvecs[i].cols == 1);
-            //*.t() is MatExpr (not Mat) so we can use assignment operator
-            r = rvecs[i].t();
-            t = tvecs[i].t();
-        }
-        //cvWriteComment( *fs, "a set of 6-tuples (rotation vector + translation vector) for each view", 0 );
-        fs << "extrinsic_parameters" << bigmat;
-    }
-
-    if( !imagePoints.empty() )
-    {
-        Mat imagePtMat((int)imagePoints.size(), (int)imagePoints[0].size(), CV_32FC2);
-        for( int i = 0; i < (int)imagePoints.size(); i++ )
-        {
-            Mat r = imagePtMat.row(i).reshape(2, imagePtMat.cols);
-            Mat imgpti(imagePoints[i]);
-            imgpti.copyTo(r);
-        }
-        fs << "image_points" << imagePtMat;
-    }
-}
-
-static bool readStringList( const string& filename, vector<string>& l )
-{
-    l.resize(0);
-    FileStorage fs(filename, FileStorage::READ);
-    if( !fs.isOpened() )
-        return false;
-    FileNode n = fs.getFirstTopLevelNode();
-    if( n.type() != FileNode::SEQ )
-        return false;
-    FileNodeIterator it = n.begin(), it_end = n.end();
-    for( ; it != it_end; ++it )
-        l.push_back((string)*it);
-    return true;
-}
-
-
-static bool runAndSave(const string& outputFilename,
-                const vector<vector<Point2f> >& imagePoints,
-                Size imageSize, Size boardSize, Pattern patternType, float squareSize,
-                float aspectRatio, int flags, Mat& cameraMatrix,
-                Mat& distCoeffs, bool writeExtrinsics, bool writePoints )
-{
-    vector<Mat> rvecs, tvecs;
-    vector<float> reprojErrs;
-    double totalAvgErr = 0;
-
-    bool ok = runCalibration(imagePoints, imageSize, boardSize, patternType, squareSize,
-                   aspectRatio, flags, cameraMatrix, distCoeffs,
-                   rvecs, tvecs, reprojErrs, totalAvgErr);
-    printf("%s. avg reprojection error = %.2f\n",
-           ok ? "Calibration succeeded" : "Calibration failed",
-           totalAvgErr);
-
-    if( ok )
-        saveCameraParams( outputFilename, imageSize,
-                         boardSize, squareSize, aspectRatio,
-                         flags, cameraMatrix, distCoeffs,
-                         writeExtrinsics ? rvecs : vector<Mat>(),
-                         writeExtrinsics ? tvecs : vector<Mat>(),
-                         writeExtrinsics ? reprojErrs : vector<float>(),
-                         writePoints ? imagePoints : vector<vector<Point2f> >(),
-                         totalAvgErr );
-    return ok;
-}
-
 
 int main( int argc, char** argv )
 {
@@ -310,6 +107,9 @@ int main( int argc, char** argv )
     bool flipVertical;
     bool showUndistorted;
     bool videofile;
+    bool headless;
+    double prevVideoTime = 0;
+    CalibrationReport report("calibration");
     int delay;
     clock_t prevTimestamp = 0;
     int mode = DETECTION;
@@ -320,7 +120,7 @@ int main( int argc, char** argv )
 
     cv::CommandLineParser parser(argc, argv,
         "{help ||}{w||}{h||}{pt|chessboard|}{n|10|}{d|1000|}{s|1|}{o|out_camera_data.yml|}"
-        "{op||}{oe||}{zt||}{a|1|}{p||}{v||}{V||}{su||}"
+        "{op||}{oe||}{zt||}{a|1|}{p||}{v||}{V||}{su||}{headless||}{ds|0|}"
         "{@input_data|0|}");
     if (parser.has("help"))
     {
@@ -358,6 +158,8 @@ int main( int argc, char** argv )
     if ( parser.has("o") )
         outputFilename = parser.get<string>("o");
     showUndistorted = parser.has("su");
+    headless = parser.has("headless");
+    PatternDetector patternDetector(parser.get<int>("ds"));
     if ( isdigit(parser.get<string>("@input_data")[0]) )
         cameraId = parser.get<int>("@input_data");
     else
@@ -397,14 +199,24 @@ int main( int argc, char** argv )
     if( !imageList.empty() )
         nframes = (int)imageList.size();
 
-    if( capture.isOpened() )
+    if( capture.isOpened() && !headless )
         printf( "%s", liveCaptureHelp );
 
-    namedWindow( "Image View", 1 );
+    // image lists are searched in full, live and video frames without a board are skipped early
+    BoardPresence presence;
+    bool checkPresence = imageList.empty();
+
+    // nobody can press 'g' without a window
+    if( headless )
+        mode = CAPTURING;
+    else
+        namedWindow( "Image View", 1 );
 
+    // the gray buffer keeps its allocation across frames
+    Mat viewGray;
     for(i = 0;;i++)
     {
-        Mat view, viewGray;
+        Mat view;
         bool blink = false;
 
         if( capture.isOpened() )
@@ -414,7 +226,16 @@ int main( int argc, char** argv )
             view0.copyTo(view);
         }
         else if( i < (int)imageList.size() )
+        {
             view = imread(imageList[i], 1);
+            if( view.empty() && headless )
+            {
+                printf("%s: could not be read\n", imageList[i].c_str());
+                report.framesProcessed++;
+                report.framesUnreadable++;
+                continue;
+            }
+        }
 
         if(view.empty())
         {
@@ -422,11 +243,12 @@ int main( int argc, char** argv )
                 runAndSave(outputFilename, imagePoints, imageSize,
                            boardSize, pattern, squareSize, aspectRatio,
                            flags, cameraMatrix, distCoeffs,
-                           writeExtrinsics, writePoints);
+                           writeExtrinsics, writePoints, &report);
             break;
         }
 
         imageSize = view.size();
+        report.framesProcessed++;
 
         if( flipVertical )
             flip( view, view, 0 );
@@ -434,35 +256,60 @@ int main( int argc, char** argv )
         vector<Point2f> pointbuf;
         cvtColor(view, viewGray, COLOR_BGR2GRAY);
 
-        bool found;
-        switch( pattern )
+        bool found = false;
+        // frames without anything board-like skip the full detector
+        if( !checkPresence || presence.check( viewGray, boardSize, pattern == CHESSBOARD ) )
         {
-            case CHESSBOARD:
-                found = findChessboardCorners( view, boardSize, pointbuf,
-                    CALIB_CB_ADAPTIVE_THRESH | CALIB_CB_FAST_CHECK | CALIB_CB_NORMALIZE_IMAGE);
-                break;
-            case CIRCLES_GRID:
-                found = findCirclesGrid( view, boardSize, pointbuf );
-                break;
-            case ASYMMETRIC_CIRCLES_GRID:
-                found = findCirclesGrid( view, boardSize, pointbuf, CALIB_CB_ASYMMETRIC_GRID );
-                break;
-            default:
-                return fprintf( stderr, "Unknown pattern type\n" ), -1;
+            switch( pattern )
+            {
+                case CHESSBOARD:
+                    found = patternDetector.findChessboard( viewGray, boardSize, pointbuf,
+                        CALIB_CB_ADAPTIVE_THRESH | CALIB_CB_FAST_CHECK | CALIB_CB_NORMALIZE_IMAGE);
+                    break;
+                case CIRCLES_GRID:
+                    found = patternDetector.findCirclesGrid( viewGray, boardSize, pointbuf, CALIB_CB_SYMMETRIC_GRID );
+                    break;
+                case ASYMMETRIC_CIRCLES_GRID:
+                    found = patternDetector.findCirclesGrid( viewGray, boardSize, pointbuf, CALIB_CB_ASYMMETRIC_GRID );
+                    break;
+                default:
+                    return fprintf( stderr, "Unknown pattern type\n" ), -1;
+            }
         }
 
-       // improve the found corners' coordinate accuracy
-        if( pattern == CHESSBOARD && found) cornerSubPix( viewGray, pointbuf, Size(11,11),
-            Size(-1,-1), TermCriteria( TermCriteria::EPS+TermCriteria::COUNT, 30, 0.1 ));
+        if( found )
+            report.framesWithPattern++;
+
+        // without waitKey a video file decodes faster than real time, so the delay
+        // is measured on the video clock to spread the views over the recording
+        bool delayElapsed;
+        if( headless && !inputFilename.empty() )
+            delayElapsed = capture.get(CAP_PROP_POS_MSEC) - prevVideoTime > delay;
+        else
+            delayElapsed = clock() - prevTimestamp > delay*1e-3*CLOCKS_PER_SEC;
 
-        if( mode == CAPTURING && found &&
-           (!capture.isOpened() || clock() - prevTimestamp > delay*1e-3*CLOCKS_PER_SEC) )
+        if( mode == CAPTURING && found && (!capture.isOpened() || delayElapsed) )
         {
             imagePoints.push_back(pointbuf);
             prevTimestamp = clock();
+            if( headless && capture.isOpened() )
+                prevVideoTime = capture.get(CAP_PROP_POS_MSEC);
             blink = capture.isOpened();
         }
 
+        if( headless )
+        {
+            if( imagePoints.size() >= (unsigned)nframes )
+            {
+                runAndSave(outputFilename, imagePoints, imageSize,
+                           boardSize, pattern, squareSize, aspectRatio,
+                           flags, cameraMatrix, distCoeffs,
+                           writeExtrinsics, writePoints, &report);
+                break;
+            }
+            continue;
+        }
+
         if(found)
             drawChessboardCorners( view, boardSize, Mat(pointbuf), found );
 
@@ -512,7 +359,7 @@ int main( int argc, char** argv )
             if( runAndSave(outputFilename, imagePoints, imageSize,
                        boardSize, pattern, squareSize, aspectRatio,
                        flags, cameraMatrix, distCoeffs,
-                       writeExtrinsics, writePoints))
+                       writeExtrinsics, writePoints, &report))
                 mode = CALIBRATED;
             else
                 mode = DETECTION;
@@ -521,7 +368,7 @@ int main( int argc, char** argv )
         }
     }
 
-    if( !capture.isOpened() && showUndistorted )
+    if( !capture.isOpened() && showUndistorted && !headless )
     {
         Mat view, rview, map1, map2;
         initUndistortRectifyMap(cameraMatrix, distCoeffs, Mat(),
@@ -542,5 +389,14 @@ int main( int argc, char** argv )
         }
     }
 
+    if( checkPresence )
+    {
+        printf( "Board pre-check skipped %d of %d frames\n", presence.framesSkipped(), presence.framesChecked() );
+        report.framesSkipped = presence.framesSkipped();
+    }
+
+    if( headless )
+        report.finish(outputFilename);
+
     return 0;
 }
@@ -0,0 +1,313 @@
+/*****************************************************************************
+* Application :		Camera Calibration Application
+*					using OpenCV3 (http://opencv.org/)
+*
+* Author      :		Michael Stengel <virtuellerealitaet@gmail.com>
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+*    1. Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*
+*    2. Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+#include "CalibrationBinary.h"
+
+#include <algorithm>
+#include <string.h>
+#include <stdio.h>
+
+using namespace cv;
+using namespace std;
+
+namespace calibcore
+{
+
+static const char calibrationMagic[8] = { 'C', 'A', 'L', 'I', 'B', 'B', 'I', 'N' };
+
+static uint64_t alignSection( uint64_t offset )
+{
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+// reserves a section of the given size, returns 0 for an empty one
+static uint64_t addSection( uint64_t& end, size_t bytes )
+{
+    if( bytes == 0 )
+        return 0;
+    uint64_t offset = alignSection(end);
+    end = offset + bytes;
+    return offset;
+}
+
+static bool writeSection( FILE* f, uint64_t offset, const void* data, size_t bytes )
+{
+    if( offset == 0 )
+        return true;
+    return fseek( f, (long)offset, SEEK_SET ) == 0 && fwrite( data, 1, bytes, f ) == bytes;
+}
+
+// equal element by element, the file keeps the float and double values as written
+static bool sameValues( const Mat& a, const Mat& b )
+{
+    if( a.total() * a.channels() != b.total() * b.channels() )
+        return false;
+    if( a.empty() )
+        return true;
+    Mat x, y;
+    a.reshape( 1, (int)(a.total() * a.channels()) ).convertTo( x, CV_64F );
+    b.reshape( 1, (int)(b.total() * b.channels()) ).convertTo( y, CV_64F );
+    return norm( x, y, NORM_INF ) == 0;
+}
+
+bool isBinaryCalibrationFile( const string& filename )
+{
+    const string extension = ".calib";
+    return filename.size() > extension.size() &&
+           filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+bool saveCalibrationBinary( const string& filename, const CalibrationData& data )
+{
+    BinaryCalibrationHeader header;
+    memset( &header, 0, sizeof(header) );
+    memcpy( header.magic, calibrationMagic, sizeof(header.magic) );
+    header.version = CALIBRATION_BINARY_VERSION;
+    header.headerSize = (uint32_t)sizeof(header);
+    header.imageWidth = data.imageSize.width;
+    header.imageHeight = data.imageSize.height;
+    header.boardWidth = data.boardSize.width;
+    header.boardHeight = data.boardSize.height;
+    header.squareSize = data.squareSize;
+    header.aspectRatio = data.aspectRatio;
+    header.flags = data.flags;
+    header.avgReprojectionError = data.avgReprojectionError;
+
+    Mat K;
+    data.cameraMatrix.convertTo( K, CV_64F );
+    CV_Assert( K.rows == 3 && K.cols == 3 );
+    for( int i = 0; i < 9; i++ )
+        header.cameraMatrix[i] = K.at<double>(i / 3, i % 3);
+
+    // the arrays are laid out once here and written in one pass below
+    Mat dist;
+    data.distCoeffs.reshape(1, (int)data.distCoeffs.total()).convertTo( dist, CV_64F );
+    header.distCount = dist.rows;
+
+    Mat extrinsics;
+    if( !data.rvecs.empty() && data.rvecs.size() == data.tvecs.size() )
+    {
+        extrinsics.create( (int)data.rvecs.size(), 6, CV_64F );
+        for( int i = 0; i < extrinsics.rows; i++ )
+        {
+            data.rvecs[i].reshape(1, 1).convertTo( extrinsics(Range(i, i+1), Range(0,3)), CV_64F );
+            data.tvecs[i].reshape(1, 1).convertTo( extrinsics(Range(i, i+1), Range(3,6)), CV_64F );
+        }
+    }
+    header.views = std::max( extrinsics.rows, (int)data.perViewErrors.size() );
+
+    Mat points, residuals;
+    if( !data.imagePoints.empty() )
+    {
+        points.create( (int)data.imagePoints.size(), (int)data.imagePoints[0].size(), CV_32FC2 );
+        for( int i = 0; i < points.rows; i++ )
+            Mat(data.imagePoints[i]).reshape(2, 1).copyTo( points.row(i) );
+
+        if( data.residuals.size() == data.imagePoints.size() )
+        {
+            residuals.create( points.size(), CV_32FC2 );
+            for( int i = 0; i < residuals.rows; i++ )
+                Mat(data.residuals[i]).reshape(2, 1).copyTo( residuals.row(i) );
+        }
+    }
+    header.pointViews = points.rows;
+    header.pointsPerView = points.cols;
+
+    uint64_t end = sizeof(header);
+    header.distOffset = addSection( end, dist.total() * sizeof(double) );
+    header.viewErrorsOffset = addSection( end, data.perViewErrors.size() * sizeof(float) );
+    header.extrinsicsOffset = addSection( end, extrinsics.total() * sizeof(double) );
+    header.pointsOffset = addSection( end, points.total() * 2 * sizeof(float) );
+    header.residualsOffset = addSection( end, residuals.total() * 2 * sizeof(float) );
+    header.fileSize = end;
+
+    // written under a temporary name like the map cache, a tool that maps the
+    // calibration meanwhile never sees half a file
+    string tempname = filename + ".tmp";
+    FILE* f = fopen( tempname.c_str(), "wb" );
+    if( !f )
+        return false;
+
+    bool ok = fwrite( &header, sizeof(header), 1, f ) == 1 &&
+        writeSection( f, header.distOffset, dist.data, dist.total() * sizeof(double) ) &&
+        writeSection( f, header.viewErrorsOffset, data.perViewErrors.data(), data.perViewErrors.size() * sizeof(float) ) &&
+        writeSection( f, header.extrinsicsOffset, extrinsics.data, extrinsics.total() * sizeof(double) ) &&
+        writeSection( f, header.pointsOffset, points.data, points.total() * 2 * sizeof(float) ) &&
+        writeSection( f, header.residualsOffset, residuals.data, residuals.total() * 2 * sizeof(float) );
+    ok = fclose( f ) == 0 && ok;
+
+#ifdef _WIN32
+    // rename will not overwrite on Windows, elsewhere it swaps the file atomically
+    remove( filename.c_str() );
+#endif
+    if( !ok || rename( tempname.c_str(), filename.c_str() ) != 0 )
+    {
+        remove( tempname.c_str() );
+        return false;
+    }
+    return true;
+}
+
+bool MappedCalibration::open( const string& filename )
+{
+    if( !_file.open( filename ) )
+        return false;
+    if( _file.size() < sizeof(BinaryCalibrationHeader) )
+        return close(), false;
+
+    const BinaryCalibrationHeader& h = header();
+    uint64_t views = (uint64_t)std::max(h.views, 0);
+    uint64_t points = (uint64_t)std::max(h.pointViews, 0) * (uint64_t)std::max(h.pointsPerView, 0);
+    struct { uint64_t offset, bytes; } sections[] = {
+        { h.distOffset, (uint64_t)std::max(h.distCount, 0) * sizeof(double) },
+        { h.viewErrorsOffset, views * sizeof(float) },
+        { h.extrinsicsOffset, views * 6 * sizeof(double) },
+        { h.pointsOffset, points * 2 * sizeof(float) },
+        { h.residualsOffset, points * 2 * sizeof(float) } };
+
+    bool valid = memcmp( h.magic, calibrationMagic, sizeof(h.magic) ) == 0 &&
+                 h.version == CALIBRATION_BINARY_VERSION &&
+                 h.headerSize == sizeof(BinaryCalibrationHeader) &&
+                 h.fileSize <= _file.size();
+    for( size_t i = 0; valid && i < sizeof(sections) / sizeof(sections[0]); i++ )
+        valid = sections[i].offset == 0 ||
+                (sections[i].offset % 8 == 0 && sections[i].offset >= sizeof(BinaryCalibrationHeader) &&
+                 sections[i].offset + sections[i].bytes <= h.fileSize);
+    if( !valid )
+    {
+        fprintf( stderr, "%s is not a version %u calibration file\n", filename.c_str(), CALIBRATION_BINARY_VERSION );
+        return close(), false;
+    }
+    return true;
+}
+
+Mat MappedCalibration::section( uint64_t offset, int rows, int cols, int type ) const
+{
+    if( !isOpen() || offset == 0 || rows <= 0 || cols <= 0 )
+        return Mat();
+    // read-only memory, the header only promises not to write through it
+    return Mat( rows, cols, type, (void*)(_file.data() + offset) );
+}
+
+Mat MappedCalibration::cameraMatrix() const
+{
+    return isOpen() ? Mat( 3, 3, CV_64F, (void*)header().cameraMatrix ) : Mat();
+}
+
+Mat MappedCalibration::distCoeffs() const
+{
+    return section( header().distOffset, header().distCount, 1, CV_64F );
+}
+
+Mat MappedCalibration::perViewErrors() const
+{
+    return section( header().viewErrorsOffset, header().views, 1, CV_32F );
+}
+
+Mat MappedCalibration::extrinsics() const
+{
+    return section( header().extrinsicsOffset, header().views, 6, CV_64F );
+}
+
+Mat MappedCalibration::imagePoints() const
+{
+    return section( header().pointsOffset, header().pointViews, header().pointsPerView, CV_32FC2 );
+}
+
+Mat MappedCalibration::residuals() const
+{
+    return section( header().residualsOffset, header().pointViews, header().pointsPerView, CV_32FC2 );
+}
+
+void MappedCalibration::read( CalibrationData& data ) const
+{
+    data = CalibrationData();
+    if( !isOpen() )
+        return;
+
+    const BinaryCalibrationHeader& h = header();
+    data.imageSize = imageSize();
+    data.boardSize = boardSize();
+    data.squareSize = h.squareSize;
+    data.aspectRatio = h.aspectRatio;
+    data.flags = h.flags;
+    data.avgReprojectionError = h.avgReprojectionError;
+    data.cameraMatrix = cameraMatrix().clone();
+    data.distCoeffs = distCoeffs().clone();
+
+    Mat errors = perViewErrors();
+    if( !errors.empty() )
+        data.perViewErrors.assign( errors.ptr<float>(), errors.ptr<float>() + errors.rows );
+
+    Mat ext = extrinsics();
+    for( int i = 0; i < ext.rows; i++ )
+    {
+        data.rvecs.push_back( ext(Range(i, i+1), Range(0,3)).t() );
+        data.tvecs.push_back( ext(Range(i, i+1), Range(3,6)).t() );
+    }
+
+    Mat pts = imagePoints(), res = residuals();
+    for( int i = 0; i < pts.rows; i++ )
+    {
+        data.imagePoints.push_back( vector<Point2f>( pts.ptr<Point2f>(i), pts.ptr<Point2f>(i) + pts.cols ) );
+        if( !res.empty() )
+            data.residuals.push_back( vector<Point2f>( res.ptr<Point2f>(i), res.ptr<Point2f>(i) + res.cols ) );
+    }
+}
+
+bool verifyCalibrationBinary( const string& filename, const CalibrationData& data )
+{
+    MappedCalibration mapped;
+    if( !mapped.open( filename ) )
+        return false;
+    CalibrationData stored;
+    mapped.read( stored );
+
+    bool same = stored.imageSize == data.imageSize && stored.boardSize == data.boardSize &&
+                stored.squareSize == data.squareSize && stored.aspectRatio == data.aspectRatio &&
+                stored.flags == data.flags && stored.avgReprojectionError == data.avgReprojectionError &&
+                sameValues( stored.cameraMatrix, data.cameraMatrix ) &&
+                sameValues( stored.distCoeffs, data.distCoeffs ) &&
+                sameValues( Mat(stored.perViewErrors), Mat(data.perViewErrors) ) &&
+                stored.rvecs.size() == data.rvecs.size() &&
+                stored.imagePoints.size() == data.imagePoints.size() &&
+                stored.residuals.size() == data.residuals.size();
+    for( size_t i = 0; same && i < data.rvecs.size(); i++ )
+        same = sameValues( stored.rvecs[i], data.rvecs[i] ) && sameValues( stored.tvecs[i], data.tvecs[i] );
+    for( size_t i = 0; same && i < data.imagePoints.size(); i++ )
+        same = sameValues( Mat(stored.imagePoints[i]), Mat(data.imagePoints[i]) );
+    for( size_t i = 0; same && i < data.residuals.size(); i++ )
+        same = sameValues( Mat(stored.residuals[i]), Mat(data.residuals[i]) );
+    return same;
+}
+
+}
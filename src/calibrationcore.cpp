@@ -0,0 +1,438 @@
+/*****************************************************************************
+* Application :		Camera Calibration Application
+*					using OpenCV3 (http://opencv.org/)
+*
+* Author      :		Michael Stengel <virtuellerealitaet@gmail.com>
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+*    1. Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*
+*    2. Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+#include "CalibrationCore.h"
+#include "CalibrationBinary.h"
+#include "CalibrationReport.h"
+#include "ReprojectionErrors.h"
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/calib3d.hpp>
+
+#include <algorithm>
+#include <stdio.h>
+#include <time.h>
+
+using namespace cv;
+using namespace std;
+
+namespace calibcore
+{
+
+double computeReprojectionErrors(
+        const vector<vector<Point3f> >& objectPoints,
+        const vector<vector<Point2f> >& imagePoints,
+        const vector<Mat>& rvecs, const vector<Mat>& tvecs,
+        const Mat& cameraMatrix, const Mat& distCoeffs,
+        vector<float>& perViewErrors, bool fisheye )
+{
+    ReprojectionErrors errors(fisheye ? ReprojectionErrors::FISHEYE_MODEL : ReprojectionErrors::PINHOLE_MODEL);
+    double totalAvgErr = errors.compute(objectPoints, imagePoints, rvecs, tvecs,
+                                        cameraMatrix, distCoeffs);
+    perViewErrors = errors.perViewErrors();
+    return totalAvgErr;
+}
+
+void calcChessboardCorners(Size boardSize, float squareSize, vector<Point3f>& corners, Pattern patternType)
+{
+    corners.resize(0);
+
+    switch(patternType)
+    {
+      case CHESSBOARD:
+      case CIRCLES_GRID:
+        for( int i = 0; i < boardSize.height; i++ )
+            for( int j = 0; j < boardSize.width; j++ )
+                corners.push_back(Point3f(float(j*squareSize),
+                                          float(i*squareSize), 0));
+        break;
+
+      case ASYMMETRIC_CIRCLES_GRID:
+        for( int i = 0; i < boardSize.height; i++ )
+            for( int j = 0; j < boardSize.width; j++ )
+                corners.push_back(Point3f(float((2*j + i % 2)*squareSize),
+                                          float(i*squareSize), 0));
+        break;
+
+      default:
+        CV_Error(Error::StsBadArg, "Unknown pattern type\n");
+    }
+}
+
+bool runCalibration( const vector<vector<Point2f> >& imagePoints,
+                    Size imageSize, Size boardSize, Pattern patternType,
+                    float squareSize, float aspectRatio,
+                    int flags, Mat& cameraMatrix, Mat& distCoeffs,
+                    vector<Mat>& rvecs, vector<Mat>& tvecs,
+                    vector<float>& reprojErrs,
+                    double& totalAvgErr)
+{
+    cameraMatrix = Mat::eye(3, 3, CV_64F);
+    if( flags & CALIB_FIX_ASPECT_RATIO )
+        cameraMatrix.at<double>(0,0) = aspectRatio;
+
+    distCoeffs = Mat::zeros(8, 1, CV_64F);
+
+    vector<vector<Point3f> > objectPoints(1);
+    calcChessboardCorners(boardSize, squareSize, objectPoints[0], patternType);
+
+    objectPoints.resize(imagePoints.size(),objectPoints[0]);
+
+    double rms = calibrateCamera(objectPoints, imagePoints, imageSize, cameraMatrix,
+                    distCoeffs, rvecs, tvecs, flags|CALIB_FIX_K4|CALIB_FIX_K5);
+                    ///*|CALIB_FIX_K3*/|CALIB_FIX_K4|CALIB_FIX_K5);
+    printf("RMS error reported by calibrateCamera: %g\n", rms);
+
+    bool ok = checkRange(cameraMatrix) && checkRange(distCoeffs);
+
+    totalAvgErr = computeReprojectionErrors(objectPoints, imagePoints,
+                rvecs, tvecs, cameraMatrix, distCoeffs, reprojErrs);
+
+    return ok;
+}
+
+static void cloneMats( const vector<Mat>& src, vector<Mat>& dst )
+{
+    dst.resize(src.size());
+    for( size_t i = 0; i < src.size(); i++ )
+        dst[i] = src[i].clone();
+}
+
+bool runRobustCalibration( const vector<vector<Point2f> >& imagePoints,
+                    Size imageSize, Size boardSize, Pattern patternType,
+                    float squareSize, float aspectRatio, int flags,
+                    int rounds, float threshold,
+                    Mat& cameraMatrix, Mat& distCoeffs,
+                    vector<Mat>& rvecs, vector<Mat>& tvecs,
+                    vector<float>& reprojErrs, double& totalAvgErr,
+                    vector<int>& keptViews )
+{
+    cameraMatrix = Mat::eye(3, 3, CV_64F);
+    if( flags & CALIB_FIX_ASPECT_RATIO )
+        cameraMatrix.at<double>(0,0) = aspectRatio;
+
+    distCoeffs = Mat::zeros(8, 1, CV_64F);
+
+    vector<Point3f> board;
+    calcChessboardCorners(boardSize, squareSize, board, patternType);
+
+    vector<vector<Point3f> > objectPoints(imagePoints.size(), board);
+    vector<vector<Point2f> > solvePoints(imagePoints);
+    keptViews.resize(imagePoints.size());
+    for( size_t i = 0; i < keptViews.size(); i++ )
+        keptViews[i] = (int)i;
+
+    // outputs of the last round that passed the range check, calibrateCamera
+    // overwrites the warm-started intrinsics and poses in place
+    Mat goodCameraMatrix, goodDistCoeffs;
+    vector<Mat> goodRvecs, goodTvecs;
+    vector<float> goodReprojErrs;
+    double goodTotalAvgErr = 0;
+    vector<int> goodViews;
+
+    ReprojectionErrors errors;
+    bool ok = false;
+    for( int round = 0;; round++ )
+    {
+        int64 start = getTickCount();
+        int solveFlags = flags|CALIB_FIX_K4|CALIB_FIX_K5;
+        if( round > 0 )
+            solveFlags |= CALIB_USE_INTRINSIC_GUESS;
+        double rms = calibrateCamera(objectPoints, solvePoints, imageSize, cameraMatrix,
+                        distCoeffs, rvecs, tvecs, solveFlags);
+
+        ok = checkRange(cameraMatrix) && checkRange(distCoeffs);
+        totalAvgErr = errors.compute(objectPoints, solvePoints, rvecs, tvecs, cameraMatrix, distCoeffs);
+        reprojErrs = errors.perViewErrors();
+        printf("Round %d: %d views, RMS error %g (%.0f ms)\n", round, (int)solvePoints.size(), rms,
+               (getTickCount() - start)*1000/getTickFrequency());
+
+        // a pruning round that diverged falls back to the round before
+        if( !ok && round > 0 )
+        {
+            printf("Round %d failed, keeping the result of round %d\n", round, round - 1);
+            cameraMatrix = goodCameraMatrix;
+            distCoeffs = goodDistCoeffs;
+            rvecs = goodRvecs;
+            tvecs = goodTvecs;
+            reprojErrs = goodReprojErrs;
+            totalAvgErr = goodTotalAvgErr;
+            keptViews = goodViews;
+            ok = true;
+            break;
+        }
+
+        if( !ok || round >= rounds )
+            break;
+
+        cameraMatrix.copyTo(goodCameraMatrix);
+        distCoeffs.copyTo(goodDistCoeffs);
+        cloneMats(rvecs, goodRvecs);
+        cloneMats(tvecs, goodTvecs);
+        goodReprojErrs = reprojErrs;
+        goodTotalAvgErr = totalAvgErr;
+        goodViews = keptViews;
+
+        vector<float> sortedErrs(reprojErrs);
+        nth_element(sortedErrs.begin(), sortedErrs.begin() + sortedErrs.size()/2, sortedErrs.end());
+        double viewLimit = threshold*sortedErrs[sortedErrs.size()/2];
+        double pointLimit = threshold*totalAvgErr;
+
+        vector<vector<Point3f> > nextObjectPoints;
+        vector<vector<Point2f> > nextSolvePoints;
+        vector<int> nextViews;
+        size_t points = 0, nextPoints = 0;
+        for( size_t i = 0; i < solvePoints.size(); i++ )
+        {
+            points += solvePoints[i].size();
+            if( reprojErrs[i] > viewLimit )
+                continue;
+
+            const vector<Point2f>& residuals = errors.residuals()[i];
+            vector<Point3f> viewObjectPoints;
+            vector<Point2f> viewImagePoints;
+            for( size_t j = 0; j < residuals.size(); j++ )
+                if( norm(residuals[j]) <= pointLimit )
+                {
+                    viewObjectPoints.push_back(objectPoints[i][j]);
+                    viewImagePoints.push_back(solvePoints[i][j]);
+                }
+
+            // the initial pose of a view needs a homography
+            if( viewImagePoints.size() < 4 )
+                continue;
+
+            nextPoints += viewImagePoints.size();
+            nextObjectPoints.push_back(viewObjectPoints);
+            nextSolvePoints.push_back(viewImagePoints);
+            nextViews.push_back(keptViews[i]);
+        }
+
+        // nothing left to drop, or too little left to solve
+        if( nextPoints == points || nextSolvePoints.size() < 3 )
+            break;
+
+        printf("Dropping %d views and %d points\n", (int)(solvePoints.size() - nextSolvePoints.size()),
+               (int)(points - nextPoints));
+        objectPoints.swap(nextObjectPoints);
+        solvePoints.swap(nextSolvePoints);
+        keptViews.swap(nextViews);
+    }
+
+    return ok;
+}
+
+void saveCameraParams( const string& filename,
+                       Size imageSize, Size boardSize,
+                       float squareSize, float aspectRatio, int flags,
+                       const Mat& cameraMatrix, const Mat& distCoeffs,
+                       const vector<Mat>& rvecs, const vector<Mat>& tvecs,
+                       const vector<float>& reprojErrs,
+                       const vector<vector<Point2f> >& imagePoints,
+                       double totalAvgErr )
+{
+    FileStorage fs( filename, FileStorage::WRITE );
+
+    time_t tt;
+    time( &tt );
+    struct tm *t2 = localtime( &tt );
+    char buf[1024];
+    strftime( buf, sizeof(buf)-1, "%c", t2 );
+
+    fs << "calibration_time" << buf;
+
+    if( !rvecs.empty() || !reprojErrs.empty() )
+        fs << "nframes" << (int)std::max(rvecs.size(), reprojErrs.size());
+    fs << "image_width" << imageSize.width;
+    fs << "image_height" << imageSize.height;
+    fs << "board_width" << boardSize.width;
+    fs << "board_height" << boardSize.height;
+    fs << "square_size" << squareSize;
+
+    if( flags & CALIB_FIX_ASPECT_RATIO )
+        fs << "aspectRatio" << aspectRatio;
+
+    if( flags != 0 )
+    {
+        sprintf( buf, "flags: %s%s%s%s",
+            flags & CALIB_USE_INTRINSIC_GUESS ? "+use_intrinsic_guess" : "",
+            flags & CALIB_FIX_ASPECT_RATIO ? "+fix_aspectRatio" : "",
+            flags & CALIB_FIX_PRINCIPAL_POINT ? "+fix_principal_point" : "",
+            flags & CALIB_ZERO_TANGENT_DIST ? "+zero_tangent_dist" : "" );
+        fs.writeComment( buf );
+    }
+
+    fs << "flags" << flags;
+
+    fs << "camera_matrix" << cameraMatrix;
+    fs << "distortion_coefficients" << distCoeffs;
+
+    fs << "avg_reprojection_error" << totalAvgErr;
+    if( !reprojErrs.empty() )
+        fs << "per_view_reprojection_errors" << Mat(reprojErrs);
+
+    if( !rvecs.empty() && !tvecs.empty() )
+    {
+        CV_Assert(rvecs[0].type() == tvecs[0].type());
+        Mat bigmat((int)rvecs.size(), 6, rvecs[0].type());
+        for( int i = 0; i < (int)rvecs.size(); i++ )
+        {
+            Mat r = bigmat(Range(i, i+1), Range(0,3));
+            Mat t = bigmat(Range(i, i+1), Range(3,6));
+
+            CV_Assert(rvecs[i].rows == 3 && rvecs[i].cols == 1);
+            CV_Assert(tvecs[i].rows == 3 && tvecs[i].cols == 1);
+            //*.t() is MatExpr (not Mat) so we can use assignment operator
+            r = rvecs[i].t();
+            t = tvecs[i].t();
+        }
+        fs.writeComment( "a set of 6-tuples (rotation vector + translation vector) for each view" );
+        fs << "extrinsic_parameters" << bigmat;
+    }
+
+    if( !imagePoints.empty() )
+    {
+        Mat imagePtMat((int)imagePoints.size(), (int)imagePoints[0].size(), CV_32FC2);
+        for( int i = 0; i < (int)imagePoints.size(); i++ )
+        {
+            Mat r = imagePtMat.row(i).reshape(2, imagePtMat.cols);
+            Mat imgpti(imagePoints[i]);
+            imgpti.copyTo(r);
+        }
+        fs << "image_points" << imagePtMat;
+    }
+}
+
+bool readStringList( const string& filename, vector<string>& l )
+{
+    l.resize(0);
+    FileStorage fs(filename, FileStorage::READ);
+    if( !fs.isOpened() )
+        return false;
+    FileNode n = fs.getFirstTopLevelNode();
+    if( n.type() != FileNode::SEQ )
+        return false;
+    FileNodeIterator it = n.begin(), it_end = n.end();
+    for( ; it != it_end; ++it )
+        l.push_back((string)*it);
+    return true;
+}
+
+bool runAndSave(const string& outputFilename,
+                const vector<vector<Point2f> >& imagePoints,
+                Size imageSize, Size boardSize, Pattern patternType, float squareSize,
+                float aspectRatio, int flags, Mat& cameraMatrix,
+                Mat& distCoeffs, bool writeExtrinsics, bool writePoints,
+                CalibrationReport* report, int robustRounds, float robustThreshold )
+{
+    vector<Mat> rvecs, tvecs;
+    vector<float> reprojErrs;
+    double totalAvgErr = 0;
+
+    int64 start = getTickCount();
+    bool ok;
+    vector<vector<Point2f> > keptPoints;
+    if( robustRounds > 0 )
+    {
+        // the saved points are the full detections of the views that were kept
+        vector<int> keptViews;
+        ok = runRobustCalibration(imagePoints, imageSize, boardSize, patternType, squareSize,
+                       aspectRatio, flags, robustRounds, robustThreshold, cameraMatrix, distCoeffs,
+                       rvecs, tvecs, reprojErrs, totalAvgErr, keptViews);
+        for( size_t i = 0; i < keptViews.size(); i++ )
+            keptPoints.push_back(imagePoints[keptViews[i]]);
+    }
+    else
+    {
+        ok = runCalibration(imagePoints, imageSize, boardSize, patternType, squareSize,
+                       aspectRatio, flags, cameraMatrix, distCoeffs,
+                       rvecs, tvecs, reprojErrs, totalAvgErr);
+        keptPoints = imagePoints;
+    }
+    if( report )
+    {
+        report->framesUsed = (int)keptPoints.size();
+        report->setCalibration(ok, totalAvgErr, (getTickCount() - start)/getTickFrequency());
+    }
+    printf("%s. avg reprojection error = %.2f\n",
+           ok ? "Calibration succeeded" : "Calibration failed",
+           totalAvgErr);
+
+    if( ok && isBinaryCalibrationFile(outputFilename) )
+    {
+        CalibrationData data;
+        data.imageSize = imageSize;
+        data.boardSize = boardSize;
+        data.squareSize = squareSize;
+        data.aspectRatio = aspectRatio;
+        data.flags = flags;
+        data.avgReprojectionError = totalAvgErr;
+        data.cameraMatrix = cameraMatrix;
+        data.distCoeffs = distCoeffs;
+        if( writeExtrinsics )
+        {
+            data.rvecs = rvecs;
+            data.tvecs = tvecs;
+            data.perViewErrors = reprojErrs;
+        }
+        if( writePoints )
+            data.imagePoints = keptPoints;
+
+        // the residuals need the pose of every view
+        if( writeExtrinsics && writePoints )
+        {
+            vector<Point3f> corners;
+            calcChessboardCorners(boardSize, squareSize, corners, patternType);
+            vector<vector<Point3f> > objectPoints(keptPoints.size(), corners);
+            ReprojectionErrors errors;
+            errors.compute(objectPoints, keptPoints, rvecs, tvecs, cameraMatrix, distCoeffs);
+            data.residuals = errors.residuals();
+        }
+
+        if( !saveCalibrationBinary(outputFilename, data) )
+            printf("Could not write %s\n", outputFilename.c_str());
+        else if( !verifyCalibrationBinary(outputFilename, data) )
+            printf("%s does not read back as written\n", outputFilename.c_str());
+    }
+    else if( ok )
+        saveCameraParams( outputFilename, imageSize,
+                         boardSize, squareSize, aspectRatio,
+                         flags, cameraMatrix, distCoeffs,
+                         writeExtrinsics ? rvecs : vector<Mat>(),
+                         writeExtrinsics ? tvecs : vector<Mat>(),
+                         writeExtrinsics ? reprojErrs : vector<float>(),
+                         writePoints ? keptPoints : vector<vector<Point2f> >(),
+                         totalAvgErr );
+    return ok;
+}
+
+}
@@ -12,15 +12,25 @@
 #include <opencv2/videoio.hpp>
 #include <opencv2/highgui.hpp>
 
+#include "CalibrationReport.h"
+#include "PatternDetector.h"
+#include "BoardPresence.h"
+#include "FrameQuality.h"
+#include "VideoStream.h"
+#include "BatchProcessor.h"
+#include "CalibrationCore.h"
+
 using namespace cv;
 using namespace std;
 
 static void help()
 {
     cout <<  "This is a camera calibration sample." << endl
-         <<  "Usage: camera_calibration [configuration_file -- default ./default.xml]"  << endl
+         <<  "Usage: camera_calibration [configuration_file -- default ./default.xml] [-headless]"  << endl
          <<  "Near the sample file you'll find the configuration file, which has detailed help of "
-             "how to edit it.  It may be any OpenCV supported file format XML/YAML." << endl;
+             "how to edit it.  It may be any OpenCV supported file format XML/YAML." << endl
+         <<  "-headless (or Headless in the configuration) runs without a window and writes a "
+             "summary report next to the output file." << endl;
 }
 class Settings
 {
@@ -46,9 +56,15 @@ public:
                   << "Write_outputFileName"  << outputFileName
 
                   << "Show_UndistortedImage" << showUndistorsed
+                  << "Headless" << headless
 
                   << "Input_FlipAroundHorizontalAxis" << flipVertical
                   << "Input_Delay" << delay
+                  << "Input_MaxDetectionSize" << maxDetectionSize
+                  << "Input_VideoStep" << videoStep
+                  << "Input_VideoSeek" << videoSeek
+                  << "Input_MinSharpness" << minSharpness
+                  << "Input_Threads" << threads
                   << "Input" << input
            << "}";
     }
@@ -68,8 +84,14 @@ public:
         node["Calibrate_UseFisheyeModel"] >> useFisheye;
         node["Input_FlipAroundHorizontalAxis"] >> flipVertical;
         node["Show_UndistortedImage"] >> showUndistorsed;
+        node["Headless"] >> headless;
         node["Input"] >> input;
         node["Input_Delay"] >> delay;
+        node["Input_MaxDetectionSize"] >> maxDetectionSize;
+        node["Input_VideoStep"] >> videoStep;
+        node["Input_VideoSeek"] >> videoSeek;
+        node["Input_MinSharpness"] >> minSharpness;
+        node["Input_Threads"] >> threads;
         node["Fix_K1"] >> fixK1;
         node["Fix_K2"] >> fixK2;
         node["Fix_K3"] >> fixK3;
@@ -197,6 +219,11 @@ public:
     int nrFrames;                // The number of frames to use from the input for calibration
     float aspectRatio;           // The aspect ratio
     int delay;                   // In case of a video input
+    int maxDetectionSize;        // Search the pattern downscaled to this longer side, 0 for full resolution
+    int videoStep;               // Only look at every n-th frame of a video file
+    bool videoSeek;              // Seek to the sampled frames instead of decoding the ones in between
+    float minSharpness;          // Skip video frames with a lower Laplacian variance, 0 keeps all
+    int threads;                 // Decode and search image lists on this many threads, 0 or 1 for one
     bool writePoints;            // Write detected feature points
     bool writeExtrinsics;        // Write extrinsic parameters
     bool calibZeroTangentDist;   // Assume zero tangential distortion
@@ -204,6 +231,7 @@ public:
     bool flipVertical;           // Flip the captured images around the horizontal axis
     string outputFileName;       // The name of the file where to write
     bool showUndistorsed;        // Show undistorted images after calibration
+    bool headless;               // No window and no drawing, write a summary report instead
     string input;                // The input ->
     bool useFisheye;             // use fisheye camera model for calibration
     bool fixK1;                  // fix K1 distortion coefficient
@@ -242,7 +270,80 @@ static inline void write(FileStorage& fs, const String&, const Settings& s )
 enum { DETECTION = 0, CAPTURING = 1, CALIBRATED = 2 };
 
 bool runCalibrationAndSave(Settings& s, Size imageSize, Mat&  cameraMatrix, Mat& distCoeffs,
-                           vector<vector<Point2f> > imagePoints );
+                           vector<vector<Point2f> > imagePoints, CalibrationReport* report = 0 );
+
+static bool findPattern( const Settings& s, const PatternDetector& patternDetector,
+                         const Mat& viewGray, vector<Point2f>& pointBuf )
+{
+    int chessBoardFlags = CALIB_CB_ADAPTIVE_THRESH | CALIB_CB_NORMALIZE_IMAGE;
+
+    if(!s.useFisheye) {
+        // fast check erroneously fails with high distortions like fisheye
+        chessBoardFlags |= CALIB_CB_FAST_CHECK;
+    }
+
+    switch( s.calibrationPattern ) // Find feature points on the input format
+    {
+    case Settings::CHESSBOARD:
+        return patternDetector.findChessboard( viewGray, s.boardSize, pointBuf, chessBoardFlags);
+    case Settings::CIRCLES_GRID:
+        return patternDetector.findCirclesGrid( viewGray, s.boardSize, pointBuf, CALIB_CB_SYMMETRIC_GRID );
+    case Settings::ASYMMETRIC_CIRCLES_GRID:
+        return patternDetector.findCirclesGrid( viewGray, s.boardSize, pointBuf, CALIB_CB_ASYMMETRIC_GRID );
+    default:
+        return false;
+    }
+}
+
+struct ListDetection
+{
+    ListDetection() : readable(false), found(false) {}
+
+    bool readable;
+    bool found;
+    Size imageSize;
+    vector<Point2f> pointBuf;
+};
+
+// Decodes and searches the image list on s.threads threads until s.nrFrames
+// views are found. The detections are handed over in list order, so imagePoints
+// holds the same views in the same order as a run on one thread.
+static void detectImageListParallel( const Settings& s, const PatternDetector& patternDetector,
+                                     vector<vector<Point2f> >& imagePoints, Size& imageSize,
+                                     CalibrationReport& report )
+{
+    BatchProcessor<ListDetection> processor(s.threads);
+    processor.run(s.imageList.size(),
+        [&](size_t i, ListDetection& d)
+        {
+            Mat view = imread(s.imageList[i], IMREAD_COLOR), viewGray;
+            if( view.empty() )
+                return;
+            d.readable = true;
+            d.imageSize = view.size();
+            if( s.flipVertical )    flip( view, view, 0 );
+            cvtColor(view, viewGray, COLOR_BGR2GRAY);
+            d.found = findPattern( s, patternDetector, viewGray, d.pointBuf );
+        },
+        [&](size_t i, ListDetection& d)
+        {
+            report.framesProcessed++;
+            if( !d.readable )
+            {
+                cerr << s.imageList[i] << ": could not be read" << endl;
+                report.framesUnreadable++;
+                return;
+            }
+            if( !d.found )
+                return;
+            report.framesWithPattern++;
+            imageSize = d.imageSize;
+            imagePoints.push_back(d.pointBuf);
+            // the list is not searched past the frames that are used
+            if( imagePoints.size() >= (size_t)s.nrFrames )
+                processor.stop();
+        });
+}
 
 int main(int argc, char* argv[])
 {
@@ -261,6 +362,9 @@ int main(int argc, char* argv[])
     fs.release();                                         // close Settings file
     //! [file_read]
 
+    if (argc > 2 && string(argv[2]) == "-headless")
+        s.headless = true;
+
     //FileStorage fout("settings.yml", FileStorage::WRITE); // write config as YAML
     //fout << "Settings" << s;
 
@@ -273,91 +377,142 @@ int main(int argc, char* argv[])
     vector<vector<Point2f> > imagePoints;
     Mat cameraMatrix, distCoeffs;
     Size imageSize;
-    int mode = s.inputType == Settings::IMAGE_LIST ? CAPTURING : DETECTION;
+    // image lists are searched in full, live and video frames without a board are skipped early
+    BoardPresence presence;
+    bool checkPresence = s.inputType == Settings::CAMERA;
+    bool liveInput = s.inputType == Settings::CAMERA || s.inputType == Settings::VIDEO_FILE;
+
+    // a video file is decoded, sampled and prefiltered on a thread of its own,
+    // only the frames that pass the pre-check reach the loop
+    VideoStream* videoStream = 0;
+    if( s.inputType == Settings::VIDEO_FILE )
+    {
+        s.inputCapture.release();
+        VideoStream::Filter prefilter = [&](const Mat& frame)
+        {
+            Mat gray;
+            cvtColor(frame, gray, COLOR_BGR2GRAY);
+            if( s.minSharpness > 0 && FrameQuality::sharpness(gray) < s.minSharpness )
+                return false;
+            return presence.check( gray, s.boardSize, s.calibrationPattern == Settings::CHESSBOARD );
+        };
+        videoStream = new VideoStream(s.videoStep, s.videoSeek);
+        if( !videoStream->open(s.input, prefilter) )
+        {
+            cout << "Could not open the video " << s.input << endl;
+            delete videoStream;
+            return -1;
+        }
+    }
+
+    // nobody can press 'g' without a window
+    int mode = s.inputType == Settings::IMAGE_LIST || s.headless ? CAPTURING : DETECTION;
     clock_t prevTimestamp = 0;
+    double prevVideoTime = 0;
+    CalibrationReport report("camera_calibration");
+    PatternDetector patternDetector(s.maxDetectionSize);
     const Scalar RED(0,0,255), GREEN(0,255,0);
     const char ESC_KEY = 27;
 
+    // an image list on several threads is searched in one go, the loop below then
+    // only shows the result
+    bool listDetected = false;
+    if( s.inputType == Settings::IMAGE_LIST && s.threads > 1 )
+    {
+        detectImageListParallel(s, patternDetector, imagePoints, imageSize, report);
+        if( !imagePoints.empty() &&
+            runCalibrationAndSave(s, imageSize, cameraMatrix, distCoeffs, imagePoints, &report) )
+            mode = CALIBRATED;
+        listDetected = true;
+    }
+
     //! [get_input]
-    for(;;)
+    // the gray buffer keeps its allocation across frames
+    Mat viewGray;
+    while( !listDetected )
     {
         Mat view;
         bool blinkOutput = false;
 
-        view = s.nextImage();
+        size_t listPosition = s.atImageList;
+        VideoStream::Frame frame;
+        if( videoStream )
+        {
+            if( videoStream->next(frame) )
+                view = frame.view;
+        }
+        else
+            view = s.nextImage();
 
         //-----  If no more image, or got enough, then stop calibration and show result -------------
         if( mode == CAPTURING && imagePoints.size() >= (size_t)s.nrFrames )
         {
-          if( runCalibrationAndSave(s, imageSize,  cameraMatrix, distCoeffs, imagePoints))
+          if( runCalibrationAndSave(s, imageSize,  cameraMatrix, distCoeffs, imagePoints, &report))
               mode = CALIBRATED;
           else
               mode = DETECTION;
+          if( s.headless )        // there is nothing to show the result in
+              break;
+        }
+        if( view.empty() && s.headless && s.atImageList > listPosition )
+        {
+            // an unreadable list entry is skipped instead of ending the run
+            cerr << s.imageList[listPosition] << ": could not be read" << endl;
+            report.framesProcessed++;
+            report.framesUnreadable++;
+            continue;
         }
         if(view.empty())          // If there are no more images stop the loop
         {
             // if calibration threshold was not reached yet, calibrate now
             if( mode != CALIBRATED && !imagePoints.empty() )
-                runCalibrationAndSave(s, imageSize,  cameraMatrix, distCoeffs, imagePoints);
+                runCalibrationAndSave(s, imageSize,  cameraMatrix, distCoeffs, imagePoints, &report);
             break;
         }
         //! [get_input]
 
         imageSize = view.size();  // Format input image.
+        report.framesProcessed++;
         if( s.flipVertical )    flip( view, view, 0 );
 
         //! [find_pattern]
         vector<Point2f> pointBuf;
+        cvtColor(view, viewGray, COLOR_BGR2GRAY);
 
-        bool found;
-
-        int chessBoardFlags = CALIB_CB_ADAPTIVE_THRESH | CALIB_CB_NORMALIZE_IMAGE;
-
-        if(!s.useFisheye) {
-            // fast check erroneously fails with high distortions like fisheye
-            chessBoardFlags |= CALIB_CB_FAST_CHECK;
-        }
-
-        switch( s.calibrationPattern ) // Find feature points on the input format
-        {
-        case Settings::CHESSBOARD:
-            found = findChessboardCorners( view, s.boardSize, pointBuf, chessBoardFlags);
-            break;
-        case Settings::CIRCLES_GRID:
-            found = findCirclesGrid( view, s.boardSize, pointBuf );
-            break;
-        case Settings::ASYMMETRIC_CIRCLES_GRID:
-            found = findCirclesGrid( view, s.boardSize, pointBuf, CALIB_CB_ASYMMETRIC_GRID );
-            break;
-        default:
-            found = false;
-            break;
-        }
+        // frames without anything board-like skip the full detector
+        bool found = false;
+        if( !checkPresence || presence.check( viewGray, s.boardSize, s.calibrationPattern == Settings::CHESSBOARD ) )
+            found = findPattern( s, patternDetector, viewGray, pointBuf );
         //! [find_pattern]
         //! [pattern_found]
         if ( found)                // If done with success,
         {
-              // improve the found corners' coordinate accuracy for chessboard
-                if( s.calibrationPattern == Settings::CHESSBOARD)
-                {
-                    Mat viewGray;
-                    cvtColor(view, viewGray, COLOR_BGR2GRAY);
-                    cornerSubPix( viewGray, pointBuf, Size(11,11),
-                        Size(-1,-1), TermCriteria( TermCriteria::EPS+TermCriteria::COUNT, 30, 0.1 ));
-                }
+                report.framesWithPattern++;
+
+                // a video file is not played in real time, so the delay is measured
+                // on the video clock to spread the views over the recording
+                bool delayElapsed;
+                if( videoStream )
+                    delayElapsed = frame.msec - prevVideoTime > s.delay;
+                else
+                    delayElapsed = clock() - prevTimestamp > s.delay*1e-3*CLOCKS_PER_SEC;
 
                 if( mode == CAPTURING &&  // For camera only take new samples after delay time
-                    (!s.inputCapture.isOpened() || clock() - prevTimestamp > s.delay*1e-3*CLOCKS_PER_SEC) )
+                    (!liveInput || delayElapsed) )
                 {
                     imagePoints.push_back(pointBuf);
                     prevTimestamp = clock();
-                    blinkOutput = s.inputCapture.isOpened();
+                    prevVideoTime = frame.msec;
+                    blinkOutput = liveInput;
                 }
 
                 // Draw the corners.
-                drawChessboardCorners( view, s.boardSize, Mat(pointBuf), found );
+                if( !s.headless )
+                    drawChessboardCorners( view, s.boardSize, Mat(pointBuf), found );
         }
         //! [pattern_found]
+        if( s.headless )
+            continue;
         //----------------------------- Output Text ------------------------------------------------
         //! [output_text]
         string msg = (mode == CAPTURING) ? "100/100" :
@@ -393,7 +548,7 @@ int main(int argc, char* argv[])
         //------------------------------ Show image and check for input commands -------------------
         //! [await_input]
         imshow("Image View", view);
-        char key = (char)waitKey(s.inputCapture.isOpened() ? 50 : s.delay);
+        char key = (char)waitKey(videoStream ? 1 : liveInput ? 50 : s.delay);
 
         if( key  == ESC_KEY )
             break;
@@ -401,7 +556,7 @@ int main(int argc, char* argv[])
         if( key == 'u' && mode == CALIBRATED )
            s.showUndistorsed = !s.showUndistorsed;
 
-        if( s.inputCapture.isOpened() && key == 'g' )
+        if( liveInput && key == 'g' )
         {
             mode = CAPTURING;
             imagePoints.clear();
@@ -409,9 +564,26 @@ int main(int argc, char* argv[])
         //! [await_input]
     }
 
+    // the decode thread may still run after ESC or enough frames, its counters
+    // are only final once it is joined
+    if( videoStream )
+    {
+        videoStream->close();
+        printf( "Video: %d frames decoded, %d rejected before detection\n",
+                videoStream->framesDecoded(), videoStream->framesRejected() );
+        report.framesSkipped = videoStream->framesRejected();
+        delete videoStream;
+    }
+
+    if( checkPresence )
+    {
+        printf( "Board pre-check skipped %d of %d frames\n", presence.framesSkipped(), presence.framesChecked() );
+        report.framesSkipped = presence.framesSkipped();
+    }
+
     // -----------------------Show the undistorted image for the image list ------------------------
     //! [show_results]
-    if( s.inputType == Settings::IMAGE_LIST && s.showUndistorsed )
+    if( s.inputType == Settings::IMAGE_LIST && s.showUndistorsed && !s.headless )
     {
         Mat view, rview, map1, map2;
 
@@ -445,6 +617,9 @@ int main(int argc, char* argv[])
     }
     //! [show_results]
 
+    if( s.headless )
+        report.finish(s.outputFileName);
+
     return 0;
 }
 
@@ -455,31 +630,8 @@ static double computeReprojectionErrors( const vector<vector<Point3f> >& objectP
                                          const Mat& cameraMatrix , const Mat& distCoeffs,
                                          vector<float>& perViewErrors, bool fisheye)
 {
-    vector<Point2f> imagePoints2;
-    size_t totalPoints = 0;
-    double totalErr = 0, err;
-    perViewErrors.resize(objectPoints.size());
-
-    for(size_t i = 0; i < objectPoints.size(); ++i )
-    {
-        if (fisheye)
-        {
-            fisheye::projectPoints(objectPoints[i], imagePoints2, rvecs[i], tvecs[i], cameraMatrix,
-                                   distCoeffs);
-        }
-        else
-        {
-            projectPoints(objectPoints[i], rvecs[i], tvecs[i], cameraMatrix, distCoeffs, imagePoints2);
-        }
-        err = norm(imagePoints[i], imagePoints2, NORM_L2);
-
-        size_t n = objectPoints[i].size();
-        perViewErrors[i] = (float) std::sqrt(err*err/n);
-        totalErr        += err*err;
-        totalPoints     += n;
-    }
-
-    return std::sqrt(totalErr/totalPoints);
+    return calibcore::computeReprojectionErrors(objectPoints, imagePoints, rvecs, tvecs,
+                                                cameraMatrix, distCoeffs, perViewErrors, fisheye);
 }
 //! [compute_errors]
 //! [board_corners]
@@ -671,14 +823,20 @@ static void saveCameraParams( Settings& s, Size& imageSize, Mat& cameraMatrix, M
 
 //! [run_and_save]
 bool runCalibrationAndSave(Settings& s, Size imageSize, Mat& cameraMatrix, Mat& distCoeffs,
-                           vector<vector<Point2f> > imagePoints)
+                           vector<vector<Point2f> > imagePoints, CalibrationReport* report)
 {
     vector<Mat> rvecs, tvecs;
     vector<float> reprojErrs;
     double totalAvgErr = 0;
 
+    int64 start = getTickCount();
     bool ok = runCalibration(s, imageSize, cameraMatrix, distCoeffs, imagePoints, rvecs, tvecs, reprojErrs,
                              totalAvgErr);
+    if (report)
+    {
+        report->framesUsed = (int)imagePoints.size();
+        report->setCalibration(ok, totalAvgErr, (getTickCount() - start)/getTickFrequency());
+    }
     cout << (ok ? "Calibration succeeded" : "Calibration failed")
          << ". avg re projection error = " << totalAvgErr << endl;
 
@@ -426,24 +426,63 @@ void CirclesGridClusterFinder::parsePatternPoints(const std::vector<cv::Point2f>
   }
 }
 
-Graph::Graph(size_t n)
+Graph::Graph(size_t n) :
+  verticesCount(0)
 {
-  for (size_t i = 0; i < n; i++)
+  reset(n);
+}
+
+void Graph::reset(size_t n)
+{
+  for (size_t i = 0; i < std::min(n, vertices.size()); i++)
+  {
+    vertices[i].neighbors.clear();
+  }
+  if (vertices.size() < n)
+    vertices.resize(n);
+  verticesCount = n;
+}
+
+size_t Graph::capacityBytes() const
+{
+  size_t bytes = vertices.capacity() * sizeof(Vertex);
+  for (size_t i = 0; i < vertices.size(); i++)
   {
-    addVertex(i);
+    bytes += vertices[i].neighbors.capacity() * sizeof(size_t);
   }
+  return bytes;
 }
 
 bool Graph::doesVertexExist(size_t id) const
 {
-  return (vertices.find(id) != vertices.end());
+  return id < verticesCount;
 }
 
 void Graph::addVertex(size_t id)
 {
   CV_Assert( !doesVertexExist( id ) );
+  //vertex ids are dense
+  CV_Assert( id == verticesCount );
 
-  vertices.insert(std::pair<size_t, Vertex> (id, Vertex()));
+  if (vertices.size() == verticesCount)
+    vertices.push_back(Vertex());
+  else
+    vertices[verticesCount].neighbors.clear();
+  verticesCount++;
+}
+
+static void insertNeighbor(Graph::Neighbors &neighbors, size_t id)
+{
+  Graph::Neighbors::iterator it = std::lower_bound(neighbors.begin(), neighbors.end(), id);
+  if (it == neighbors.end() || *it != id)
+    neighbors.insert(it, id);
+}
+
+static void eraseNeighbor(Graph::Neighbors &neighbors, size_t id)
+{
+  Graph::Neighbors::iterator it = std::lower_bound(neighbors.begin(), neighbors.end(), id);
+  if (it != neighbors.end() && *it == id)
+    neighbors.erase(it);
 }
 
 void Graph::addEdge(size_t id1, size_t id2)
@@ -451,8 +490,8 @@ void Graph::addEdge(size_t id1, size_t id2)
   CV_Assert( doesVertexExist( id1 ) );
   CV_Assert( doesVertexExist( id2 ) );
 
-  vertices[id1].neighbors.insert(id2);
-  vertices[id2].neighbors.insert(id1);
+  insertNeighbor(vertices[id1].neighbors, id2);
+  insertNeighbor(vertices[id2].neighbors, id1);
 }
 
 void Graph::removeEdge(size_t id1, size_t id2)
@@ -460,8 +499,8 @@ void Graph::removeEdge(size_t id1, size_t id2)
   CV_Assert( doesVertexExist( id1 ) );
   CV_Assert( doesVertexExist( id2 ) );
 
-  vertices[id1].neighbors.erase(id2);
-  vertices[id2].neighbors.erase(id1);
+  eraseNeighbor(vertices[id1].neighbors, id2);
+  eraseNeighbor(vertices[id2].neighbors, id1);
 }
 
 bool Graph::areVerticesAdjacent(size_t id1, size_t id2) const
@@ -469,21 +508,30 @@ bool Graph::areVerticesAdjacent(size_t id1, size_t id2) const
   CV_Assert( doesVertexExist( id1 ) );
   CV_Assert( doesVertexExist( id2 ) );
 
-  Vertices::const_iterator it = vertices.find(id1);
-  return it->second.neighbors.find(id2) != it->second.neighbors.end();
+  const Neighbors &neighbors = vertices[id1].neighbors;
+  return std::binary_search(neighbors.begin(), neighbors.end(), id2);
 }
 
 size_t Graph::getVerticesCount() const
 {
-  return vertices.size();
+  return verticesCount;
 }
 
 size_t Graph::getDegree(size_t id) const
 {
   CV_Assert( doesVertexExist(id) );
 
-  Vertices::const_iterator it = vertices.find(id);
-  return it->second.neighbors.size();
+  return vertices[id].neighbors.size();
+}
+
+size_t Graph::getEdgesCount() const
+{
+  size_t degrees = 0;
+  for (size_t i = 0; i < verticesCount; i++)
+  {
+    degrees += vertices[i].neighbors.size();
+  }
+  return degrees / 2;
 }
 
 void Graph::floydWarshall(cv::Mat &distanceMatrix, int infinity) const
@@ -491,35 +539,37 @@ void Graph::floydWarshall(cv::Mat &distanceMatrix, int infinity) const
   const int edgeWeight = 1;
 
   const int n = (int)getVerticesCount();
+  //a preallocated n x n matrix is reused as is
   distanceMatrix.create(n, n, CV_32SC1);
   distanceMatrix.setTo(infinity);
-  for (Vertices::const_iterator it1 = vertices.begin(); it1 != vertices.end();++it1)
+  for (int i1 = 0; i1 < n; i1++)
   {
-    distanceMatrix.at<int> ((int)it1->first, (int)it1->first) = 0;
-    for (Neighbors::const_iterator it2 = it1->second.neighbors.begin(); it2 != it1->second.neighbors.end();++it2)
+    distanceMatrix.at<int> (i1, i1) = 0;
+    const Neighbors &neighbors = vertices[i1].neighbors;
+    for (Neighbors::const_iterator it2 = neighbors.begin(); it2 != neighbors.end();++it2)
     {
-      CV_Assert( it1->first != *it2 );
-      distanceMatrix.at<int> ((int)it1->first, (int)*it2) = edgeWeight;
+      CV_Assert( (size_t)i1 != *it2 );
+      distanceMatrix.at<int> (i1, (int)*it2) = edgeWeight;
     }
   }
 
-  for (Vertices::const_iterator it1 = vertices.begin(); it1 != vertices.end();++it1)
+  for (int i1 = 0; i1 < n; i1++)
   {
-    for (Vertices::const_iterator it2 = vertices.begin(); it2 != vertices.end();++it2)
+    for (int i2 = 0; i2 < n; i2++)
     {
-      for (Vertices::const_iterator it3 = vertices.begin(); it3 != vertices.end();++it3)
+      const int d21 = distanceMatrix.at<int> (i2, i1);
+      if (d21 == infinity)
+        continue;
+
+      int *row2 = distanceMatrix.ptr<int> (i2);
+      const int *row1 = distanceMatrix.ptr<int> (i1);
+      for (int i3 = 0; i3 < n; i3++)
       {
-      int i1 = (int)it1->first, i2 = (int)it2->first, i3 = (int)it3->first;
-        int val1 = distanceMatrix.at<int> (i2, i3);
-        int val2;
-        if (distanceMatrix.at<int> (i2, i1) == infinity ||
-      distanceMatrix.at<int> (i1, i3) == infinity)
-          val2 = val1;
-        else
-        {
-          val2 = distanceMatrix.at<int> (i2, i1) + distanceMatrix.at<int> (i1, i3);
-        }
-        distanceMatrix.at<int> (i2, i3) = (val1 == infinity) ? val2 : std::min(val1, val2);
+        if (row1[i3] == infinity)
+          continue;
+
+        int val2 = d21 + row1[i3];
+        row2[i3] = (row2[i3] == infinity) ? val2 : std::min(row2[i3], val2);
       }
     }
   }
@@ -529,8 +579,7 @@ const Graph::Neighbors& Graph::getNeighbors(size_t id) const
 {
   CV_Assert( doesVertexExist(id) );
 
-  Vertices::const_iterator it = vertices.find(id);
-  return it->second.neighbors;
+  return vertices[id].neighbors;
 }
 
 CirclesGridFinder::Segment::Segment(cv::Point2f _s, cv::Point2f _e) :
@@ -559,54 +608,325 @@ CirclesGridFinderParameters::CirclesGridFinderParameters()
 
   minRNGEdgeSwitchDist = 5.f;
   gridType = SYMMETRIC_GRID;
+
+  parallelEvaluation = false;
+  kmeansSeed = 0xffffffff;
+}
+
+CirclesGridFinderTrace::CirclesGridFinderTrace()
+{
+  clear();
+}
+
+void CirclesGridFinderTrace::clear()
+{
+  rngTime = 0;
+  densityFilterTime = 0;
+  basisTime = 0;
+  mcsTime = 0;
+  longestPathTime = 0;
+  detectionCheckTime = 0;
+  totalTime = 0;
+
+  keypointsCount = 0;
+  addedKeypointsCount = 0;
+  rngEdgesCount = 0;
+  gridVectorsCount = 0;
+  filteredVectorsCount = 0;
+  kmeansAttempts = 0;
+  bestKmeansAttempt = -1;
+  basisEdgesCount[0] = basisEdgesCount[1] = 0;
+  longestPathLength = -1;
+  addedLines = 0;
+  rejectedLines = 0;
+
+  failureReason = NO_FAILURE;
+}
+
+const char* CirclesGridFinderTrace::getFailureReasonName(FailureReason reason)
+{
+  switch (reason)
+  {
+    case NO_FAILURE:
+      return "none";
+    case NO_SAMPLES:
+      return "no rng vectors";
+    case NO_DENSE_SAMPLES:
+      return "no vectors left after density filter";
+    case NO_BASIS:
+      return "basis size is not 2";
+    case DEGENERATE_BASIS:
+      return "degenerate basis";
+    case WRONG_ROWS_COUNT:
+      return "wrong number of rows";
+    case WRONG_ROW_SIZE:
+      return "wrong row size";
+    case DUPLICATE_HOLES:
+      return "holes share keypoints";
+    case UNKNOWN_GRID_TYPE:
+      return "unknown grid type";
+    case EXCEPTION:
+      return "exception";
+  }
+  return "unknown";
+}
+
+void CirclesGridFinderTrace::write(std::ostream &out) const
+{
+  out << "keypoints " << keypointsCount << " (+" << addedKeypointsCount << "), rng edges " << rngEdgesCount
+      << ", vectors " << gridVectorsCount << " -> " << filteredVectorsCount
+      << ", kmeans best " << bestKmeansAttempt << "/" << kmeansAttempts
+      << ", basis edges " << basisEdgesCount[0] << "/" << basisEdgesCount[1]
+      << ", longest path " << longestPathLength << ", lines " << addedLines << " added " << rejectedLines << " rejected"
+      << std::endl;
+  out << std::fixed << std::setprecision(3) << "rng " << rngTime << " ms, density " << densityFilterTime
+      << " ms, basis " << basisTime << " ms, mcs " << mcsTime << " ms (path " << longestPathTime
+      << " ms), check " << detectionCheckTime << " ms, total " << totalTime << " ms" << std::endl;
+  out << "failure: " << getFailureReasonName(failureReason) << std::endl;
+}
+
+//adds the lifetime of the timer to a trace field, does nothing when tracing is off
+class StageTimer
+{
+public:
+  StageTimer(double *_milliseconds) :
+    milliseconds(_milliseconds), start(_milliseconds ? getTickCount() : 0)
+  {
+  }
+
+  ~StageTimer()
+  {
+    if (milliseconds)
+      *milliseconds += (getTickCount() - start) * 1000. / getTickFrequency();
+  }
+
+private:
+  StageTimer(const StageTimer&);
+  StageTimer& operator=(const StageTimer&);
+
+  double *milliseconds;
+  int64 start;
+};
+
+CirclesGridFinderStatistics::CirclesGridFinderStatistics()
+{
+  detections = 0;
+  workspaceGrowths = 0;
+  lastGrowthDetection = 0;
+  workspaceBytes = 0;
+}
+
+void CirclesGridMatrixArena::acquire(int count, int rows, int cols, std::vector<Mat> &matrices)
+{
+  CV_Assert(count >= 0 && rows >= 0 && cols >= 0);
+
+  const size_t matrixSize = static_cast<size_t> (rows) * cols;
+  if (buffer.size() < count * matrixSize)
+    buffer.resize(count * matrixSize);
+
+  matrices.resize(count);
+  for (int i = 0; i < count; i++)
+  {
+    matrices[i] = Mat(rows, cols, CV_32SC1, buffer.empty() ? 0 : &buffer[i * matrixSize]);
+  }
+}
+
+size_t CirclesGridMatrixArena::capacityBytes() const
+{
+  return buffer.capacity() * sizeof(int);
+}
+
+static size_t pointsCapacityBytes(const std::vector<std::vector<Point2f> > &points)
+{
+  size_t bytes = points.capacity() * sizeof(std::vector<Point2f>);
+  for (size_t i = 0; i < points.size(); i++)
+  {
+    bytes += points[i].capacity() * sizeof(Point2f);
+  }
+  return bytes;
+}
+
+static size_t indicesCapacityBytes(const std::vector<std::vector<size_t> > &indices)
+{
+  size_t bytes = indices.capacity() * sizeof(std::vector<size_t>);
+  for (size_t i = 0; i < indices.size(); i++)
+  {
+    bytes += indices[i].capacity() * sizeof(size_t);
+  }
+  return bytes;
+}
+
+size_t CirclesGridFinderWorkspace::capacityBytes() const
+{
+  size_t bytes = (vectors.capacity() + tmpVectors.capacity() + filteredVectors.capacity() + basis.capacity())
+      * sizeof(Point2f);
+  bytes += basisIndices.capacity() * sizeof(int);
+  bytes += rng.capacityBytes() + basisGraphs.capacity() * sizeof(Graph);
+  for (size_t i = 0; i < basisGraphs.size(); i++)
+  {
+    bytes += basisGraphs[i].capacityBytes();
+  }
+
+  bytes += (attemptLabels.capacity() + attemptCenters.capacity()) * sizeof(Mat);
+  for (size_t i = 0; i < attemptCenters.size(); i++)
+  {
+    bytes += attemptCenters[i].total() * attemptCenters[i].elemSize();
+  }
+  bytes += compactness.capacity() * sizeof(double) + labelsArena.capacityBytes();
+  bytes += pointsCapacityBytes(clusters) + pointsCapacityBytes(hulls);
+
+  bytes += (distanceMatrices.capacity() + predecessorMatrices.capacity()) * sizeof(Mat);
+  bytes += distanceArena.capacityBytes() + predecessorArena.capacityBytes();
+  bytes += (longestPath.vertices.capacity() + holesRow.capacity()) * sizeof(size_t);
+
+  for (int i = 0; i < 2; i++)
+  {
+    bytes += (candidates[i].capacity() + seeds[i].capacity()) * sizeof(size_t);
+  }
+  bytes += indicesCapacityBytes(holesRowPool) + vertexIds.capacity() * sizeof(size_t);
+  return bytes;
 }
 
 CirclesGridFinder::CirclesGridFinder(Size _patternSize, const std::vector<Point2f> &testKeypoints,
                                      const CirclesGridFinderParameters &_parameters) :
-  patternSize(static_cast<size_t> (_patternSize.width), static_cast<size_t> (_patternSize.height))
+  CirclesGridFinder(_patternSize, _parameters)
+{
+  reset(testKeypoints);
+}
+
+CirclesGridFinder::CirclesGridFinder(Size _patternSize, const CirclesGridFinderParameters &_parameters) :
+  patternSize(static_cast<size_t> (_patternSize.width), static_cast<size_t> (_patternSize.height)),
+  initialParameters(_parameters)
 {
   CV_Assert(_patternSize.height >= 0 && _patternSize.width >= 0);
 
-  keypoints = testKeypoints;
   parameters = _parameters;
   largeHoles = 0;
   smallHoles = 0;
+  trace = 0;
+}
+
+void CirclesGridFinder::reset(const std::vector<Point2f> &testKeypoints)
+{
+  keypoints.assign(testKeypoints.begin(), testKeypoints.end());
+  parameters = initialParameters;
+  recycleHoles(holes);
+  recycleHoles(holes2);
+  largeHoles = 0;
+  smallHoles = 0;
+}
+
+const CirclesGridFinderStatistics& CirclesGridFinder::getStatistics() const
+{
+  return statistics;
+}
+
+void CirclesGridFinder::setTrace(CirclesGridFinderTrace *_trace)
+{
+  trace = _trace;
+}
+
+void CirclesGridFinder::setFailure(CirclesGridFinderTrace::FailureReason reason) const
+{
+  if (trace && trace->failureReason == CirclesGridFinderTrace::NO_FAILURE)
+    trace->failureReason = reason;
+}
+
+void CirclesGridFinder::updateStatistics()
+{
+  size_t bytes = workspace.capacityBytes() + keypoints.capacity() * sizeof(Point2f);
+  bytes += indicesCapacityBytes(holes) + indicesCapacityBytes(holes2);
+  if (bytes > statistics.workspaceBytes)
+  {
+    statistics.workspaceGrowths++;
+    statistics.lastGrowthDetection = statistics.detections;
+  }
+  statistics.workspaceBytes = bytes;
+}
+
+void CirclesGridFinder::recycleHoles(std::vector<std::vector<size_t> > &rows)
+{
+  for (size_t i = 0; i < rows.size(); i++)
+  {
+    rows[i].clear();
+    workspace.holesRowPool.push_back(std::vector<size_t>());
+    workspace.holesRowPool.back().swap(rows[i]);
+  }
+  rows.clear();
+}
+
+void CirclesGridFinder::takeHolesRow(std::vector<size_t> &row)
+{
+  row.clear();
+  if (!workspace.holesRowPool.empty())
+  {
+    row.swap(workspace.holesRowPool.back());
+    workspace.holesRowPool.pop_back();
+  }
 }
 
 bool CirclesGridFinder::findHoles()
 {
+  if (trace)
+  {
+    trace->clear();
+    trace->keypointsCount = keypoints.size();
+  }
+  StageTimer timer(trace ? &trace->totalTime : 0);
+
+  statistics.detections++;
+  bool isFound = false;
+  try
+  {
+    isFound = detectHoles();
+  }
+  catch (...)
+  {
+    setFailure(CirclesGridFinderTrace::EXCEPTION);
+    updateStatistics();
+    throw;
+  }
+  if (trace)
+    trace->addedKeypointsCount = keypoints.size() - trace->keypointsCount;
+  updateStatistics();
+  return isFound;
+}
+
+bool CirclesGridFinder::detectHoles()
+{
+  CirclesGridFinderWorkspace &ws = workspace;
   switch (parameters.gridType)
   {
     case CirclesGridFinderParameters::SYMMETRIC_GRID:
     {
-      std::vector<Point2f> vectors, filteredVectors, basis;
-      Graph rng(0);
-      computeRNG(rng, vectors);
-      filterOutliersByDensity(vectors, filteredVectors);
-      std::vector<Graph> basisGraphs;
-      findBasis(filteredVectors, basis, basisGraphs);
-      findMCS(basis, basisGraphs);
+      computeRNG(ws.rng, ws.vectors);
+      if (trace)
+        trace->gridVectorsCount = ws.vectors.size();
+      filterOutliersByDensity(ws.vectors, ws.filteredVectors);
+      findBasis(ws.filteredVectors, ws.basis, ws.basisGraphs);
+      findMCS(ws.basis, ws.basisGraphs);
       break;
     }
 
     case CirclesGridFinderParameters::ASYMMETRIC_GRID:
     {
-      std::vector<Point2f> vectors, tmpVectors, filteredVectors, basis;
-      Graph rng(0);
-      computeRNG(rng, tmpVectors);
-      rng2gridGraph(rng, vectors);
-      filterOutliersByDensity(vectors, filteredVectors);
-      std::vector<Graph> basisGraphs;
-      findBasis(filteredVectors, basis, basisGraphs);
-      findMCS(basis, basisGraphs);
-      eraseUsedGraph(basisGraphs);
-      holes2 = holes;
-      holes.clear();
-      findMCS(basis, basisGraphs);
+      computeRNG(ws.rng, ws.tmpVectors);
+      ws.vectors.clear();
+      rng2gridGraph(ws.rng, ws.vectors);
+      if (trace)
+        trace->gridVectorsCount = ws.vectors.size();
+      filterOutliersByDensity(ws.vectors, ws.filteredVectors);
+      findBasis(ws.filteredVectors, ws.basis, ws.basisGraphs);
+      findMCS(ws.basis, ws.basisGraphs);
+      eraseUsedGraph(ws.basisGraphs);
+      recycleHoles(holes2);
+      holes2.swap(holes);
+      findMCS(ws.basis, ws.basisGraphs);
       break;
     }
 
     default:
+      setFailure(CirclesGridFinderTrace::UNKNOWN_GRID_TYPE);
       CV_Error(Error::StsBadArg, "Unkown pattern type");
   }
   return (isDetectionCorrect());
@@ -617,11 +937,11 @@ void CirclesGridFinder::rng2gridGraph(Graph &rng, std::vector<cv::Point2f> &vect
 {
   for (size_t i = 0; i < rng.getVerticesCount(); i++)
   {
-    Graph::Neighbors neighbors1 = rng.getNeighbors(i);
-    for (Graph::Neighbors::iterator it1 = neighbors1.begin(); it1 != neighbors1.end(); ++it1)
+    const Graph::Neighbors &neighbors1 = rng.getNeighbors(i);
+    for (Graph::Neighbors::const_iterator it1 = neighbors1.begin(); it1 != neighbors1.end(); ++it1)
     {
-      Graph::Neighbors neighbors2 = rng.getNeighbors(*it1);
-      for (Graph::Neighbors::iterator it2 = neighbors2.begin(); it2 != neighbors2.end(); ++it2)
+      const Graph::Neighbors &neighbors2 = rng.getNeighbors(*it1);
+      for (Graph::Neighbors::const_iterator it2 = neighbors2.begin(); it2 != neighbors2.end(); ++it2)
       {
         if (i < *it2)
         {
@@ -663,26 +983,37 @@ void CirclesGridFinder::eraseUsedGraph(std::vector<Graph> &basisGraphs) const
 
 bool CirclesGridFinder::isDetectionCorrect()
 {
+  StageTimer timer(trace ? &trace->detectionCheckTime : 0);
   switch (parameters.gridType)
   {
     case CirclesGridFinderParameters::SYMMETRIC_GRID:
     {
       if (holes.size() != patternSize.height)
+      {
+        setFailure(CirclesGridFinderTrace::WRONG_ROWS_COUNT);
         return false;
+      }
 
-      std::set<size_t> vertices;
+      std::vector<size_t> &vertices = workspace.vertexIds;
+      vertices.clear();
       for (size_t i = 0; i < holes.size(); i++)
       {
         if (holes[i].size() != patternSize.width)
-          return false;
-
-        for (size_t j = 0; j < holes[i].size(); j++)
         {
-          vertices.insert(holes[i][j]);
+          setFailure(CirclesGridFinderTrace::WRONG_ROW_SIZE);
+          return false;
         }
+
+        vertices.insert(vertices.end(), holes[i].begin(), holes[i].end());
       }
 
-      return vertices.size() == patternSize.area();
+      std::sort(vertices.begin(), vertices.end());
+      if ((size_t)(std::unique(vertices.begin(), vertices.end()) - vertices.begin()) != patternSize.area())
+      {
+        setFailure(CirclesGridFinderTrace::DUPLICATE_HOLES);
+        return false;
+      }
+      return true;
     }
 
     case CirclesGridFinderParameters::ASYMMETRIC_GRID:
@@ -715,39 +1046,45 @@ bool CirclesGridFinder::isDetectionCorrect()
 
       if (largeHoles->size() != lh || smallHoles->size() != sh)
       {
+        setFailure(CirclesGridFinderTrace::WRONG_ROWS_COUNT);
         return false;
       }
 
-      std::set<size_t> vertices;
+      std::vector<size_t> &vertices = workspace.vertexIds;
+      vertices.clear();
       for (size_t i = 0; i < largeHoles->size(); i++)
       {
         if (largeHoles->at(i).size() != lw)
         {
+          setFailure(CirclesGridFinderTrace::WRONG_ROW_SIZE);
           return false;
         }
 
-        for (size_t j = 0; j < largeHoles->at(i).size(); j++)
-        {
-          vertices.insert(largeHoles->at(i)[j]);
-        }
+        vertices.insert(vertices.end(), largeHoles->at(i).begin(), largeHoles->at(i).end());
 
         if (i < smallHoles->size())
         {
           if (smallHoles->at(i).size() != sw)
           {
+            setFailure(CirclesGridFinderTrace::WRONG_ROW_SIZE);
             return false;
           }
 
-          for (size_t j = 0; j < smallHoles->at(i).size(); j++)
-          {
-            vertices.insert(smallHoles->at(i)[j]);
-          }
+          vertices.insert(vertices.end(), smallHoles->at(i).begin(), smallHoles->at(i).end());
         }
       }
-      return (vertices.size() == largeHeight * largeWidth + smallHeight * smallWidth);
+      std::sort(vertices.begin(), vertices.end());
+      size_t uniqueCount = std::unique(vertices.begin(), vertices.end()) - vertices.begin();
+      if (uniqueCount != largeHeight * largeWidth + smallHeight * smallWidth)
+      {
+        setFailure(CirclesGridFinderTrace::DUPLICATE_HOLES);
+        return false;
+      }
+      return true;
     }
 
     default:
+      setFailure(CirclesGridFinderTrace::UNKNOWN_GRID_TYPE);
       CV_Error(0, "Unknown pattern type");
   }
 
@@ -756,10 +1093,14 @@ bool CirclesGridFinder::isDetectionCorrect()
 
 void CirclesGridFinder::findMCS(const std::vector<Point2f> &basis, std::vector<Graph> &basisGraphs)
 {
-  holes.clear();
-  Path longestPath;
+  StageTimer timer(trace ? &trace->mcsTime : 0);
+  recycleHoles(holes);
+  Path &longestPath = workspace.longestPath;
   size_t bestGraphIdx = findLongestPath(basisGraphs, longestPath);
-  std::vector<size_t> holesRow = longestPath.vertices;
+  if (trace)
+    trace->longestPathLength = longestPath.length;
+  std::vector<size_t> &holesRow = workspace.holesRow;
+  holesRow.assign(longestPath.vertices.begin(), longestPath.vertices.end());
 
   while (holesRow.size() > std::max(patternSize.width, patternSize.height))
   {
@@ -769,7 +1110,9 @@ void CirclesGridFinder::findMCS(const std::vector<Point2f> &basis, std::vector<G
 
   if (bestGraphIdx == 0)
   {
-    holes.push_back(holesRow);
+    holes.push_back(std::vector<size_t>());
+    takeHolesRow(holes.back());
+    holes.back().assign(holesRow.begin(), holesRow.end());
     size_t w = holes[0].size();
     size_t h = holes.size();
 
@@ -794,7 +1137,10 @@ void CirclesGridFinder::findMCS(const std::vector<Point2f> &basis, std::vector<G
   {
     holes.resize(holesRow.size());
     for (size_t i = 0; i < holesRow.size(); i++)
+    {
+      takeHolesRow(holes[i]);
       holes[i].push_back(holesRow[i]);
+    }
 
     size_t w = holes[0].size();
     size_t h = holes.size();
@@ -963,19 +1309,25 @@ void CirclesGridFinder::insertWinner(float aboveConfidence, float belowConfidenc
 
   if (addRow)
   {
+    std::vector<size_t> row;
+    takeHolesRow(row);
     if (aboveConfidence >= belowConfidence)
     {
       //if (!areCentersNew(above, holes))
       //  CV_Error( 0, "Centers are not new" );
 
-      holes.insert(holes.begin(), above);
+      row.assign(above.begin(), above.end());
+      holes.insert(holes.begin(), std::vector<size_t>());
+      holes.front().swap(row);
     }
     else
     {
       //if (!areCentersNew(below, holes))
       //  CV_Error( 0, "Centers are not new" );
 
-      holes.insert(holes.end(), below);
+      row.assign(below.begin(), below.end());
+      holes.push_back(std::vector<size_t>());
+      holes.back().swap(row);
     }
   }
   else
@@ -1004,7 +1356,7 @@ void CirclesGridFinder::insertWinner(float aboveConfidence, float belowConfidenc
 }
 
 float CirclesGridFinder::computeGraphConfidence(const std::vector<Graph> &basisGraphs, bool addRow,
-                                                const std::vector<size_t> &points, const std::vector<size_t> &seeds)
+                                                const std::vector<size_t> &points, const std::vector<size_t> &seeds) const
 {
   CV_Assert( points.size() == seeds.size() );
   float confidence = 0;
@@ -1049,20 +1401,66 @@ float CirclesGridFinder::computeGraphConfidence(const std::vector<Graph> &basisG
 
 }
 
+//evaluates the confidence of the candidate line above (index 0) and below (index 1) the current holes
+class CirclesGridFinder::GraphConfidenceInvoker : public ParallelLoopBody
+{
+public:
+  GraphConfidenceInvoker(const CirclesGridFinder &_finder, const std::vector<Graph> &_basisGraphs, bool _addRow,
+                         const std::vector<size_t> *_points, const std::vector<size_t> *_seeds, float *_confidences) :
+    finder(_finder), basisGraphs(_basisGraphs), addRow(_addRow), points(_points), seeds(_seeds), confidences(_confidences)
+  {
+  }
+
+  void operator()(const Range &range) const
+  {
+    for (int i = range.start; i < range.end; i++)
+    {
+      confidences[i] = finder.computeGraphConfidence(basisGraphs, addRow, points[i], seeds[i]);
+    }
+  }
+
+private:
+  GraphConfidenceInvoker& operator=(const GraphConfidenceInvoker&);
+
+  const CirclesGridFinder &finder;
+  const std::vector<Graph> &basisGraphs;
+  bool addRow;
+  const std::vector<size_t> *points;
+  const std::vector<size_t> *seeds;
+  float *confidences;
+};
+
 void CirclesGridFinder::addHolesByGraph(const std::vector<Graph> &basisGraphs, bool addRow, Point2f basisVec)
 {
-  std::vector<size_t> above, below, aboveSeeds, belowSeeds;
-  findCandidateHoles(above, below, addRow, basisVec, aboveSeeds, belowSeeds);
-  float aboveConfidence = computeGraphConfidence(basisGraphs, addRow, above, aboveSeeds);
-  float belowConfidence = computeGraphConfidence(basisGraphs, addRow, below, belowSeeds);
+  std::vector<size_t> *candidates = workspace.candidates, *seeds = workspace.seeds;
+  //candidate search may append new keypoints, so it stays serial
+  findCandidateHoles(candidates[0], candidates[1], addRow, basisVec, seeds[0], seeds[1]);
+
+  float confidences[2];
+  GraphConfidenceInvoker invoker(*this, basisGraphs, addRow, candidates, seeds, confidences);
+  if (parameters.parallelEvaluation)
+    parallel_for_(Range(0, 2), invoker);
+  else
+    invoker(Range(0, 2));
 
-  insertWinner(aboveConfidence, belowConfidence, parameters.minGraphConfidence, addRow, above, below, holes);
+  if (trace)
+  {
+    if (confidences[0] < parameters.minGraphConfidence && confidences[1] < parameters.minGraphConfidence)
+      trace->rejectedLines++;
+    else
+      trace->addedLines++;
+  }
+  insertWinner(confidences[0], confidences[1], parameters.minGraphConfidence, addRow, candidates[0], candidates[1], holes);
 }
 
 void CirclesGridFinder::filterOutliersByDensity(const std::vector<Point2f> &samples, std::vector<Point2f> &filteredSamples)
 {
+  StageTimer timer(trace ? &trace->densityFilterTime : 0);
   if (samples.empty())
+  {
+    setFailure(CirclesGridFinderTrace::NO_SAMPLES);
     CV_Error( 0, "samples is empty" );
+  }
 
   filteredSamples.clear();
 
@@ -1080,22 +1478,76 @@ void CirclesGridFinder::filterOutliersByDensity(const std::vector<Point2f> &samp
       filteredSamples.push_back(samples[i]);
   }
 
+  if (trace)
+    trace->filteredVectorsCount = filteredSamples.size();
   if (filteredSamples.empty())
+  {
+    setFailure(CirclesGridFinderTrace::NO_DENSE_SAMPLES);
     CV_Error( 0, "filteredSamples is empty" );
+  }
 }
 
+//runs single kmeans attempts, each one with its own deterministic seed
+class KmeansAttemptInvoker : public ParallelLoopBody
+{
+public:
+  KmeansAttemptInvoker(const Mat &_data, int _clustersCount, uint64 _seed, std::vector<Mat> &_labels,
+                       std::vector<Mat> &_centers, std::vector<double> &_compactness) :
+    data(_data), clustersCount(_clustersCount), seed(_seed), labels(_labels), centers(_centers), compactness(_compactness)
+  {
+  }
+
+  void operator()(const Range &range) const
+  {
+    //theRNG() is per thread, restore its state for other users of the worker
+    RNG savedRNG = theRNG();
+    TermCriteria termCriteria;
+    for (int i = range.start; i < range.end; i++)
+    {
+      theRNG() = RNG(seed + (uint64)i);
+      compactness[i] = kmeans(data, clustersCount, labels[i], termCriteria, 1, KMEANS_RANDOM_CENTERS, centers[i]);
+    }
+    theRNG() = savedRNG;
+  }
+
+private:
+  KmeansAttemptInvoker& operator=(const KmeansAttemptInvoker&);
+
+  const Mat &data;
+  int clustersCount;
+  uint64 seed;
+  std::vector<Mat> &labels;
+  std::vector<Mat> &centers;
+  std::vector<double> &compactness;
+};
+
 void CirclesGridFinder::findBasis(const std::vector<Point2f> &samples, std::vector<Point2f> &basis, std::vector<Graph> &basisGraphs)
 {
+  StageTimer timer(trace ? &trace->basisTime : 0);
   basis.clear();
-  Mat bestLabels;
-  TermCriteria termCriteria;
-  Mat centers;
   const int clustersCount = 4;
-  kmeans(Mat(samples).reshape(1, 0), clustersCount, bestLabels, termCriteria, parameters.kmeansAttempts,
-         KMEANS_RANDOM_CENTERS, centers);
+  const int attempts = std::max(parameters.kmeansAttempts, 1);
+  std::vector<Mat> &attemptLabels = workspace.attemptLabels, &attemptCenters = workspace.attemptCenters;
+  std::vector<double> &compactness = workspace.compactness;
+  //labels live in the arena, the 4x2 centers keep their size and are reused by kmeans
+  workspace.labelsArena.acquire(attempts, (int)samples.size(), 1, attemptLabels);
+  attemptCenters.resize(attempts);
+  compactness.resize(attempts);
+  Mat data = Mat(samples).reshape(1, 0);
+  KmeansAttemptInvoker invoker(data, clustersCount, parameters.kmeansSeed, attemptLabels, attemptCenters, compactness);
+  if (parameters.parallelEvaluation)
+    parallel_for_(Range(0, attempts), invoker);
+  else
+    invoker(Range(0, attempts));
+
+  //the first attempt with the smallest compactness wins, independent of the evaluation order
+  size_t bestAttempt = std::min_element(compactness.begin(), compactness.end()) - compactness.begin();
+  Mat bestLabels = attemptLabels[bestAttempt];
+  Mat centers = attemptCenters[bestAttempt];
   CV_Assert( centers.type() == CV_32FC1 );
 
-  std::vector<int> basisIndices;
+  std::vector<int> &basisIndices = workspace.basisIndices;
+  basisIndices.clear();
   //TODO: only remove duplicate
   for (int i = 0; i < clustersCount; i++)
   {
@@ -1107,8 +1559,16 @@ void CirclesGridFinder::findBasis(const std::vector<Point2f> &samples, std::vect
       basisIndices.push_back(i);
     }
   }
+  if (trace)
+  {
+    trace->kmeansAttempts = attempts;
+    trace->bestKmeansAttempt = (int)bestAttempt;
+  }
   if (basis.size() != 2)
+  {
+    setFailure(CirclesGridFinderTrace::NO_BASIS);
     CV_Error(0, "Basis size is not 2");
+  }
 
   if (basis[1].x > basis[0].x)
   {
@@ -1118,9 +1578,18 @@ void CirclesGridFinder::findBasis(const std::vector<Point2f> &samples, std::vect
 
   const float minBasisDif = 2;
   if (norm(basis[0] - basis[1]) < minBasisDif)
+  {
+    setFailure(CirclesGridFinderTrace::DEGENERATE_BASIS);
     CV_Error(0, "degenerate basis" );
+  }
 
-  std::vector<std::vector<Point2f> > clusters(2), hulls(2);
+  std::vector<std::vector<Point2f> > &clusters = workspace.clusters, &hulls = workspace.hulls;
+  clusters.resize(2);
+  hulls.resize(2);
+  for (size_t i = 0; i < clusters.size(); i++)
+  {
+    clusters[i].clear();
+  }
   for (int k = 0; k < (int)samples.size(); k++)
   {
     int label = bestLabels.at<int> (k, 0);
@@ -1139,7 +1608,11 @@ void CirclesGridFinder::findBasis(const std::vector<Point2f> &samples, std::vect
     convexHull(Mat(clusters[i]), hulls[i]);
   }
 
-  basisGraphs.resize(basis.size(), Graph(keypoints.size()));
+  basisGraphs.resize(basis.size());
+  for (size_t i = 0; i < basisGraphs.size(); i++)
+  {
+    basisGraphs[i].reset(keypoints.size());
+  }
   for (size_t i = 0; i < keypoints.size(); i++)
   {
     for (size_t j = 0; j < keypoints.size(); j++)
@@ -1160,11 +1633,17 @@ void CirclesGridFinder::findBasis(const std::vector<Point2f> &samples, std::vect
   }
   if (basisGraphs.size() != 2)
     CV_Error(0, "Number of basis graphs is not 2");
+  if (trace)
+  {
+    trace->basisEdgesCount[0] = basisGraphs[0].getEdgesCount();
+    trace->basisEdgesCount[1] = basisGraphs[1].getEdgesCount();
+  }
 }
 
 void CirclesGridFinder::computeRNG(Graph &rng, std::vector<cv::Point2f> &vectors, Mat *drawImage) const
 {
-  rng = Graph(keypoints.size());
+  StageTimer timer(trace ? &trace->rngTime : 0);
+  rng.reset(keypoints.size());
   vectors.clear();
 
   //TODO: use more fast algorithm instead of naive N^3
@@ -1206,6 +1685,9 @@ void CirclesGridFinder::computeRNG(Graph &rng, std::vector<cv::Point2f> &vectors
       }
     }
   }
+
+  if (trace)
+    trace->rngEdgesCount = rng.getEdgesCount();
 }
 
 void computePredecessorMatrix(const Mat &dm, int verticesCount, Mat &predecessorMatrix)
@@ -1242,65 +1724,79 @@ static void computeShortestPath(Mat &predecessorMatrix, size_t v1, size_t v2, st
   path.push_back(v2);
 }
 
-size_t CirclesGridFinder::findLongestPath(std::vector<Graph> &basisGraphs, Path &bestPath)
+//computes the all-pairs shortest paths of every basis graph
+class ShortestPathsInvoker : public ParallelLoopBody
 {
-  std::vector<Path> longestPaths(1);
-  std::vector<int> confidences;
+public:
+  ShortestPathsInvoker(const std::vector<Graph> &_graphs, int _infinity, std::vector<Mat> &_distanceMatrices,
+                       std::vector<Mat> &_predecessorMatrices) :
+    graphs(_graphs), infinity(_infinity), distanceMatrices(_distanceMatrices), predecessorMatrices(_predecessorMatrices)
+  {
+  }
+
+  void operator()(const Range &range) const
+  {
+    for (int i = range.start; i < range.end; i++)
+    {
+      graphs[i].floydWarshall(distanceMatrices[i], infinity);
+      computePredecessorMatrix(distanceMatrices[i], (int)graphs[i].getVerticesCount(), predecessorMatrices[i]);
+    }
+  }
+
+private:
+  ShortestPathsInvoker& operator=(const ShortestPathsInvoker&);
 
+  const std::vector<Graph> &graphs;
+  int infinity;
+  std::vector<Mat> &distanceMatrices;
+  std::vector<Mat> &predecessorMatrices;
+};
+
+size_t CirclesGridFinder::findLongestPath(std::vector<Graph> &basisGraphs, Path &bestPath)
+{
+  StageTimer timer(trace ? &trace->longestPathTime : 0);
   size_t bestGraphIdx = 0;
   const int infinity = -1;
+  //keypoints added by addHolesByGraph are not part of the graphs
+  const int n = (int)basisGraphs[0].getVerticesCount();
+  CV_Assert( basisGraphs[0].getVerticesCount() == basisGraphs[1].getVerticesCount() );
+  std::vector<Mat> &distanceMatrices = workspace.distanceMatrices, &predecessorMatrices = workspace.predecessorMatrices;
+  workspace.distanceArena.acquire((int)basisGraphs.size(), n, n, distanceMatrices);
+  workspace.predecessorArena.acquire((int)basisGraphs.size(), n, n, predecessorMatrices);
+  ShortestPathsInvoker invoker(basisGraphs, infinity, distanceMatrices, predecessorMatrices);
+  if (parameters.parallelEvaluation)
+    parallel_for_(Range(0, (int)basisGraphs.size()), invoker);
+  else
+    invoker(Range(0, (int)basisGraphs.size()));
+
+  //a later graph only wins with a strictly longer path
+  double bestLength = -1;
+  Point bestLoc;
   for (size_t graphIdx = 0; graphIdx < basisGraphs.size(); graphIdx++)
   {
-    const Graph &g = basisGraphs[graphIdx];
-    Mat distanceMatrix;
-    g.floydWarshall(distanceMatrix, infinity);
-    Mat predecessorMatrix;
-    computePredecessorMatrix(distanceMatrix, (int)g.getVerticesCount(), predecessorMatrix);
-
     double maxVal;
     Point maxLoc;
-    minMaxLoc(distanceMatrix, 0, &maxVal, 0, &maxLoc);
+    minMaxLoc(distanceMatrices[graphIdx], 0, &maxVal, 0, &maxLoc);
 
-    if (maxVal > longestPaths[0].length)
+    if (maxVal > bestLength)
     {
-      longestPaths.clear();
-      confidences.clear();
+      bestLength = maxVal;
+      bestLoc = maxLoc;
       bestGraphIdx = graphIdx;
     }
-    if (longestPaths.empty() || (maxVal == longestPaths[0].length && graphIdx == bestGraphIdx))
-    {
-      Path path = Path(maxLoc.x, maxLoc.y, cvRound(maxVal));
-      CV_Assert(maxLoc.x >= 0 && maxLoc.y >= 0)
-        ;
-      size_t id1 = static_cast<size_t> (maxLoc.x);
-      size_t id2 = static_cast<size_t> (maxLoc.y);
-      computeShortestPath(predecessorMatrix, id1, id2, path.vertices);
-      longestPaths.push_back(path);
-
-      int conf = 0;
-      for (int v2 = 0; v2 < (int)path.vertices.size(); v2++)
-      {
-        conf += (int)basisGraphs[1 - (int)graphIdx].getDegree(v2);
-      }
-      confidences.push_back(conf);
-    }
   }
   //if( bestGraphIdx != 0 )
   //CV_Error( 0, "" );
 
-  int maxConf = -1;
-  int bestPathIdx = -1;
-  for (int i = 0; i < (int)confidences.size(); i++)
-  {
-    if (confidences[i] > maxConf)
-    {
-      maxConf = confidences[i];
-      bestPathIdx = i;
-    }
-  }
+  CV_Assert(bestLoc.x >= 0 && bestLoc.y >= 0)
+    ;
+  bestPath.firstVertex = bestLoc.x;
+  bestPath.lastVertex = bestLoc.y;
+  bestPath.length = cvRound(bestLength);
+  bestPath.vertices.clear();
+  computeShortestPath(predecessorMatrices[bestGraphIdx], static_cast<size_t> (bestLoc.x),
+                      static_cast<size_t> (bestLoc.y), bestPath.vertices);
 
-  //int bestPathIdx = rand() % longestPaths.size();
-  bestPath = longestPaths.at(bestPathIdx);
   bool needReverse = (bestGraphIdx == 0 && keypoints[bestPath.lastVertex].x < keypoints[bestPath.firstVertex].x)
       || (bestGraphIdx == 1 && keypoints[bestPath.lastVertex].y < keypoints[bestPath.firstVertex].y);
   if (needReverse)
@@ -1599,3 +2095,160 @@ size_t CirclesGridFinder::getFirstCorner(std::vector<Point> &largeCornerIndices,
 
   return cornerIdx;
 }
+
+CirclesGridTrackerParameters::CirclesGridTrackerParameters()
+{
+  roiScale = 0.45f;
+  minBlobAreaRatio = 0.03f;
+  maxBlobAreaRatio = 0.7f;
+  maxCenterShift = 0.5f;
+  maxReprojectionError = 0.15f;
+  blobColor = 0;
+}
+
+CirclesGridTracker::CirclesGridTracker(Size _patternSize, bool isAsymmetricGrid,
+                                       const CirclesGridTrackerParameters &_parameters) :
+  patternSize(_patternSize), parameters(_parameters), motion(0.f, 0.f), tracking(false), trackedFrames(0), lostCount(0)
+{
+  CV_Assert(patternSize.height > 0 && patternSize.width > 0);
+
+  for (int i = 0; i < patternSize.height; i++)
+  {
+    for (int j = 0; j < patternSize.width; j++)
+    {
+      if (isAsymmetricGrid)
+        idealPoints.push_back(Point2f(static_cast<float> (2 * j + i % 2), static_cast<float> (i)));
+      else
+        idealPoints.push_back(Point2f(static_cast<float> (j), static_cast<float> (i)));
+    }
+  }
+}
+
+void CirclesGridTracker::reset(const std::vector<Point2f> &centers)
+{
+  CV_Assert(centers.size() == idealPoints.size());
+
+  trackedCenters = centers;
+  motion = Point2f(0.f, 0.f);
+  homography = findHomography(idealPoints, trackedCenters, 0);
+  tracking = !homography.empty();
+}
+
+void CirclesGridTracker::lose()
+{
+  if (tracking)
+    lostCount++;
+  tracking = false;
+}
+
+bool CirclesGridTracker::isTracking() const
+{
+  return tracking;
+}
+
+const Mat& CirclesGridTracker::getHomography() const
+{
+  return homography;
+}
+
+size_t CirclesGridTracker::getTrackedFrames() const
+{
+  return trackedFrames;
+}
+
+size_t CirclesGridTracker::getLostCount() const
+{
+  return lostCount;
+}
+
+bool CirclesGridTracker::refineCenter(const Mat &gray, Point2f predicted, float nearestDistance, Point2f &center)
+{
+  float radius = parameters.roiScale * nearestDistance;
+  int halfSize = cvCeil(radius);
+  if (halfSize < 2)
+    return false;
+
+  Rect window(cvRound(predicted.x) - halfSize, cvRound(predicted.y) - halfSize, 2 * halfSize + 1, 2 * halfSize + 1);
+  Rect roi = window & Rect(0, 0, gray.cols, gray.rows);
+  //a clipped window would pull the centroid towards the image border
+  if (roi.area() != window.area())
+    return false;
+
+  int thresholdType = (parameters.blobColor == 0 ? THRESH_BINARY_INV : THRESH_BINARY) | THRESH_OTSU;
+  threshold(gray(roi), mask, 0, 255, thresholdType);
+
+  Moments m = moments(mask, true);
+  double areaRatio = m.m00 / roi.area();
+  if (areaRatio < parameters.minBlobAreaRatio || areaRatio > parameters.maxBlobAreaRatio)
+    return false;
+
+  center = Point2f(static_cast<float> (m.m10 / m.m00 + roi.x), static_cast<float> (m.m01 / m.m00 + roi.y));
+  return norm(center - predicted) <= parameters.maxCenterShift * radius;
+}
+
+bool CirclesGridTracker::track(const Mat &gray, std::vector<Point2f> &centers)
+{
+  if (!tracking)
+    return false;
+
+  CV_Assert(gray.type() == CV_8UC1);
+
+  const size_t n = trackedCenters.size();
+  predictedCenters.resize(n);
+  for (size_t i = 0; i < n; i++)
+  {
+    predictedCenters[i] = trackedCenters[i] + motion;
+  }
+
+  nearestDistances.assign(n, std::numeric_limits<float>::max());
+  for (size_t i = 0; i < n; i++)
+  {
+    for (size_t j = i + 1; j < n; j++)
+    {
+      float dist = static_cast<float> (norm(predictedCenters[i] - predictedCenters[j]));
+      nearestDistances[i] = std::min(nearestDistances[i], dist);
+      nearestDistances[j] = std::min(nearestDistances[j], dist);
+    }
+  }
+
+  refinedCenters.resize(n);
+  for (size_t i = 0; i < n; i++)
+  {
+    if (!refineCenter(gray, predictedCenters[i], nearestDistances[i], refinedCenters[i]))
+    {
+      lose();
+      return false;
+    }
+  }
+
+  //the refined centers must still form a planar grid, otherwise a window snapped to a wrong blob
+  Mat H = findHomography(idealPoints, refinedCenters, 0);
+  if (H.empty())
+  {
+    lose();
+    return false;
+  }
+
+  perspectiveTransform(idealPoints, reprojectedCenters, H);
+  for (size_t i = 0; i < n; i++)
+  {
+    if (norm(reprojectedCenters[i] - refinedCenters[i]) > parameters.maxReprojectionError * nearestDistances[i])
+    {
+      lose();
+      return false;
+    }
+  }
+
+  Point2f shift(0.f, 0.f);
+  for (size_t i = 0; i < n; i++)
+  {
+    shift += refinedCenters[i] - trackedCenters[i];
+  }
+  motion = shift * (1.f / n);
+
+  trackedCenters.swap(refinedCenters);
+  homography = H;
+  centers = trackedCenters;
+  trackedFrames++;
+  return true;
+}
@@ -0,0 +1,509 @@
+/*****************************************************************************
+* Application :		Camera Calibration Application
+*					using OpenCV3 (http://opencv.org/)
+*
+* Author      :		Michael Stengel <virtuellerealitaet@gmail.com>
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+*    1. Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*
+*    2. Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#include <stdafx.h>
+#include "circlesgrid.hpp"
+
+using namespace cv;
+using namespace std;
+
+static void help()
+{
+    printf( "Benchmark of the in-tree circles grid finders\n"
+        "Renders symmetric and asymmetric circle grids (clean, perspective, blur and noise variants),\n"
+        "detects blobs and runs CirclesGridFinder and CirclesGridClusterFinder on them.\n"
+        "Usage: circlesgridbenchmark\n"
+        "     [-w <board_width>]       # the number of circles per row (4 by default)\n"
+        "     [-h <board_height>]      # the number of circle rows (11 by default)\n"
+        "     [-n <cases>]             # rendered images per variant (50 by default)\n"
+        "     [-r <repeats>]           # runs of the finders per image for timing (1 by default)\n"
+        "     [-seed <seed>]           # seed of the rendered corpus (0 by default)\n"
+        "     [-e <max_error>]         # max mean center error in pixels of a correct detection (2 by default)\n"
+        "     [-parallel]              # evaluate the finder candidates in parallel\n"
+        "     [-k <keypoints.yml>]     # additionally run the stored keypoint sets of the file\n"
+        "     [-dump <keypoints.yml>]  # store the keypoint sets of the rendered corpus\n"
+        "\n" );
+}
+
+enum Variant { CLEAN, PERSPECTIVE, BLUR, NOISE, VARIANTS_COUNT };
+
+static const char *variantNames[VARIANTS_COUNT] = { "clean", "perspective", "blur", "noise" };
+
+static const Size imageSize(640, 480);
+
+struct KeypointSet
+{
+    Size patternSize;
+    bool isAsymmetricGrid;
+    vector<Point2f> points;
+    vector<Point2f> centers;
+};
+
+struct BenchmarkResults
+{
+    BenchmarkResults() : cases(0), blobTime(0),
+        finderFound(0), finderCorrect(0), finderError(0),
+        clusterFound(0), clusterCorrect(0), clusterError(0), clusterTime(0)
+    {
+        for( int i = 0; i <= CirclesGridFinderTrace::EXCEPTION; i++ )
+            failures[i] = 0;
+    }
+
+    string name;
+    int cases;
+    double blobTime;
+
+    int finderFound, finderCorrect;
+    double finderError;
+    CirclesGridFinderTrace finderTime;
+    // failure reasons of the last attempt of failed detections
+    int failures[CirclesGridFinderTrace::EXCEPTION + 1];
+
+    int clusterFound, clusterCorrect;
+    double clusterError, clusterTime;
+};
+
+static vector<Point2f> idealGridPoints(Size patternSize, bool isAsymmetricGrid, float spacing)
+{
+    vector<Point2f> points;
+    for( int i = 0; i < patternSize.height; i++ )
+        for( int j = 0; j < patternSize.width; j++ )
+            points.push_back(Point2f(float((isAsymmetricGrid ? 2*j + i % 2 : j) + 1)*spacing,
+                                     float(i + 1)*spacing));
+    return points;
+}
+
+// draws the grid on a flat board and warps it into the camera image,
+// the warped circle centers are the ground truth
+static void renderGrid(Size patternSize, bool isAsymmetricGrid, int variant, RNG& rng,
+                       Mat& image, vector<Point2f>& centers)
+{
+    const float spacing = 40;
+    const float radius = spacing*(isAsymmetricGrid ? 0.35f : 0.3f);
+    const int shift = 4;
+
+    vector<Point2f> boardPoints = idealGridPoints(patternSize, isAsymmetricGrid, spacing);
+    int columns = isAsymmetricGrid ? 2*patternSize.width + 1 : patternSize.width + 1;
+    Size boardSize(cvRound(columns*spacing), cvRound((patternSize.height + 1)*spacing));
+
+    Mat board(boardSize, CV_8UC1, Scalar(255));
+    for( size_t i = 0; i < boardPoints.size(); i++ )
+        circle(board, Point(cvRound(boardPoints[i].x*(1 << shift)), cvRound(boardPoints[i].y*(1 << shift))),
+               cvRound(radius*(1 << shift)), Scalar(0), -1, LINE_AA, shift);
+
+    // fit the board into the image, rotated and moved a bit
+    float scale = 0.8f*std::min(imageSize.width/float(boardSize.width), imageSize.height/float(boardSize.height));
+    double angle = rng.uniform(-0.3, 0.3);
+    Point2f center(imageSize.width*0.5f + rng.uniform(-20.f, 20.f), imageSize.height*0.5f + rng.uniform(-20.f, 20.f));
+    Point2f boardCorners[4] = { Point2f(0, 0), Point2f((float)boardSize.width, 0),
+        Point2f((float)boardSize.width, (float)boardSize.height), Point2f(0, (float)boardSize.height) };
+    Point2f imageCorners[4];
+    for( int i = 0; i < 4; i++ )
+    {
+        Point2f p = (boardCorners[i] - Point2f(boardSize.width*0.5f, boardSize.height*0.5f))*scale;
+        imageCorners[i] = center + Point2f(float(p.x*cos(angle) - p.y*sin(angle)), float(p.x*sin(angle) + p.y*cos(angle)));
+        if( variant == PERSPECTIVE )
+            imageCorners[i] += Point2f(rng.uniform(-0.1f, 0.1f)*imageSize.width,
+                                       rng.uniform(-0.1f, 0.1f)*imageSize.height);
+    }
+
+    Mat H = getPerspectiveTransform(boardCorners, imageCorners);
+    warpPerspective(board, image, H, imageSize, INTER_LINEAR, BORDER_CONSTANT, Scalar(190));
+    perspectiveTransform(boardPoints, centers, H);
+
+    if( variant == BLUR )
+        GaussianBlur(image, image, Size(), 2.0);
+    else if( variant == NOISE )
+    {
+        Mat noise(imageSize, CV_16SC1);
+        rng.fill(noise, RNG::NORMAL, 0, 10);
+        Mat noisy;
+        image.convertTo(noisy, CV_16SC1);
+        noisy += noise;
+        noisy.convertTo(image, CV_8UC1);
+    }
+}
+
+// centers are compared in the detected order and reversed,
+// both orderings are valid results of the finders
+static double centerError(const vector<Point2f>& centers, const vector<Point2f>& truth)
+{
+    if( centers.size() != truth.size() || truth.empty() )
+        return -1;
+
+    double forward = 0, backward = 0;
+    size_t n = truth.size();
+    for( size_t i = 0; i < n; i++ )
+    {
+        forward += norm(centers[i] - truth[i]);
+        backward += norm(centers[i] - truth[n - 1 - i]);
+    }
+    return std::min(forward, backward)/n;
+}
+
+static void addTrace(CirclesGridFinderTrace& sum, const CirclesGridFinderTrace& trace)
+{
+    sum.rngTime += trace.rngTime;
+    sum.densityFilterTime += trace.densityFilterTime;
+    sum.basisTime += trace.basisTime;
+    sum.mcsTime += trace.mcsTime;
+    sum.longestPathTime += trace.longestPathTime;
+    sum.detectionCheckTime += trace.detectionCheckTime;
+    sum.totalTime += trace.totalTime;
+}
+
+// same attempts as cv::findCirclesGrid: a failed first attempt is retried
+// on keypoints rectified with the partially detected grid
+static bool runGridFinder(CirclesGridFinder& finder, bool isAsymmetricGrid, vector<Point2f> points,
+                          vector<Point2f>& centers, CirclesGridFinderTrace& time,
+                          CirclesGridFinderTrace::FailureReason& failure)
+{
+    const int attempts = 2;
+    const size_t minHomographyPoints = 4;
+    CirclesGridFinderTrace trace;
+    finder.setTrace(&trace);
+
+    Mat H;
+    for( int i = 0; i < attempts; i++ )
+    {
+        centers.clear();
+        finder.reset(points);
+        bool isFound = false;
+        try
+        {
+            isFound = finder.findHoles();
+        }
+        catch( const cv::Exception& )
+        {
+        }
+        addTrace(time, trace);
+        failure = trace.failureReason;
+
+        if( isFound )
+        {
+            if( isAsymmetricGrid )
+                finder.getAsymmetricHoles(centers);
+            else
+                finder.getHoles(centers);
+
+            if( i != 0 )
+            {
+                Mat orgPointsMat;
+                transform(centers, orgPointsMat, H.inv());
+                convertPointsFromHomogeneous(orgPointsMat, centers);
+            }
+            finder.setTrace(0);
+            return true;
+        }
+
+        finder.getHoles(centers);
+        if( i != attempts - 1 )
+        {
+            if( centers.size() < minHomographyPoints )
+                break;
+            H = CirclesGridFinder::rectifyGrid(finder.getDetectedGridSize(), centers, points, points);
+        }
+    }
+    finder.setTrace(0);
+    centers.clear();
+    return false;
+}
+
+static bool runClusterFinder(const KeypointSet& set, vector<Point2f>& centers)
+{
+    CirclesGridClusterFinder clusterFinder(set.isAsymmetricGrid);
+    try
+    {
+        clusterFinder.findGrid(set.points, set.patternSize, centers);
+    }
+    catch( const cv::Exception& )
+    {
+        centers.clear();
+    }
+    return centers.size() == (size_t)set.patternSize.area();
+}
+
+static void runKeypointSet(const KeypointSet& set, CirclesGridFinder& finder, int repeats,
+                           double maxError, BenchmarkResults& results)
+{
+    vector<Point2f> centers;
+    results.cases++;
+
+    for( int r = 0; r < repeats; r++ )
+    {
+        CirclesGridFinderTrace::FailureReason failure;
+        bool found = runGridFinder(finder, set.isAsymmetricGrid, set.points, centers, results.finderTime, failure);
+        if( r == 0 && !found )
+            results.failures[failure]++;
+        if( r == 0 && found )
+        {
+            results.finderFound++;
+            double error = centerError(centers, set.centers);
+            if( error >= 0 && error <= maxError )
+            {
+                results.finderCorrect++;
+                results.finderError += error;
+            }
+        }
+    }
+
+    for( int r = 0; r < repeats; r++ )
+    {
+        int64 start = getTickCount();
+        bool found = runClusterFinder(set, centers);
+        results.clusterTime += (getTickCount() - start)*1000./getTickFrequency();
+        if( r == 0 && found )
+        {
+            results.clusterFound++;
+            double error = centerError(centers, set.centers);
+            if( error >= 0 && error <= maxError )
+            {
+                results.clusterCorrect++;
+                results.clusterError += error;
+            }
+        }
+    }
+}
+
+static void printResults(const BenchmarkResults& results, int repeats)
+{
+    if( results.cases == 0 )
+        return;
+
+    double n = results.cases, runs = double(results.cases)*repeats;
+    const CirclesGridFinderTrace& t = results.finderTime;
+    printf("%-24s %5d %8.2f | %6.1f%% %6.1f%% %7.3f | %7.3f %7.3f %7.3f %7.3f %7.3f %7.3f | %6.1f%% %6.1f%% %7.3f %7.3f\n",
+        results.name.c_str(), results.cases, results.blobTime/n,
+        100.*results.finderFound/n, 100.*results.finderCorrect/n,
+        results.finderCorrect ? results.finderError/results.finderCorrect : 0.,
+        t.rngTime/runs, t.densityFilterTime/runs, t.basisTime/runs, t.mcsTime/runs, t.longestPathTime/runs, t.totalTime/runs,
+        100.*results.clusterFound/n, 100.*results.clusterCorrect/n,
+        results.clusterCorrect ? results.clusterError/results.clusterCorrect : 0.,
+        results.clusterTime/runs);
+}
+
+static bool readKeypointSets(const string& filename, vector<KeypointSet>& sets)
+{
+    FileStorage fs(filename, FileStorage::READ);
+    if( !fs.isOpened() )
+        return false;
+
+    FileNode node = fs["keypoint_sets"];
+    for( FileNodeIterator it = node.begin(); it != node.end(); ++it )
+    {
+        KeypointSet set;
+        set.patternSize = Size((int)(*it)["board_width"], (int)(*it)["board_height"]);
+        set.isAsymmetricGrid = (int)(*it)["asymmetric"] != 0;
+        (*it)["points"] >> set.points;
+        (*it)["centers"] >> set.centers;
+        sets.push_back(set);
+    }
+    return true;
+}
+
+static void writeKeypointSets(const string& filename, const vector<KeypointSet>& sets)
+{
+    FileStorage fs(filename, FileStorage::WRITE);
+    fs << "keypoint_sets" << "[";
+    for( size_t i = 0; i < sets.size(); i++ )
+    {
+        fs << "{" << "board_width" << sets[i].patternSize.width
+                  << "board_height" << sets[i].patternSize.height
+                  << "asymmetric" << (int)sets[i].isAsymmetricGrid
+                  << "points" << sets[i].points
+                  << "centers" << sets[i].centers << "}";
+    }
+    fs << "]";
+}
+
+static CirclesGridFinderParameters finderParameters(bool isAsymmetricGrid, bool parallelEvaluation)
+{
+    // the parameters cv::findCirclesGrid uses
+    CirclesGridFinderParameters parameters;
+    parameters.vertexPenalty = -0.6f;
+    parameters.vertexGain = 1;
+    parameters.existingVertexGain = 10000;
+    parameters.edgeGain = 1;
+    parameters.edgePenalty = -0.6f;
+    parameters.gridType = isAsymmetricGrid ? CirclesGridFinderParameters::ASYMMETRIC_GRID
+                                           : CirclesGridFinderParameters::SYMMETRIC_GRID;
+    parameters.parallelEvaluation = parallelEvaluation;
+    return parameters;
+}
+
+int main( int argc, char** argv )
+{
+    Size boardSize(4, 11);
+    int cases = 50;
+    int repeats = 1;
+    int seed = 0;
+    double maxError = 2;
+    bool parallelEvaluation = false;
+    const char* keypointsFilename = 0;
+    const char* dumpFilename = 0;
+
+    for( int i = 1; i < argc; i++ )
+    {
+        const char* s = argv[i];
+        if( strcmp( s, "-w" ) == 0 )
+        {
+            if( sscanf( argv[++i], "%d", &boardSize.width ) != 1 || boardSize.width <= 1 )
+                return fprintf( stderr, "Invalid board width\n" ), -1;
+        }
+        else if( strcmp( s, "-h" ) == 0 )
+        {
+            if( sscanf( argv[++i], "%d", &boardSize.height ) != 1 || boardSize.height <= 1 )
+                return fprintf( stderr, "Invalid board height\n" ), -1;
+        }
+        else if( strcmp( s, "-n" ) == 0 )
+        {
+            if( sscanf( argv[++i], "%d", &cases ) != 1 || cases < 0 )
+                return fprintf( stderr, "Invalid number of cases\n" ), -1;
+        }
+        else if( strcmp( s, "-r" ) == 0 )
+        {
+            if( sscanf( argv[++i], "%d", &repeats ) != 1 || repeats <= 0 )
+                return fprintf( stderr, "Invalid number of repeats\n" ), -1;
+        }
+        else if( strcmp( s, "-seed" ) == 0 )
+        {
+            if( sscanf( argv[++i], "%d", &seed ) != 1 )
+                return fprintf( stderr, "Invalid seed\n" ), -1;
+        }
+        else if( strcmp( s, "-e" ) == 0 )
+        {
+            if( sscanf( argv[++i], "%lf", &maxError ) != 1 || maxError <= 0 )
+                return fprintf( stderr, "Invalid max error\n" ), -1;
+        }
+        else if( strcmp( s, "-parallel" ) == 0 )
+        {
+            parallelEvaluation = true;
+        }
+        else if( strcmp( s, "-k" ) == 0 )
+        {
+            keypointsFilename = argv[++i];
+        }
+        else if( strcmp( s, "-dump" ) == 0 )
+        {
+            dumpFilename = argv[++i];
+        }
+        else if( strcmp( s, "-help" ) == 0 || strcmp( s, "--help" ) == 0 )
+        {
+            help();
+            return 0;
+        }
+        else
+            return fprintf( stderr, "Unknown option %s\n", s ), -1;
+    }
+
+    // the default blob detector of cv::findCirclesGrid
+    Ptr<SimpleBlobDetector> blobDetector = SimpleBlobDetector::create();
+    CirclesGridFinder symmetricFinder(boardSize, finderParameters(false, parallelEvaluation));
+    CirclesGridFinder asymmetricFinder(boardSize, finderParameters(true, parallelEvaluation));
+
+    RNG rng((uint64)seed);
+    vector<BenchmarkResults> results;
+    vector<KeypointSet> renderedSets;
+
+    for( int asymmetric = 0; asymmetric < 2; asymmetric++ )
+    {
+        for( int variant = 0; variant < VARIANTS_COUNT; variant++ )
+        {
+            BenchmarkResults variantResults;
+            variantResults.name = string(asymmetric ? "asymmetric " : "symmetric ") + variantNames[variant];
+
+            for( int c = 0; c < cases; c++ )
+            {
+                KeypointSet set;
+                set.patternSize = boardSize;
+                set.isAsymmetricGrid = asymmetric != 0;
+
+                Mat image;
+                renderGrid(boardSize, set.isAsymmetricGrid, variant, rng, image, set.centers);
+
+                int64 start = getTickCount();
+                vector<KeyPoint> keypoints;
+                blobDetector->detect(image, keypoints);
+                variantResults.blobTime += (getTickCount() - start)*1000./getTickFrequency();
+                KeyPoint::convert(keypoints, set.points);
+
+                runKeypointSet(set, asymmetric ? asymmetricFinder : symmetricFinder, repeats, maxError, variantResults);
+                if( dumpFilename )
+                    renderedSets.push_back(set);
+            }
+            results.push_back(variantResults);
+        }
+    }
+
+    if( keypointsFilename )
+    {
+        vector<KeypointSet> storedSets;
+        if( !readKeypointSets(keypointsFilename, storedSets) )
+            return fprintf( stderr, "Could not read keypoint sets from %s\n", keypointsFilename ), -1;
+
+        BenchmarkResults storedResults;
+        storedResults.name = "stored keypoints";
+        for( size_t i = 0; i < storedSets.size(); i++ )
+        {
+            CirclesGridFinder finder(storedSets[i].patternSize,
+                                     finderParameters(storedSets[i].isAsymmetricGrid, parallelEvaluation));
+            runKeypointSet(storedSets[i], finder, repeats, maxError, storedResults);
+        }
+        results.push_back(storedResults);
+    }
+
+    if( dumpFilename )
+        writeKeypointSets(dumpFilename, renderedSets);
+
+    printf("board %dx%d, %d cases per variant, %d repeats, times in ms per run\n",
+        boardSize.width, boardSize.height, cases, repeats);
+    printf("%-24s %5s %8s | %7s %7s %7s | %7s %7s %7s %7s %7s %7s | %7s %7s %7s %7s\n",
+        "variant", "cases", "blobs",
+        "found", "correct", "error", "rng", "density", "basis", "mcs", "path", "total",
+        "found", "correct", "error", "time");
+    printf("%-24s %5s %8s | %-23s | %-47s | %s\n", "", "", "", "CirclesGridFinder", "CirclesGridFinder stages",
+        "CirclesGridClusterFinder");
+    for( size_t i = 0; i < results.size(); i++ )
+        printResults(results[i], repeats);
+
+    printf("\nCirclesGridFinder failures\n");
+    for( size_t i = 0; i < results.size(); i++ )
+    {
+        for( int reason = 0; reason <= CirclesGridFinderTrace::EXCEPTION; reason++ )
+        {
+            if( results[i].failures[reason] > 0 )
+                printf("%-24s %5d  %s\n", results[i].name.c_str(), results[i].failures[reason],
+                    CirclesGridFinderTrace::getFailureReasonName((CirclesGridFinderTrace::FailureReason)reason));
+        }
+    }
+
+    return 0;
+}
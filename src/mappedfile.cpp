@@ -0,0 +1,120 @@
+/*****************************************************************************
+* Application :		Camera Calibration Application
+*					using OpenCV3 (http://opencv.org/)
+*
+* Author      :		Michael Stengel <virtuellerealitaet@gmail.com>
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+*    1. Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*
+*    2. Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace calibcore
+{
+
+MappedFile::MappedFile()
+    : _data(0), _size(0),
+#ifdef _WIN32
+      _file(INVALID_HANDLE_VALUE), _mapping(0)
+#else
+      _file(-1)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open( const string& filename )
+{
+    close();
+
+#ifdef _WIN32
+    _file = CreateFileA( filename.c_str(), GENERIC_READ, FILE_SHARE_READ, 0,
+                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0 );
+    if( _file == INVALID_HANDLE_VALUE )
+        return false;
+    LARGE_INTEGER size;
+    if( !GetFileSizeEx( _file, &size ) || size.QuadPart == 0 )
+        return close(), false;
+    _mapping = CreateFileMappingA( _file, 0, PAGE_READONLY, 0, 0, 0 );
+    if( !_mapping )
+        return close(), false;
+    _data = (const unsigned char*)MapViewOfFile( _mapping, FILE_MAP_READ, 0, 0, 0 );
+    _size = (size_t)size.QuadPart;
+#else
+    _file = ::open( filename.c_str(), O_RDONLY );
+    if( _file < 0 )
+        return false;
+    struct stat st;
+    if( fstat( _file, &st ) != 0 || st.st_size == 0 )
+        return close(), false;
+    void* mapped = mmap( 0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, _file, 0 );
+    _data = mapped == MAP_FAILED ? 0 : (const unsigned char*)mapped;
+    _size = (size_t)st.st_size;
+#endif
+    if( !_data )
+        return close(), false;
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if( _data )
+        UnmapViewOfFile( _data );
+    if( _mapping )
+        CloseHandle( _mapping );
+    if( _file != INVALID_HANDLE_VALUE )
+        CloseHandle( _file );
+    _mapping = 0;
+    _file = INVALID_HANDLE_VALUE;
+#else
+    if( _data )
+        munmap( (void*)_data, _size );
+    if( _file >= 0 )
+        ::close( _file );
+    _file = -1;
+#endif
+    _data = 0;
+    _size = 0;
+}
+
+}
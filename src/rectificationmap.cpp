@@ -0,0 +1,240 @@
+/*****************************************************************************
+* Application :		Camera Calibration Application
+*					using OpenCV3 (http://opencv.org/)
+*
+* Author      :		Michael Stengel <virtuellerealitaet@gmail.com>
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+*    1. Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*
+*    2. Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+#include "RectificationMap.h"
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/calib3d.hpp>
+
+#include <string.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using namespace cv;
+using namespace std;
+
+namespace calibcore
+{
+
+static const char rectificationMagic[8] = { 'R', 'E', 'C', 'T', 'M', 'A', 'P', 0 };
+
+// everything the maps depend on as doubles: model, image size, then each
+// matrix as its element count and values. The same calibration read back as
+// float or double gives the same parameters and key.
+static void addMat( vector<double>& params, const Mat& m )
+{
+    Mat values;
+    if( !m.empty() )
+        m.reshape(1, (int)m.total() * m.channels()).convertTo( values, CV_64F );
+
+    params.push_back( values.rows );
+    for( int i = 0; i < values.rows; i++ )
+        params.push_back( values.at<double>(i) );
+}
+
+static vector<double> mapParameters( const Mat& cameraMatrix, const Mat& distCoeffs,
+                                     const Mat& R, const Mat& P, Size imageSize, RectificationMap::Model model )
+{
+    vector<double> params;
+    params.push_back( model );
+    params.push_back( imageSize.width );
+    params.push_back( imageSize.height );
+    addMat( params, cameraMatrix );
+    addMat( params, distCoeffs );
+    addMat( params, R );
+    addMat( params, P );
+    return params;
+}
+
+static uint64_t hashParameters( const vector<double>& params )
+{
+    const uint64_t prime = 1099511628211ULL;
+    uint64_t hash = 14695981039346656037ULL;
+    hash = (hash ^ RECTIFICATION_MAP_VERSION) * prime;
+    for( size_t i = 0; i < params.size(); i++ )
+    {
+        uint64_t word;
+        memcpy( &word, &params[i], sizeof(word) );
+        hash = (hash ^ word) * prime;
+    }
+    return hash;
+}
+
+uint64_t RectificationMap::key( const Mat& cameraMatrix, const Mat& distCoeffs,
+                                const Mat& R, const Mat& P, Size imageSize, Model model )
+{
+    return hashParameters( mapParameters( cameraMatrix, distCoeffs, R, P, imageSize, model ) );
+}
+
+bool RectificationMap::init( const string& directory, const Mat& cameraMatrix, const Mat& distCoeffs,
+                             const Mat& R, const Mat& P, Size imageSize, Model model )
+{
+    release();
+    if( cameraMatrix.empty() || imageSize.area() == 0 )
+        return false;
+
+    vector<double> params = mapParameters( cameraMatrix, distCoeffs, R, P, imageSize, model );
+    string filename;
+    if( !directory.empty() )
+    {
+        char buf[32];
+        sprintf( buf, "%016llx.map", (unsigned long long)hashParameters( params ) );
+        filename = directory + "/" + buf;
+
+        if( load( filename, imageSize, params ) )
+            return true;
+    }
+
+    if( model == FISHEYE_MODEL )
+        fisheye::initUndistortRectifyMap( cameraMatrix, distCoeffs, R, P, imageSize, CV_16SC2, _map1, _map2 );
+    else
+        initUndistortRectifyMap( cameraMatrix, distCoeffs, R, P, imageSize, CV_16SC2, _map1, _map2 );
+
+    // a cache that cannot be written only costs the next start its maps
+    if( !filename.empty() && !save( filename, _map1, _map2, params ) )
+        printf( "Could not write the map cache %s\n", filename.c_str() );
+    return true;
+}
+
+void RectificationMap::release()
+{
+    _map1.release();
+    _map2.release();
+    _file.close();
+    _fromCache = false;
+}
+
+void RectificationMap::apply( const Mat& src, Mat& dst ) const
+{
+    CV_Assert( isValid() && src.size() == _map1.size() );
+    remap( src, dst, _map1, _map2, INTER_LINEAR );
+}
+
+bool RectificationMap::load( const string& filename, Size imageSize, const vector<double>& params )
+{
+    if( !_file.open( filename ) )
+        return false;
+
+    const RectificationMapHeader& h = *(const RectificationMapHeader*)_file.data();
+    uint64_t map1Bytes = (uint64_t)imageSize.area() * 2 * sizeof(short);
+    uint64_t map2Bytes = (uint64_t)imageSize.area() * sizeof(ushort);
+    uint64_t paramsBytes = (uint64_t)params.size() * sizeof(double);
+
+    // a file of another version or other parameters under a colliding key is rebuilt
+    bool valid = _file.size() >= sizeof(RectificationMapHeader) &&
+                 memcmp( h.magic, rectificationMagic, sizeof(h.magic) ) == 0 &&
+                 h.version == RECTIFICATION_MAP_VERSION &&
+                 h.headerSize == sizeof(RectificationMapHeader) &&
+                 h.key == hashParameters( params ) &&
+                 h.width == imageSize.width && h.height == imageSize.height &&
+                 h.map1Type == CV_16SC2 && h.map2Type == CV_16UC1 &&
+                 h.fileSize <= _file.size() &&
+                 h.paramsCount == params.size() &&
+                 h.paramsOffset >= sizeof(RectificationMapHeader) && h.paramsOffset + paramsBytes <= h.fileSize &&
+                 memcmp( _file.data() + h.paramsOffset, params.data(), paramsBytes ) == 0 &&
+                 h.map1Offset >= sizeof(RectificationMapHeader) && h.map1Offset + map1Bytes <= h.fileSize &&
+                 h.map2Offset >= sizeof(RectificationMapHeader) && h.map2Offset + map2Bytes <= h.fileSize;
+    if( !valid )
+    {
+        _file.close();
+        return false;
+    }
+
+    _map1 = Mat( imageSize, CV_16SC2, (void*)(_file.data() + h.map1Offset) );
+    _map2 = Mat( imageSize, CV_16UC1, (void*)(_file.data() + h.map2Offset) );
+    _fromCache = true;
+    return true;
+}
+
+bool RectificationMap::save( const string& filename, const Mat& map1, const Mat& map2,
+                             const vector<double>& params )
+{
+    CV_Assert( map1.type() == CV_16SC2 && map2.type() == CV_16UC1 &&
+               map1.isContinuous() && map2.isContinuous() );
+
+    RectificationMapHeader header;
+    memset( &header, 0, sizeof(header) );
+    memcpy( header.magic, rectificationMagic, sizeof(header.magic) );
+    header.version = RECTIFICATION_MAP_VERSION;
+    header.headerSize = (uint32_t)sizeof(header);
+    header.width = map1.cols;
+    header.height = map1.rows;
+    header.map1Type = map1.type();
+    header.map2Type = map2.type();
+    header.key = hashParameters( params );
+
+    size_t paramsBytes = params.size() * sizeof(double);
+    size_t map1Bytes = map1.total() * map1.elemSize();
+    size_t map2Bytes = map2.total() * map2.elemSize();
+    header.paramsOffset = sizeof(header);
+    header.paramsCount = params.size();
+    header.map1Offset = header.paramsOffset + paramsBytes;
+    header.map2Offset = header.map1Offset + map1Bytes;
+    header.fileSize = header.map2Offset + map2Bytes;
+
+    // the directory usually exists after the first map, an error shows up in fopen
+    string directory = filename.substr( 0, filename.find_last_of( "/\\" ) );
+#ifdef _WIN32
+    _mkdir( directory.c_str() );
+#else
+    mkdir( directory.c_str(), 0755 );
+#endif
+
+    // written under a temporary name, a tool that starts meanwhile never maps half a file
+    string tempname = filename + ".tmp";
+    FILE* f = fopen( tempname.c_str(), "wb" );
+    if( !f )
+        return false;
+    bool ok = fwrite( &header, sizeof(header), 1, f ) == 1 &&
+              fwrite( params.data(), 1, paramsBytes, f ) == paramsBytes &&
+              fwrite( map1.data, 1, map1Bytes, f ) == map1Bytes &&
+              fwrite( map2.data, 1, map2Bytes, f ) == map2Bytes;
+    ok = fclose( f ) == 0 && ok;
+
+#ifdef _WIN32
+    // the Windows rename fails on an existing target, POSIX replaces it atomically
+    remove( filename.c_str() );
+#endif
+    if( !ok || rename( tempname.c_str(), filename.c_str() ) != 0 )
+    {
+        remove( tempname.c_str() );
+        return false;
+    }
+    return true;
+}
+
+}
@@ -34,13 +34,28 @@
 
 #include <stdafx.h>
 #include "ThreadCamera.h"
+#include "circlesgrid.hpp"
+#include "BatchProcessor.h"
+#include "CalibrationReport.h"
+#include "UndistortionEngine.h"
+#include "AsyncCalibration.h"
+#include "PatternDetector.h"
+#include "BoardPresence.h"
+#include "BoardRoiTracker.h"
+#include "LivePipeline.h"
+#include "FrameQuality.h"
+#include "CalibrationCore.h"
+#include "DetectionCache.h"
+#include "ViewSelector.h"
 
 #undef min
 #undef max
 #include <algorithm>
+#include <chrono>
 
 using namespace cv;
 using namespace std;
+using namespace calibcore;
 
 const char * usage =
 " \nexample command line for calibration from a live feed.\n"
@@ -89,6 +104,7 @@ static void help()
         "                              # (used only for video capturing)\n"
         "     [-s <squareSize>]       # square size in some user-defined units (1 by default)\n"
         "     [-o <out_camera_params>] # the output filename for intrinsic [and extrinsic] parameters\n"
+        "                              # (.yml/.xml, or .calib for the binary container)\n"
         "     [-op]                    # write detected feature points\n"
         "     [-oe]                    # write extrinsic parameters\n"
         "     [-zt]                    # assume zero tangential distortion\n"
@@ -98,6 +114,32 @@ static void help()
         "     [-V]                     # use a video file, and not an image list, uses\n"
         "                              # [input_data] string for the video file name\n"
         "     [-su]                    # show undistorted images after calibration\n"
+        "     [-track]                 # track circle grids between live frames instead of\n"
+        "                              # detecting them from scratch in every frame, chessboards\n"
+        "                              # are searched around the corners of the last frame first\n"
+        "     [-batch]                 # detect the pattern in all images of the image list without\n"
+        "                              # a window, using all cores, and calibrate\n"
+        "     [-j <threads>]           # number of detection threads in batch and live camera mode\n"
+        "                              # (all cores by default)\n"
+        "     [-cache]                 # keep the batch detections in <input_data>.detections.yml and\n"
+        "                              # reuse them for unchanged images and detector settings\n"
+        "     [-ds <pixels>]           # search the pattern on a copy downscaled to this longer side\n"
+        "                              # and refine it at full resolution (for high-resolution input)\n"
+        "     [-mapcache <dir>]        # keep the undistortion maps in this directory and map them\n"
+        "                              # from there when the same calibration comes up again\n"
+        "     [-sharp <variance>]      # only capture boards whose Laplacian variance reaches this\n"
+        "     [-motion <pixels>]       # only capture boards whose corners moved less than this\n"
+        "                              # since the previous frame (live and video input)\n"
+        "     [-headless]              # no window and no drawing, capture right away and write a\n"
+        "                              # summary report next to the output file (image lists use -batch)\n"
+        "     [-inc]                   # update the intrinsics and their uncertainty after every\n"
+        "                              # captured view\n"
+        "     [-robust <rounds>]       # solve again up to this many times without the views and points\n"
+        "                              # that do not fit the previous solution\n"
+        "     [-rt <factor>]           # outlier threshold of -robust, relative to the median view error\n"
+        "                              # and the overall error (3 by default)\n"
+        "     [-select]                # skip views whose board pose repeats an earlier one and stop\n"
+        "                              # once the views cover the image and enough tilt angles\n"
         "     [input_data]             # input data, one of the following:\n"
         "                              #  - text file with a list of the images of the board\n"
         "                              #    the text file can be generated with imagelist_creator\n"
@@ -108,221 +150,228 @@ static void help()
     printf( "\n%s", liveCaptureHelp );
 }
 
-enum { DETECTION = 0, CAPTURING = 1, CALIBRATED = 2 };
-enum Pattern { CHESSBOARD, CIRCLES_GRID, ASYMMETRIC_CIRCLES_GRID };
+enum { DETECTION = 0, CAPTURING = 1, CALIBRATED = 2, CALIBRATING = 3 };
 
-static double computeReprojectionErrors(
-        const vector<vector<Point3f> >& objectPoints,
-        const vector<vector<Point2f> >& imagePoints,
-        const vector<Mat>& rvecs, const vector<Mat>& tvecs,
-        const Mat& cameraMatrix, const Mat& distCoeffs,
-        vector<float>& perViewErrors )
+// running estimate of the intrinsics while views are being captured
+struct IncrementalEstimate
 {
-    vector<Point2f> imagePoints2;
-    int i, totalPoints = 0;
-    double totalErr = 0, err;
-    perViewErrors.resize(objectPoints.size());
+    IncrementalEstimate() : views(0), totalAvgErr(0), seconds(0) {}
 
-    for( i = 0; i < (int)objectPoints.size(); i++ )
-    {
-        projectPoints(Mat(objectPoints[i]), rvecs[i], tvecs[i],
-                      cameraMatrix, distCoeffs, imagePoints2);
-        err = norm(Mat(imagePoints[i]), Mat(imagePoints2), CV_L2);
-        int n = (int)objectPoints[i].size();
-        perViewErrors[i] = (float)std::sqrt(err*err/n);
-        totalErr += err*err;
-        totalPoints += n;
-    }
-
-    return std::sqrt(totalErr/totalPoints);
-}
-
-static void calcChessboardCorners(Size boardSize, float squareSize, vector<Point3f>& corners, Pattern patternType = CHESSBOARD)
+    int views;
+    Mat cameraMatrix, distCoeffs;
+    Mat stdDeviations;      // fx, fy, cx, cy, k1, k2, p1, p2, k3, ...
+    double totalAvgErr;
+    double seconds;         // time of the last update
+};
+
+// Refines the estimate with the views captured so far. The first solve starts
+// from scratch, later ones start from the previous intrinsics, which are
+// already close, so a few iterations are enough.
+static bool updateIncrementalCalibration( const vector<vector<Point2f> >& imagePoints,
+                    Size imageSize, Size boardSize, Pattern patternType,
+                    float squareSize, float aspectRatio, int flags,
+                    IncrementalEstimate& estimate )
 {
-    corners.resize(0);
+    // fewer views leave the focal length and the distortion unconstrained
+    if( imagePoints.size() < 3 )
+        return false;
+
+    int64 start = getTickCount();
 
-    switch(patternType)
+    Mat cameraMatrix, distCoeffs;
+    TermCriteria criteria(TermCriteria::COUNT + TermCriteria::EPS, 30, DBL_EPSILON);
+    if( estimate.cameraMatrix.empty() )
     {
-      case CHESSBOARD:
-      case CIRCLES_GRID:
-        for( int i = 0; i < boardSize.height; i++ )
-            for( int j = 0; j < boardSize.width; j++ )
-                corners.push_back(Point3f(float(j*squareSize),
-                                          float(i*squareSize), 0));
-        break;
-
-      case ASYMMETRIC_CIRCLES_GRID:
-        for( int i = 0; i < boardSize.height; i++ )
-            for( int j = 0; j < boardSize.width; j++ )
-                corners.push_back(Point3f(float((2*j + i % 2)*squareSize),
-                                          float(i*squareSize), 0));
-        break;
-
-      default:
-        CV_Error(CV_StsBadArg, "Unknown pattern type\n");
+        cameraMatrix = Mat::eye(3, 3, CV_64F);
+        if( flags & CV_CALIB_FIX_ASPECT_RATIO )
+            cameraMatrix.at<double>(0,0) = aspectRatio;
+        distCoeffs = Mat::zeros(8, 1, CV_64F);
+    }
+    else
+    {
+        estimate.cameraMatrix.copyTo(cameraMatrix);
+        estimate.distCoeffs.copyTo(distCoeffs);
+        flags |= CV_CALIB_USE_INTRINSIC_GUESS;
+        criteria.maxCount = 10;
     }
-}
-
-static bool runCalibration( vector<vector<Point2f> > imagePoints,
-                    Size imageSize, Size boardSize, Pattern patternType,
-                    float squareSize, float aspectRatio,
-                    int flags, Mat& cameraMatrix, Mat& distCoeffs,
-                    vector<Mat>& rvecs, vector<Mat>& tvecs,
-                    vector<float>& reprojErrs,
-                    double& totalAvgErr)
-{
-    cameraMatrix = Mat::eye(3, 3, CV_64F);
-    if( flags & CV_CALIB_FIX_ASPECT_RATIO )
-        cameraMatrix.at<double>(0,0) = aspectRatio;
-
-    distCoeffs = Mat::zeros(8, 1, CV_64F);
 
     vector<vector<Point3f> > objectPoints(1);
     calcChessboardCorners(boardSize, squareSize, objectPoints[0], patternType);
+    objectPoints.resize(imagePoints.size(), objectPoints[0]);
 
-    objectPoints.resize(imagePoints.size(),objectPoints[0]);
-
-    double rms = calibrateCamera(objectPoints, imagePoints, imageSize, cameraMatrix,
-                    distCoeffs, rvecs, tvecs, flags|CV_CALIB_FIX_K4|CV_CALIB_FIX_K5);
-                    ///*|CV_CALIB_FIX_K3*/|CV_CALIB_FIX_K4|CV_CALIB_FIX_K5);
-    printf("RMS error reported by calibrateCamera: %g\n", rms);
+    vector<Mat> rvecs, tvecs;
+    Mat stdDeviations, stdDeviationsExtrinsics, perViewErrors;
+    calibrateCamera(objectPoints, imagePoints, imageSize, cameraMatrix, distCoeffs,
+                    rvecs, tvecs, stdDeviations, stdDeviationsExtrinsics, perViewErrors,
+                    flags|CV_CALIB_FIX_K4|CV_CALIB_FIX_K5, criteria);
 
-    bool ok = checkRange(cameraMatrix) && checkRange(distCoeffs);
+    if( !checkRange(cameraMatrix) || !checkRange(distCoeffs) )
+    {
+        // a diverged update must not seed the next one
+        estimate = IncrementalEstimate();
+        return false;
+    }
 
-    totalAvgErr = computeReprojectionErrors(objectPoints, imagePoints,
+    vector<float> reprojErrs;
+    estimate.totalAvgErr = computeReprojectionErrors(objectPoints, imagePoints,
                 rvecs, tvecs, cameraMatrix, distCoeffs, reprojErrs);
-
-    return ok;
+    estimate.views = (int)imagePoints.size();
+    estimate.cameraMatrix = cameraMatrix;
+    estimate.distCoeffs = distCoeffs;
+    estimate.stdDeviations = stdDeviations;
+    estimate.seconds = (getTickCount() - start)/getTickFrequency();
+    return true;
 }
 
-
-static void saveCameraParams( const string& filename,
-                       Size imageSize, Size boardSize,
-                       float squareSize, float aspectRatio, int flags,
-                       const Mat& cameraMatrix, const Mat& distCoeffs,
-                       const vector<Mat>& rvecs, const vector<Mat>& tvecs,
-                       const vector<float>& reprojErrs,
-                       const vector<vector<Point2f> >& imagePoints,
-                       double totalAvgErr )
+static string formatIncrementalEstimate( const IncrementalEstimate& estimate )
 {
-    FileStorage fs( filename, FileStorage::WRITE );
-
-    time_t tt;
-    time( &tt );
-    struct tm *t2 = localtime( &tt );
-    char buf[1024];
-    strftime( buf, sizeof(buf)-1, "%c", t2 );
-
-    fs << "calibration_time" << buf;
-
-    if( !rvecs.empty() || !reprojErrs.empty() )
-        fs << "nframes" << (int)std::max(rvecs.size(), reprojErrs.size());
-    fs << "image_width" << imageSize.width;
-    fs << "image_height" << imageSize.height;
-    fs << "board_width" << boardSize.width;
-    fs << "board_height" << boardSize.height;
-    fs << "square_size" << squareSize;
+    const Mat& K = estimate.cameraMatrix;
+    const Mat& s = estimate.stdDeviations;
+    return format( "f %.1f/%.1f +-%.1f/%.1f c %.1f/%.1f +-%.1f/%.1f err %.3f",
+        K.at<double>(0,0), K.at<double>(1,1), s.at<double>(0), s.at<double>(1),
+        K.at<double>(0,2), K.at<double>(1,2), s.at<double>(2), s.at<double>(3),
+        estimate.totalAvgErr );
+}
 
-    if( flags & CV_CALIB_FIX_ASPECT_RATIO )
-        fs << "aspectRatio" << aspectRatio;
 
-    if( flags != 0 )
+// chessboard corners come back refined with cornerSubPix
+static bool detectPattern( const PatternDetector& detector, const Mat& viewGray,
+                           Size boardSize, Pattern pattern, vector<Point2f>& pointbuf )
+{
+    switch( pattern )
     {
-        sprintf( buf, "flags: %s%s%s%s",
-            flags & CV_CALIB_USE_INTRINSIC_GUESS ? "+use_intrinsic_guess" : "",
-            flags & CV_CALIB_FIX_ASPECT_RATIO ? "+fix_aspectRatio" : "",
-            flags & CV_CALIB_FIX_PRINCIPAL_POINT ? "+fix_principal_point" : "",
-            flags & CV_CALIB_ZERO_TANGENT_DIST ? "+zero_tangent_dist" : "" );
-        cvWriteComment( *fs, buf, 0 );
+        case CHESSBOARD:
+            return detector.findChessboard( viewGray, boardSize, pointbuf,
+                CV_CALIB_CB_ADAPTIVE_THRESH | CV_CALIB_CB_FAST_CHECK | CV_CALIB_CB_NORMALIZE_IMAGE);
+        case CIRCLES_GRID:
+            return detector.findCirclesGrid( viewGray, boardSize, pointbuf, CALIB_CB_SYMMETRIC_GRID );
+        case ASYMMETRIC_CIRCLES_GRID:
+            return detector.findCirclesGrid( viewGray, boardSize, pointbuf, CALIB_CB_ASYMMETRIC_GRID );
+        default:
+            return false;
     }
+}
 
-    fs << "flags" << flags;
-
-    fs << "camera_matrix" << cameraMatrix;
-    fs << "distortion_coefficients" << distCoeffs;
+struct ListDetection
+{
+    ListDetection() : found(false), cached(false) {}
+
+    bool found;
+    Size imageSize;
+    vector<Point2f> points;
+
+    string cacheKey;
+    bool cached;
+};
+
+// decodes and searches the pattern in all listed images on a thread pool,
+// imagePoints are collected in list order. Images found in the cache are
+// neither decoded nor searched again.
+static bool detectImageList( const vector<string>& imageList, const PatternDetector& detector,
+                             Size boardSize, Pattern pattern, bool flipVertical, int threads,
+                             DetectionCache* cache,
+                             vector<vector<Point2f> >& imagePoints, Size& imageSize,
+                             CalibrationReport& report )
+{
+    BatchProcessor<ListDetection> batch(threads);
+    printf("Detecting the pattern in %d images using %d threads\n", (int)imageList.size(), batch.threads());
 
-    fs << "avg_reprojection_error" << totalAvgErr;
-    if( !reprojErrs.empty() )
-        fs << "per_view_reprojection_errors" << Mat(reprojErrs);
+    int64 start = getTickCount();
+    int unreadable = 0, notFound = 0, cached = 0;
+    // the workers still look up the cache while the consumer runs, new entries
+    // are only stored once the batch is done
+    vector<pair<string, DetectionCache::Entry> > newEntries;
 
-    if( !rvecs.empty() && !tvecs.empty() )
-    {
-        CV_Assert(rvecs[0].type() == tvecs[0].type());
-        Mat bigmat((int)rvecs.size(), 6, rvecs[0].type());
-        for( int i = 0; i < (int)rvecs.size(); i++ )
+    batch.run(imageList.size(),
+        [&]( size_t index, ListDetection& detection )
         {
-            Mat r = bigmat(Range(i, i+1), Range(0,3));
-            Mat t = bigmat(Range(i, i+1), Range(3,6));
-
-            CV_Assert(rvecs[i].rows == 3 && rvecs[i].cols == 1);
-            CV_Assert(tvecs[i].rows == 3 && tvecs[i].cols == 1);
-            //*.t() is MatExpr (not Mat) so we can use assignment operator
-            r = rvecs[i].t();
-            t = tvecs[i].t();
-        }
-        cvWriteComment( *fs, "a set of 6-tuples (rotation vector + translation vector) for each view", 0 );
-        fs << "extrinsic_parameters" << bigmat;
-    }
-
-    if( !imagePoints.empty() )
-    {
-        Mat imagePtMat((int)imagePoints.size(), (int)imagePoints[0].size(), CV_32FC2);
-        for( int i = 0; i < (int)imagePoints.size(); i++ )
+            vector<uchar> content;
+            if( !DetectionCache::readFile(imageList[index], content) )
+                return;
+
+            DetectionCache::Entry entry;
+            if( cache )
+            {
+                detection.cacheKey = cache->key(content);
+                if( cache->lookup(detection.cacheKey, entry) )
+                {
+                    detection.found = entry.found;
+                    detection.imageSize = entry.imageSize;
+                    detection.points = entry.points;
+                    detection.cached = true;
+                    return;
+                }
+            }
+
+            // nothing is drawn in batch mode, the image is decoded straight to gray
+            Mat viewGray = imdecode(content, IMREAD_GRAYSCALE);
+            if( !viewGray.data )
+                return;
+
+            if( flipVertical )
+                flip( viewGray, viewGray, 0 );
+
+            detection.imageSize = viewGray.size();
+            detection.found = detectPattern( detector, viewGray, boardSize, pattern, detection.points );
+        },
+        [&]( size_t index, ListDetection& detection )
         {
-            Mat r = imagePtMat.row(i).reshape(2, imagePtMat.cols);
-            Mat imgpti(imagePoints[i]);
-            imgpti.copyTo(r);
-        }
-        fs << "image_points" << imagePtMat;
+            if( detection.cached )
+                cached++;
+            else if( cache && detection.imageSize.area() > 0 )
+            {
+                DetectionCache::Entry entry;
+                entry.found = detection.found;
+                entry.imageSize = detection.imageSize;
+                entry.points = detection.points;
+                newEntries.push_back(make_pair(detection.cacheKey, entry));
+            }
+
+            report.framesProcessed++;
+            if( detection.imageSize.area() == 0 )
+            {
+                printf("%s: could not be read\n", imageList[index].c_str());
+                report.framesUnreadable++;
+                unreadable++;
+                return;
+            }
+            if( imageSize.area() == 0 )
+                imageSize = detection.imageSize;
+            else if( imageSize != detection.imageSize )
+            {
+                printf("%s: skipped, image size differs from the first image\n", imageList[index].c_str());
+                return;
+            }
+
+            if( detection.found )
+            {
+                imagePoints.push_back(detection.points);
+                report.framesWithPattern++;
+            }
+            else
+            {
+                printf("%s: pattern not found\n", imageList[index].c_str());
+                notFound++;
+            }
+        });
+
+    double seconds = (getTickCount() - start)/getTickFrequency();
+    printf("Pattern found in %d of %d images (%d not readable, %d without pattern) in %.2f s, %.1f images/s\n",
+        (int)imagePoints.size(), (int)imageList.size(), unreadable, notFound,
+        seconds, seconds > 0 ? imageList.size()/seconds : 0.);
+
+    if( cache )
+    {
+        for( size_t i = 0; i < newEntries.size(); i++ )
+            cache->store(newEntries[i].first, newEntries[i].second);
+        printf("%d detections reused from %s\n", cached, cache->filename().c_str());
+        if( !cache->save() )
+            printf("Could not write the detection cache %s\n", cache->filename().c_str());
     }
-}
 
-static bool readStringList( const string& filename, vector<string>& l )
-{
-    l.resize(0);
-    FileStorage fs(filename, FileStorage::READ);
-    if( !fs.isOpened() )
-        return false;
-    FileNode n = fs.getFirstTopLevelNode();
-    if( n.type() != FileNode::SEQ )
-        return false;
-    FileNodeIterator it = n.begin(), it_end = n.end();
-    for( ; it != it_end; ++it )
-        l.push_back((string)*it);
-    return true;
+    return !imagePoints.empty();
 }
 
-
-static bool runAndSave(const string& outputFilename,
-                const vector<vector<Point2f> >& imagePoints,
-                Size imageSize, Size boardSize, Pattern patternType, float squareSize,
-                float aspectRatio, int flags, Mat& cameraMatrix,
-                Mat& distCoeffs, bool writeExtrinsics, bool writePoints )
-{
-    vector<Mat> rvecs, tvecs;
-    vector<float> reprojErrs;
-    double totalAvgErr = 0;
-
-    bool ok = runCalibration(imagePoints, imageSize, boardSize, patternType, squareSize,
-                   aspectRatio, flags, cameraMatrix, distCoeffs,
-                   rvecs, tvecs, reprojErrs, totalAvgErr);
-    printf("%s. avg reprojection error = %.2f\n",
-           ok ? "Calibration succeeded" : "Calibration failed",
-           totalAvgErr);
-
-    if( ok )
-        saveCameraParams( outputFilename, imageSize,
-                         boardSize, squareSize, aspectRatio,
-                         flags, cameraMatrix, distCoeffs,
-                         writeExtrinsics ? rvecs : vector<Mat>(),
-                         writeExtrinsics ? tvecs : vector<Mat>(),
-                         writeExtrinsics ? reprojErrs : vector<float>(),
-                         writePoints ? imagePoints : vector<vector<Point2f> >(),
-                         totalAvgErr );
-    return ok;
-}
-
-
 int main( int argc, char** argv )
 {
     Size boardSize, imageSize;
@@ -352,6 +401,34 @@ int main( int argc, char** argv )
     Pattern pattern = CHESSBOARD;
 
 	bool useEyeCam = false;
+	bool useTracking = false;
+	CirclesGridTracker *gridTracker = 0;
+	BoardRoiTracker *boardTracker = 0;
+	bool batchMode = false;
+	int batchThreads = 0;
+	bool useCache = false;
+	bool headless = false;
+	double prevVideoTime = 0;
+	CalibrationReport report("singlecamcalibration");
+	UndistortionEngine undistorter;
+	Mat undistortedView;
+	Mat solvedCameraMatrix, solvedDistCoeffs;
+	AsyncCalibration solver;
+	bool incremental = false;
+	int robustRounds = 0;
+	float robustThreshold = 3.f;
+	ViewSelector *viewSelector = 0;
+	bool selectViews = false;
+	IncrementalEstimate estimate;
+	IncrementalEstimate pendingEstimate;
+	bool estimating = false;
+	int estimateViews = 0, restarts = 0, estimateRestart = 0;
+	AsyncCalibration estimator(false);
+	int maxDetectionSize = 0;
+	double minSharpness = 0;
+	double maxMotion = 0;
+	int unsteadyViews = 0;
+	vector<Point2f> prevPointbuf;
 
     if( argc < 2 )
     {
@@ -437,6 +514,64 @@ int main( int argc, char** argv )
         {
             showUndistorted = true;
         }
+        else if( strcmp( s, "-track" ) == 0 )
+        {
+            useTracking = true;
+        }
+        else if( strcmp( s, "-batch" ) == 0 )
+        {
+            batchMode = true;
+        }
+        else if( strcmp( s, "-j" ) == 0 )
+        {
+            if( sscanf( argv[++i], "%d", &batchThreads ) != 1 || batchThreads <= 0 )
+                return fprintf( stderr, "Invalid number of threads\n" ), -1;
+        }
+        else if( strcmp( s, "-cache" ) == 0 )
+        {
+            useCache = true;
+        }
+        else if( strcmp( s, "-ds" ) == 0 )
+        {
+            if( sscanf( argv[++i], "%d", &maxDetectionSize ) != 1 || maxDetectionSize <= 0 )
+                return fprintf( stderr, "Invalid detection size\n" ), -1;
+        }
+        else if( strcmp( s, "-sharp" ) == 0 )
+        {
+            if( sscanf( argv[++i], "%lf", &minSharpness ) != 1 || minSharpness < 0 )
+                return fprintf( stderr, "Invalid sharpness threshold\n" ), -1;
+        }
+        else if( strcmp( s, "-motion" ) == 0 )
+        {
+            if( sscanf( argv[++i], "%lf", &maxMotion ) != 1 || maxMotion < 0 )
+                return fprintf( stderr, "Invalid motion threshold\n" ), -1;
+        }
+        else if( strcmp( s, "-mapcache" ) == 0 )
+        {
+            undistorter.setCacheDirectory( argv[++i] );
+        }
+        else if( strcmp( s, "-headless" ) == 0 )
+        {
+            headless = true;
+        }
+        else if( strcmp( s, "-inc" ) == 0 )
+        {
+            incremental = true;
+        }
+        else if( strcmp( s, "-robust" ) == 0 )
+        {
+            if( sscanf( argv[++i], "%d", &robustRounds ) != 1 || robustRounds < 0 )
+                return fprintf( stderr, "Invalid number of robust rounds\n" ), -1;
+        }
+        else if( strcmp( s, "-rt" ) == 0 )
+        {
+            if( sscanf( argv[++i], "%f", &robustThreshold ) != 1 || robustThreshold <= 1 )
+                return fprintf( stderr, "Invalid outlier threshold\n" ), -1;
+        }
+        else if( strcmp( s, "-select" ) == 0 )
+        {
+            selectViews = true;
+        }
         else if( s[0] != '-' )
         {
             if( isdigit(s[0]) )
@@ -453,6 +588,43 @@ int main( int argc, char** argv )
     }
 
 	bool captureIsOpen = false;
+	PatternDetector patternDetector(maxDetectionSize);
+
+	// an image list has nothing to show without a window, the batch path already runs headless
+	if( headless && inputFilename && !videofile && readStringList(inputFilename, imageList) )
+		batchMode = true;
+
+    if( batchMode )
+    {
+        if( !inputFilename || videofile || !readStringList(inputFilename, imageList) )
+            return fprintf( stderr, "Batch mode requires an image list\n" ), -1;
+
+        DetectionCache *cache = 0;
+        if( useCache )
+        {
+            // everything besides the image content the detections depend on
+            string settings = format("pattern %d board %dx%d flip %d detection size %d",
+                (int)pattern, boardSize.width, boardSize.height, (int)flipVertical, maxDetectionSize);
+            cache = new DetectionCache(string(inputFilename) + ".detections.yml", settings);
+            cache->load();
+        }
+
+        bool ok = detectImageList( imageList, patternDetector, boardSize, pattern, flipVertical,
+                                   batchThreads, cache, imagePoints, imageSize, report );
+        delete cache;
+
+        if( ok )
+            ok = runAndSave(outputFilename, imagePoints, imageSize,
+                            boardSize, pattern, squareSize, aspectRatio,
+                            flags, cameraMatrix, distCoeffs,
+                            writeExtrinsics, writePoints, &report, robustRounds, robustThreshold);
+        else
+            fprintf( stderr, "The pattern was not found in any image\n" );
+
+        if( headless )
+            report.finish(outputFilename);
+        return ok ? 0 : -1;
+    }
 
     if( inputFilename )
     {
@@ -494,7 +666,7 @@ int main( int argc, char** argv )
 	{
 		if (!capture.isOpened() && imageList.empty())
 			return fprintf(stderr, "Could not initialize video (%d) capture\n", cameraId), -2;
-		else
+		else if (!headless)
 			printf("%s", liveCaptureHelp);
 	}
 
@@ -504,14 +676,105 @@ int main( int argc, char** argv )
     if( !imageList.empty() )
         nframes = (int)imageList.size();
 
-    namedWindow( "Image View", 1 );
+	// stored images are unrelated to each other, tracking only pays off on live frames
+	if (useTracking && imageList.empty() && pattern != CHESSBOARD)
+		gridTracker = new CirclesGridTracker(boardSize, pattern == ASYMMETRIC_CIRCLES_GRID);
+	else if (useTracking && imageList.empty())
+		boardTracker = new BoardRoiTracker();
+
+	BoardRoiTracker::Finder findBoard = [&](const Mat& image, vector<Point2f>& corners)
+	{
+		return detectPattern( patternDetector, image, boardSize, pattern, corners );
+	};
+
+	if (selectViews)
+	{
+		vector<Point3f> boardPoints;
+		calcChessboardCorners(boardSize, squareSize, boardPoints, pattern);
+		viewSelector = new ViewSelector(boardPoints);
+	}
+
+	// image lists are searched in full, live and video frames without a board are skipped early
+	BoardPresence presence;
+	bool checkPresence = imageList.empty();
 
+	// flips, converts and searches one frame, on the pipeline workers in live camera mode
+	auto detectView = [&](Mat& view, Mat& gray, vector<Point2f>& pointbuf) -> bool
+	{
+		if( flipVertical )
+			flip( view, view, 0 );
+		cvtColor(view, gray, CV_BGR2GRAY);
+
+		bool found;
+		if( gridTracker && gridTracker->track( gray, pointbuf ) )
+			found = true;
+		// a tracked board is known to be there, the pre-check only guards full searches
+		else if( (!boardTracker || !boardTracker->isTracking()) && checkPresence &&
+				 !presence.check( gray, boardSize, pattern == CHESSBOARD ) )
+			found = false;
+		else if( boardTracker )
+			found = boardTracker->find( gray, pointbuf, findBoard );
+		else
+			found = findBoard( gray, pointbuf );
+
+		// reseed the tracker from every full detection, it keeps its track otherwise
+		if( gridTracker && !gridTracker->isTracking() && found )
+			gridTracker->reset( pointbuf );
+		return found;
+	};
+
+	// a live camera is captured, searched and shown on threads of their own so the
+	// preview does not wait for the detection. The trackers follow the board from
+	// frame to frame and need a single worker that sees the frames in order.
+	LivePipeline *pipeline = 0;
+	if( !headless && !inputFilename )
+	{
+		LivePipeline::Grabber grabber = [&](Mat& view)
+		{
+			if (useEyeCam)
+			{
+				// the driver hands out its latest frame without waiting for a new one
+				std::this_thread::sleep_for(std::chrono::milliseconds(1000 / 60));
+				pseye->receiveFrameCopy(view);
+			}
+			else
+			{
+				// the capture reuses its buffer for the next frame
+				Mat view0;
+				capture >> view0;
+				view0.copyTo(view);
+			}
+			return true;
+		};
+		pipeline = new LivePipeline(grabber, detectView, gridTracker || boardTracker ? 1 : batchThreads);
+	}
+
+    // nobody can press 'g' without a window
+    if( headless )
+        mode = CAPTURING;
+    else
+        namedWindow( "Image View", 1 );
+
+    // the gray buffer keeps its allocation across frames
+    Mat viewGray;
     for(i = 0;;i++)
     {
-        Mat view, viewGray;
+        Mat view;
         bool blink = false;
+        vector<Point2f> pointbuf;
+        bool found = false;
 
-		if (useEyeCam)
+        if( pipeline )
+        {
+            LiveFrame frame;
+            if( pipeline->next( frame ) )
+            {
+                view = frame.view;
+                found = frame.found;
+                pointbuf.swap( frame.points );
+            }
+        }
+		else if (useEyeCam)
 		{
 			Mat view0;
 			pseye->receiveFrameCopy(view0);
@@ -529,51 +792,109 @@ int main( int argc, char** argv )
 
         if(!view.data)
         {
-            if( imagePoints.size() > 0 )
+            // a solve started on the last views is taken over after the loop
+            if( mode != CALIBRATING && imagePoints.size() > 0 )
                 runAndSave(outputFilename, imagePoints, imageSize,
                            boardSize, pattern, squareSize, aspectRatio,
                            flags, cameraMatrix, distCoeffs,
-                           writeExtrinsics, writePoints);
+                           writeExtrinsics, writePoints, &report, robustRounds, robustThreshold);
             break;
         }
 
         imageSize = view.size();
+        report.framesProcessed++;
 
-        if( flipVertical )
-            flip( view, view, 0 );
+        if( !pipeline )
+            found = detectView( view, viewGray, pointbuf );
 
-        vector<Point2f> pointbuf;
-        cvtColor(view, viewGray, CV_BGR2GRAY);
+        if( found )
+            report.framesWithPattern++;
+
+        // without waitKey a video file decodes faster than real time, so the delay
+        // is measured on the video clock to spread the views over the recording
+        bool delayElapsed;
+        if( headless && inputFilename )
+            delayElapsed = capture.get(CAP_PROP_POS_MSEC) - prevVideoTime > delay;
+        else
+            delayElapsed = clock() - prevTimestamp > delay*1e-3*CLOCKS_PER_SEC;
 
-        bool found;
-        switch( pattern )
+        // a blurred board or one that is still moving (mean corner shift since the last
+        // frame, so it has to be found twice in a row) is not captured
+        bool steady = true;
+        if( found && imageList.empty() && (minSharpness > 0 || maxMotion > 0) )
         {
-            case CHESSBOARD:
-                found = findChessboardCorners( view, boardSize, pointbuf,
-                    CV_CALIB_CB_ADAPTIVE_THRESH | CV_CALIB_CB_FAST_CHECK | CV_CALIB_CB_NORMALIZE_IMAGE);
-                break;
-            case CIRCLES_GRID:
-                found = findCirclesGrid( view, boardSize, pointbuf );
-                break;
-            case ASYMMETRIC_CIRCLES_GRID:
-                found = findCirclesGrid( view, boardSize, pointbuf, CALIB_CB_ASYMMETRIC_GRID );
-                break;
-            default:
-                return fprintf( stderr, "Unknown pattern type\n" ), -1;
+            double motion = FrameQuality::cornerMotion( prevPointbuf, pointbuf );
+            steady = (minSharpness <= 0 || FrameQuality::boardSharpness( view, pointbuf ) >= minSharpness) &&
+                     (maxMotion <= 0 || (motion >= 0 && motion <= maxMotion));
         }
+        prevPointbuf = found ? pointbuf : vector<Point2f>();
 
-       // improve the found corners' coordinate accuracy
-        if( pattern == CHESSBOARD && found) cornerSubPix( viewGray, pointbuf, Size(11,11),
-            Size(-1,-1), TermCriteria( CV_TERMCRIT_EPS+CV_TERMCRIT_ITER, 30, 0.1 ));
+        if( mode == CAPTURING && found && (!captureIsOpen || delayElapsed) && !steady )
+            unsteadyViews++;
 
-        if( mode == CAPTURING && found &&
-           (!captureIsOpen || clock() - prevTimestamp > delay*1e-3*CLOCKS_PER_SEC) )
+        // the pose is only checked for views that would be captured otherwise, with the
+        // incremental estimate as intrinsics when there is one
+        if( mode == CAPTURING && found && steady && (!captureIsOpen || delayElapsed) &&
+            (!viewSelector || viewSelector->consider(pointbuf, imageSize, estimate.cameraMatrix, estimate.distCoeffs)) )
         {
             imagePoints.push_back(pointbuf);
             prevTimestamp = clock();
+            if( headless && inputFilename )
+                prevVideoTime = capture.get(CAP_PROP_POS_MSEC);
             blink = captureIsOpen;
         }
 
+        // the estimate is updated next to this loop, like the final solve. An update covers
+        // the views captured when it starts, the next one starts once it was taken over.
+        bool updated;
+        if( estimating && estimator.finished(updated) )
+        {
+            estimating = false;
+            // an update started before 'g' restarted the capture belongs to the old views
+            if( estimateRestart == restarts )
+            {
+                if( updated )
+                {
+                    estimate = pendingEstimate;
+                    printf( "%d views: %s (%.0f ms)\n", estimate.views,
+                            formatIncrementalEstimate(estimate).c_str(), estimate.seconds*1000 );
+                }
+                else    // a diverged update must not seed the next one
+                    estimate = IncrementalEstimate();
+            }
+        }
+        if( incremental && mode == CAPTURING && !estimating &&
+            imagePoints.size() >= 3 && (int)imagePoints.size() > estimateViews )
+        {
+            vector<vector<Point2f> > estimatePoints = imagePoints;
+            Size estimateSize = imageSize;
+            pendingEstimate = estimate;
+            estimator.start([=, &pendingEstimate]()
+                {
+                    return updateIncrementalCalibration(estimatePoints, estimateSize, boardSize, pattern,
+                                                        squareSize, aspectRatio, flags, pendingEstimate);
+                }, (int)estimatePoints.size());
+            estimating = true;
+            estimateViews = (int)estimatePoints.size();
+            estimateRestart = restarts;
+        }
+
+        bool enoughViews = imagePoints.size() >= (unsigned)nframes ||
+                           (viewSelector && viewSelector->complete());
+
+        if( headless )
+        {
+            if( enoughViews )
+            {
+                runAndSave(outputFilename, imagePoints, imageSize,
+                           boardSize, pattern, squareSize, aspectRatio,
+                           flags, cameraMatrix, distCoeffs,
+                           writeExtrinsics, writePoints, &report, robustRounds, robustThreshold);
+                break;
+            }
+            continue;
+        }
+
         if(found)
             drawChessboardCorners( view, boardSize, Mat(pointbuf), found );
 
@@ -589,36 +910,36 @@ int main( int argc, char** argv )
                 msg = format( "%d/%d Undist", (int)imagePoints.size(), nframes );
             else
                 msg = format( "%d/%d", (int)imagePoints.size(), nframes );
+            if( viewSelector )
+                msg += " " + viewSelector->status();
         }
+        else if( mode == CALIBRATING )
+            msg = solver.progress();
 
         putText( view, msg, textOrigin, 1, 1,
                  mode != CALIBRATED ? Scalar(0,0,255) : Scalar(0,255,0));
 
+        if( mode == CAPTURING && !steady )
+            putText( view, "Hold still", Point(10, view.rows - 20), 1, 1, Scalar(0,0,255));
+
+        if( mode == CAPTURING && estimate.views > 0 )
+            putText( view, formatIncrementalEstimate(estimate), Point(10, 20),
+                     1, 1, Scalar(0,255,255));
+
         if( blink )
             bitwise_not(view, view);
 
-        if( mode == CALIBRATED && undistortImage )
+        // the maps are only rebuilt when a new calibration result comes in
+        if( mode == CALIBRATED && undistortImage &&
+            undistorter.update(cameraMatrix, distCoeffs, imageSize) )
         {
-            Mat temp = view.clone();
-            //undistort(temp, view, cameraMatrix, distCoeffs);
-
-			Mat map1, map2;
-			
-			initUndistortRectifyMap(cameraMatrix, distCoeffs, Mat(), getOptimalNewCameraMatrix(cameraMatrix, distCoeffs, imageSize, 0.0), imageSize, CV_16SC2, map1, map2);
-			//remap(temp, view, map1, map2, INTER_LINEAR);
-			undistort(temp, view, cameraMatrix, distCoeffs, getOptimalNewCameraMatrix(cameraMatrix, distCoeffs, imageSize, 1.0));
-
-
-			//Mat newCamMat;
-			//fisheye::estimateNewCameraMatrixForUndistortRectify(cameraMatrix, distCoeffs, imageSize, Matx33d::eye(), newCamMat, 0);
-			//fisheye::initUndistortRectifyMap(cameraMatrix, distCoeffs, Matx33d::eye(), newCamMat, imageSize, CV_16SC2, map1, map2);
-
-			//fisheye::undistortImage(temp, view, cameraMatrix, distCoeffs);
-
+            undistorter.apply(view, undistortedView);
+            view = undistortedView;
         }
 
         imshow("Image View", view);
-        int key = 0xff & waitKey(captureIsOpen ? 50 : 500);
+        // the pipeline already paces the loop to the detected frames
+        int key = 0xff & waitKey(pipeline ? 1 : captureIsOpen ? 50 : 500);
 
         if( (key & 255) == 27 )
             break;
@@ -626,19 +947,45 @@ int main( int argc, char** argv )
         if( key == 'u' && mode == CALIBRATED )
             undistortImage = !undistortImage;
 
-        if(captureIsOpen && key == 'g' )
+        // like the synchronous solve did, 'g' waits until the running solve is taken over
+        if( captureIsOpen && key == 'g' && mode != CALIBRATING )
         {
             mode = CAPTURING;
             imagePoints.clear();
+            estimate = IncrementalEstimate();
+            estimateViews = 0;
+            restarts++;
+            if( viewSelector )
+                viewSelector->reset();
+            enoughViews = false;
+        }
+
+        // the solve runs next to this loop, which keeps showing and detecting frames
+        // until the new intrinsics are swapped in
+        if( mode == CAPTURING && enoughViews && !solver.isRunning() )
+        {
+            vector<vector<Point2f> > solvePoints = imagePoints;
+            Size solveSize = imageSize;
+            solver.start([=, &solvedCameraMatrix, &solvedDistCoeffs, &report]()
+                {
+                    return runAndSave(outputFilename, solvePoints, solveSize,
+                               boardSize, pattern, squareSize, aspectRatio,
+                               flags, solvedCameraMatrix, solvedDistCoeffs,
+                               writeExtrinsics, writePoints, &report, robustRounds, robustThreshold);
+                }, (int)solvePoints.size());
+            mode = CALIBRATING;
         }
 
-        if( mode == CAPTURING && imagePoints.size() >= (unsigned)nframes )
+        // mode stays CALIBRATING until the finished solve is taken over
+        bool solved;
+        if( solver.finished(solved) && mode == CALIBRATING )
         {
-            if( runAndSave(outputFilename, imagePoints, imageSize,
-                       boardSize, pattern, squareSize, aspectRatio,
-                       flags, cameraMatrix, distCoeffs,
-                       writeExtrinsics, writePoints))
+            if( solved )
+            {
+                solvedCameraMatrix.copyTo(cameraMatrix);
+                solvedDistCoeffs.copyTo(distCoeffs);
                 mode = CALIBRATED;
+            }
             else
                 mode = DETECTION;
             if( !captureIsOpen)
@@ -646,33 +993,39 @@ int main( int argc, char** argv )
         }
     }
 
-    if( !captureIsOpen && showUndistorted )
+    // a solve that is still running when the loop ends (end of the image list or
+    // ESC) is waited for, its results are taken over instead of solving again
+    if( mode == CALIBRATING )
     {
-        Mat view, rview, map1, map2;
-        //initUndistortRectifyMap(cameraMatrix, distCoeffs, Mat(),
-        //                        getOptimalNewCameraMatrix(cameraMatrix, distCoeffs, imageSize, 1.0, imageSize, 0),
-        //                        imageSize, CV_16SC2, map1, map2);
+        solver.wait();
+        bool solved;
+        if( solver.finished(solved) && solved )
+        {
+            solvedCameraMatrix.copyTo(cameraMatrix);
+            solvedDistCoeffs.copyTo(distCoeffs);
+            mode = CALIBRATED;
+        }
+    }
 
-		Mat newCamMat;
-		fisheye::estimateNewCameraMatrixForUndistortRectify(cameraMatrix, distCoeffs, imageSize, Matx33d::eye(), newCamMat, 0);
-		fisheye::initUndistortRectifyMap(cameraMatrix, distCoeffs, Matx33d::eye(), newCamMat, imageSize, CV_16SC2, map1, map2);
+    // stops the capture and detection threads before the camera goes away
+    if( pipeline )
+    {
+        printf( "Live pipeline: %d detection threads, %d frames dropped\n",
+                pipeline->threads(), (int)pipeline->framesDropped() );
+        delete pipeline;
+    }
 
+    if( !captureIsOpen && showUndistorted && !headless )
+    {
+        Mat view, rview;
 
         for( i = 0; i < (int)imageList.size(); i++ )
         {
             view = imread(imageList[i], 1);
-            if(!view.data)
+            if( !view.data || !undistorter.update(cameraMatrix, distCoeffs, view.size()) )
                 continue;
-            
-			//undistort( view, rview, cameraMatrix, distCoeffs, cameraMatrix );
-            
-			
-
-			//remap(view, rview, map1, map2, INTER_LINEAR);
 
-			fisheye::undistortImage(view, rview, cameraMatrix, distCoeffs);
-
-			//remap(view, rview, map1, map2, INTER_LINEAR);
+            undistorter.apply(view, rview);
 
             imshow("Image View", rview);
             int c = 0xff & waitKey();
@@ -687,6 +1040,38 @@ int main( int argc, char** argv )
 		delete pseye;
 	}
 
+	if (gridTracker)
+	{
+		printf("Circle grid tracked in %d frames, lost %d times\n",
+			(int)gridTracker->getTrackedFrames(), (int)gridTracker->getLostCount());
+		delete gridTracker;
+	}
+
+	if (minSharpness > 0 || maxMotion > 0)
+		printf("Views rejected as blurred or moving: %d\n", unsteadyViews);
+
+	if (boardTracker)
+	{
+		printf("Chessboard found in its region in %d frames, full searches %d, lost %d times\n",
+			(int)boardTracker->roiFrames(), (int)boardTracker->fullFrames(), (int)boardTracker->lostCount());
+		delete boardTracker;
+	}
+
+	if (viewSelector)
+	{
+		printf("Views kept by the selector: %d (%s)\n", viewSelector->views(), viewSelector->status().c_str());
+		delete viewSelector;
+	}
+
+	if( checkPresence )
+	{
+		printf( "Board pre-check skipped %d of %d frames\n", presence.framesSkipped(), presence.framesChecked() );
+		report.framesSkipped = presence.framesSkipped();
+	}
+
+	if (headless)
+		report.finish(outputFilename);
+
     return 0;
 }
 
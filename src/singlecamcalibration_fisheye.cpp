@@ -32,6 +32,12 @@
 
 #include <stdafx.h>
 #include "CameraPS3Eye.h"
+#include "CalibrationReport.h"
+#include "UndistortionEngine.h"
+#include "AsyncCalibration.h"
+#include "PatternDetector.h"
+#include "BoardPresence.h"
+#include "CalibrationCore.h"
 
 using namespace cv;
 using namespace std;
@@ -98,6 +104,10 @@ static void help()
         "     [-V]                     # use a video file, and not an image list, uses\n"
         "                              # [input_data] string for the video file name\n"
         "     [-su]                    # show undistorted images after calibration\n"
+        "     [-ds <pixels>]           # search the pattern on a copy downscaled to this longer side\n"
+        "                              # and refine it at full resolution (for high-resolution input)\n"
+        "     [-headless]              # no window and no drawing, capture right away and write a\n"
+        "                              # summary report next to the output file\n"
         "     [input_data]             # input data, one of the following:\n"
         "                              #  - text file with a list of the images of the board\n"
         "                              #    the text file can be generated with imagelist_creator\n"
@@ -108,8 +118,16 @@ static void help()
     printf( "\n%s", liveCaptureHelp );
 }
 
-enum { DETECTION = 0, CAPTURING = 1, CALIBRATED = 2 };
-enum Pattern { CHESSBOARD, CIRCLES_GRID, ASYMMETRIC_CIRCLES_GRID };
+enum { DETECTION = 0, CAPTURING = 1, CALIBRATED = 2, CALIBRATING = 3 };
+
+// the fisheye model has its own solve and calibration file, only the board
+// geometry and the image list come from the core
+using calibcore::Pattern;
+using calibcore::CHESSBOARD;
+using calibcore::CIRCLES_GRID;
+using calibcore::ASYMMETRIC_CIRCLES_GRID;
+using calibcore::calcChessboardCorners;
+using calibcore::readStringList;
 
 static double computeReprojectionErrors(
         const vector<vector<Point3f> >& objectPoints,
@@ -118,57 +136,16 @@ static double computeReprojectionErrors(
         const Mat& cameraMatrix, const Mat& distCoeffs,
         vector<float>& perViewErrors )
 {
-    vector<Point2f> imagePoints2;
-    int i, totalPoints = 0;
-    double totalErr = 0, err;
-    perViewErrors.resize(objectPoints.size());
-
-    for( i = 0; i < (int)objectPoints.size(); i++ )
-    {
-
 #ifdef PINHOLE
-        projectPoints(Mat(objectPoints[i]), rvecs[i], tvecs[i], cameraMatrix, distCoeffs, imagePoints2);
+    bool fisheyeModel = false;
 #endif
 
 #ifdef FISHEYE
-		fisheye::projectPoints(Mat(objectPoints[i]), imagePoints2, rvecs[i], tvecs[i], cameraMatrix, distCoeffs);
+    bool fisheyeModel = true;
 #endif
 
-        err = norm(Mat(imagePoints[i]), Mat(imagePoints2), CV_L2);
-
-        int n = (int)objectPoints[i].size();
-        perViewErrors[i] = (float)std::sqrt(err*err/n);
-        totalErr += err*err;
-        totalPoints += n;
-    }
-
-    return std::sqrt(totalErr/totalPoints);
-}
-
-static void calcChessboardCorners(Size boardSize, float squareSize, vector<Point3f>& corners, Pattern patternType = CHESSBOARD)
-{
-    corners.resize(0);
-
-    switch(patternType)
-    {
-      case CHESSBOARD:
-      case CIRCLES_GRID:
-        for( int i = 0; i < boardSize.height; i++ )
-            for( int j = 0; j < boardSize.width; j++ )
-                corners.push_back(Point3f(float(j*squareSize),
-                                          float(i*squareSize), 0));
-        break;
-
-      case ASYMMETRIC_CIRCLES_GRID:
-        for( int i = 0; i < boardSize.height; i++ )
-            for( int j = 0; j < boardSize.width; j++ )
-                corners.push_back(Point3f(float((2*j + i % 2)*squareSize),
-                                          float(i*squareSize), 0));
-        break;
-
-      default:
-        CV_Error(CV_StsBadArg, "Unknown pattern type\n");
-    }
+    return calibcore::computeReprojectionErrors(objectPoints, imagePoints, rvecs, tvecs,
+                                                cameraMatrix, distCoeffs, perViewErrors, fisheyeModel);
 }
 
 static bool runCalibration( vector<vector<Point2f> > imagePoints,
@@ -350,35 +327,26 @@ static void saveCameraParams( const string& filename,
     }
 }
 
-static bool readStringList( const string& filename, vector<string>& l )
-{
-    l.resize(0);
-    FileStorage fs(filename, FileStorage::READ);
-    if( !fs.isOpened() )
-        return false;
-    FileNode n = fs.getFirstTopLevelNode();
-    if( n.type() != FileNode::SEQ )
-        return false;
-    FileNodeIterator it = n.begin(), it_end = n.end();
-    for( ; it != it_end; ++it )
-        l.push_back((string)*it);
-    return true;
-}
-
-
 static bool runAndSave(const string& outputFilename,
                 const vector<vector<Point2f> >& imagePoints,
                 Size imageSize, Size boardSize, Pattern patternType, float squareSize,
                 float aspectRatio, int flags, Mat& cameraMatrix,
-                Mat& distCoeffs, bool writeExtrinsics, bool writePoints )
+                Mat& distCoeffs, bool writeExtrinsics, bool writePoints,
+                CalibrationReport* report = 0 )
 {
     vector<Mat> rvecs, tvecs;
     vector<float> reprojErrs;
     double totalAvgErr = 0;
 
+    int64 start = getTickCount();
     bool ok = runCalibration(imagePoints, imageSize, boardSize, patternType, squareSize,
                    aspectRatio, flags, cameraMatrix, distCoeffs,
                    rvecs, tvecs, reprojErrs, totalAvgErr);
+    if( report )
+    {
+        report->framesUsed = (int)imagePoints.size();
+        report->setCalibration(ok, totalAvgErr, (getTickCount() - start)/getTickFrequency());
+    }
     printf("%s. avg reprojection error = %.2f\n",
            ok ? "Calibration succeeded" : "Calibration failed",
            totalAvgErr);
@@ -425,6 +393,19 @@ int main( int argc, char** argv )
     Pattern pattern = CHESSBOARD;
 
 	bool useEyeCam = false;
+	bool headless = false;
+	int maxDetectionSize = 0;
+	double prevVideoTime = 0;
+	CalibrationReport report("singlecamcalibration_fisheye");
+	Mat undistortedView;
+	Mat solvedCameraMatrix, solvedDistCoeffs;
+	AsyncCalibration solver;
+#ifdef PINHOLE
+	UndistortionEngine undistorter(UndistortionEngine::PINHOLE_MODEL, -1);
+#endif
+#ifdef FISHEYE
+	UndistortionEngine undistorter(UndistortionEngine::FISHEYE_MODEL, 1);
+#endif
 
     if( argc < 2 )
     {
@@ -538,6 +519,15 @@ int main( int argc, char** argv )
         {
             showUndistorted = true;
         }
+        else if( strcmp( s, "-ds" ) == 0 )
+        {
+            if( sscanf( argv[++i], "%d", &maxDetectionSize ) != 1 || maxDetectionSize <= 0 )
+                return fprintf( stderr, "Invalid detection size\n" ), -1;
+        }
+        else if( strcmp( s, "-headless" ) == 0 )
+        {
+            headless = true;
+        }
         else if( s[0] != '-' )
         {
             if( isdigit(s[0]) )
@@ -554,6 +544,7 @@ int main( int argc, char** argv )
     }
 
 	bool captureIsOpen = false;
+	PatternDetector patternDetector(maxDetectionSize);
 
     if( inputFilename )
     {
@@ -585,7 +576,7 @@ int main( int argc, char** argv )
 	{
 		if (!capture.isOpened() && imageList.empty())
 			return fprintf(stderr, "Could not initialize video (%d) capture\n", cameraId), -2;
-		else
+		else if (!headless)
 			printf("%s", liveCaptureHelp);
 	}
 
@@ -595,11 +586,21 @@ int main( int argc, char** argv )
     if( !imageList.empty() )
         nframes = (int)imageList.size();
 
-    namedWindow( "Image View", 1 );
+    // image lists are searched in full, live and video frames without a board are skipped early
+    BoardPresence presence;
+    bool checkPresence = imageList.empty();
+
+    // nobody can press 'g' without a window
+    if( headless )
+        mode = CAPTURING;
+    else
+        namedWindow( "Image View", 1 );
 
+    // the gray buffer keeps its allocation across frames
+    Mat viewGray;
     for(i = 0;;i++)
     {
-        Mat view, viewGray;
+        Mat view;
         bool blink = false;
 
 		if (useEyeCam)
@@ -620,22 +621,33 @@ int main( int argc, char** argv )
             view0.copyTo(view);
         }
         else if( i < (int)imageList.size() )
+        {
             view = imread(imageList[i], 1);
+            if( !view.data && headless )
+            {
+                printf("%s: could not be read\n", imageList[i].c_str());
+                report.framesProcessed++;
+                report.framesUnreadable++;
+                continue;
+            }
+        }
 
 
 
 		//-----  If no more image, or got enough, then stop calibration and show result -------------
         if(!view.data)
         {
-            if( imagePoints.size() > 0 )
+            // a solve started on the last views is taken over after the loop
+            if( mode != CALIBRATING && imagePoints.size() > 0 )
                 runAndSave(outputFilename, imagePoints, imageSize,
                            boardSize, pattern, squareSize, aspectRatio,
                            flags, cameraMatrix, distCoeffs,
-                           writeExtrinsics, writePoints);
+                           writeExtrinsics, writePoints, &report);
             break;
         }
 
         imageSize = view.size();
+        report.framesProcessed++;
 
         if( flipVertical )
             flip( view, view, 0 );
@@ -643,40 +655,67 @@ int main( int argc, char** argv )
         vector<Point2f> pointbuf;
         cvtColor(view, viewGray, CV_BGR2GRAY);
 
-        bool found;
-        switch( pattern )
+        bool found = false;
+        // frames without anything board-like skip the full detector
+        if( !checkPresence || presence.check( viewGray, boardSize, pattern == CHESSBOARD ) )
         {
-            case CHESSBOARD:
-                found = findChessboardCorners( view, boardSize, pointbuf,
+            switch( pattern )
+            {
+                case CHESSBOARD:
+                    found = patternDetector.findChessboard( viewGray, boardSize, pointbuf,
 #ifdef PINHOLE
-                    CV_CALIB_CB_ADAPTIVE_THRESH | CV_CALIB_CB_FAST_CHECK | CV_CALIB_CB_NORMALIZE_IMAGE);
+                        CV_CALIB_CB_ADAPTIVE_THRESH | CV_CALIB_CB_FAST_CHECK | CV_CALIB_CB_NORMALIZE_IMAGE);
 #endif
 #ifdef FISHEYE
-					CV_CALIB_CB_ADAPTIVE_THRESH | CV_CALIB_CB_NORMALIZE_IMAGE);
+						CV_CALIB_CB_ADAPTIVE_THRESH | CV_CALIB_CB_NORMALIZE_IMAGE);
 #endif
-                break;
-            case CIRCLES_GRID:
-                found = findCirclesGrid( view, boardSize, pointbuf );
-                break;
-            case ASYMMETRIC_CIRCLES_GRID:
-                found = findCirclesGrid( view, boardSize, pointbuf, CALIB_CB_ASYMMETRIC_GRID );
-                break;
-            default:
-                return fprintf( stderr, "Unknown pattern type\n" ), -1;
+                    break;
+                case CIRCLES_GRID:
+                    found = patternDetector.findCirclesGrid( viewGray, boardSize, pointbuf, CALIB_CB_SYMMETRIC_GRID );
+                    break;
+                case ASYMMETRIC_CIRCLES_GRID:
+                    found = patternDetector.findCirclesGrid( viewGray, boardSize, pointbuf, CALIB_CB_ASYMMETRIC_GRID );
+                    break;
+                default:
+                    return fprintf( stderr, "Unknown pattern type\n" ), -1;
+            }
         }
 
-       // improve the found corners' coordinate accuracy
-        if( pattern == CHESSBOARD && found) cornerSubPix( viewGray, pointbuf, Size(11,11),
-            Size(-1,-1), TermCriteria( CV_TERMCRIT_EPS+CV_TERMCRIT_ITER, 30, 0.1 ));
+        if( found )
+            report.framesWithPattern++;
+
+        // without waitKey the delay only makes sense for a live camera: every listed
+        // image is used and a video file is spread over its own clock
+        bool delayElapsed;
+        if( headless && !imageList.empty() )
+            delayElapsed = true;
+        else if( headless && inputFilename )
+            delayElapsed = capture.get(CAP_PROP_POS_MSEC) - prevVideoTime > delay;
+        else
+            delayElapsed = clock() - prevTimestamp > delay*1e-3*CLOCKS_PER_SEC;
 
-        if( mode == CAPTURING && found &&
-           (!captureIsOpen || clock() - prevTimestamp > delay*1e-3*CLOCKS_PER_SEC) )
+        if( mode == CAPTURING && found && (!captureIsOpen || delayElapsed) )
         {
             imagePoints.push_back(pointbuf);
             prevTimestamp = clock();
+            if( headless && inputFilename && imageList.empty() )
+                prevVideoTime = capture.get(CAP_PROP_POS_MSEC);
             blink = captureIsOpen;
         }
 
+        if( headless )
+        {
+            if( imagePoints.size() >= (unsigned)nframes )
+            {
+                runAndSave(outputFilename, imagePoints, imageSize,
+                           boardSize, pattern, squareSize, aspectRatio,
+                           flags, cameraMatrix, distCoeffs,
+                           writeExtrinsics, writePoints, &report);
+                break;
+            }
+            continue;
+        }
+
         if(found)
             drawChessboardCorners( view, boardSize, Mat(pointbuf), found );
 
@@ -694,6 +733,8 @@ int main( int argc, char** argv )
             else
                 msg = format( "%d/%d", (int)imagePoints.size(), nframes );
         }
+        else if( mode == CALIBRATING )
+            msg = solver.progress();
 
         putText( view, msg, textOrigin, 1, 1,
                  mode != CALIBRATED ? Scalar(0,0,255) : Scalar(0,255,0));
@@ -702,15 +743,11 @@ int main( int argc, char** argv )
             bitwise_not(view, view);
 
 		//------------------------- Video capture  output  undistorted ------------------------------
-        if( mode == CALIBRATED && undistortImage )
+        if( mode == CALIBRATED && undistortImage &&
+            undistorter.update(cameraMatrix, distCoeffs, imageSize) )
         {
-            Mat temp = view.clone();
-#ifdef PINHOLE
-            undistort(temp, view, cameraMatrix, distCoeffs);
-#endif
-#ifdef FISHEYE
-			undistort(temp, view, cameraMatrix, distCoeffs);
-#endif
+            undistorter.apply(view, undistortedView);
+            view = undistortedView;
         }
 		//------------------------------ Show image and check for input commands -------------------
         imshow("Image View", view);
@@ -722,19 +759,39 @@ int main( int argc, char** argv )
         if( key == 'u' && mode == CALIBRATED )
             undistortImage = !undistortImage;
 
-        if(captureIsOpen && key == 'g' )
+        // like the synchronous solve did, 'g' waits until the running solve is taken over
+        if( captureIsOpen && key == 'g' && mode != CALIBRATING )
         {
             mode = CAPTURING;
             imagePoints.clear();
         }
 
-        if( mode == CAPTURING && imagePoints.size() >= (unsigned)nframes )
+        // the solve runs next to this loop, which keeps showing and detecting frames
+        // until the new intrinsics are swapped in
+        if( mode == CAPTURING && imagePoints.size() >= (unsigned)nframes && !solver.isRunning() )
         {
-            if( runAndSave(outputFilename, imagePoints, imageSize,
-                       boardSize, pattern, squareSize, aspectRatio,
-                       flags, cameraMatrix, distCoeffs,
-                       writeExtrinsics, writePoints))
+            vector<vector<Point2f> > solvePoints = imagePoints;
+            Size solveSize = imageSize;
+            solver.start([=, &solvedCameraMatrix, &solvedDistCoeffs, &report]()
+                {
+                    return runAndSave(outputFilename, solvePoints, solveSize,
+                               boardSize, pattern, squareSize, aspectRatio,
+                               flags, solvedCameraMatrix, solvedDistCoeffs,
+                               writeExtrinsics, writePoints, &report);
+                }, (int)solvePoints.size());
+            mode = CALIBRATING;
+        }
+
+        // mode stays CALIBRATING until the finished solve is taken over
+        bool solved;
+        if( solver.finished(solved) && mode == CALIBRATING )
+        {
+            if( solved )
+            {
+                solvedCameraMatrix.copyTo(cameraMatrix);
+                solvedDistCoeffs.copyTo(distCoeffs);
                 mode = CALIBRATED;
+            }
             else
                 mode = DETECTION;
             if( !captureIsOpen)
@@ -742,38 +799,32 @@ int main( int argc, char** argv )
         }
     }
 
-	// -----------------------Show the undistorted image for the image list ------------------------
-    if( !captureIsOpen && showUndistorted )
+    // a solve that is still running when the loop ends (end of the image list or
+    // ESC) is waited for, its results are taken over instead of solving again
+    if( mode == CALIBRATING )
     {
-        Mat view, rview, map1, map2;
-
-#ifdef PINHOLE
-        initUndistortRectifyMap(cameraMatrix, distCoeffs, Mat(),
-                                getOptimalNewCameraMatrix(cameraMatrix, distCoeffs, imageSize, 1, imageSize, 0),
-                                imageSize, CV_16SC2, map1, map2);
-#endif
-
-#ifdef FISHEYE
-
-		Mat newCamMat;
-		fisheye::estimateNewCameraMatrixForUndistortRectify(cameraMatrix, distCoeffs, imageSize, Matx33d::eye(), newCamMat, 1);
-		fisheye::initUndistortRectifyMap(cameraMatrix, distCoeffs, Matx33d::eye(), newCamMat, imageSize, CV_16SC2, map1, map2);
+        solver.wait();
+        bool solved;
+        if( solver.finished(solved) && solved )
+        {
+            solvedCameraMatrix.copyTo(cameraMatrix);
+            solvedDistCoeffs.copyTo(distCoeffs);
+            mode = CALIBRATED;
+        }
+    }
 
-#endif
+	// -----------------------Show the undistorted image for the image list ------------------------
+    if( !captureIsOpen && showUndistorted && !headless )
+    {
+        Mat view, rview;
 
         for( i = 0; i < (int)imageList.size(); i++ )
         {
             view = imread(imageList[i], 1);
-            if(!view.data)
+            if( !view.data || !undistorter.update(cameraMatrix, distCoeffs, view.size()) )
                 continue;
 
-#ifdef PINHOLE
-            undistort( view, rview, cameraMatrix, distCoeffs, cameraMatrix );
-            //remap(view, rview, map1, map2, INTER_LINEAR);
-#endif
-#ifdef FISHEYE
-			remap(view, rview, map1, map2, INTER_LINEAR);
-#endif
+            undistorter.apply(view, rview);
 
             imshow("Image View", rview);
             int c = 0xff & waitKey();
@@ -788,5 +839,14 @@ int main( int argc, char** argv )
 		delete pseye;
 	}
 
+	if( checkPresence )
+	{
+		printf( "Board pre-check skipped %d of %d frames\n", presence.framesSkipped(), presence.framesChecked() );
+		report.framesSkipped = presence.framesSkipped();
+	}
+
+	if (headless)
+		report.finish(outputFilename);
+
     return 0;
 }
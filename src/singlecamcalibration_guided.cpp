@@ -37,9 +37,14 @@
 #include <stdafx.h>
 #include "ThreadCamera.h"
 #include "circlesgrid.hpp"
+#include "UndistortionEngine.h"
+#include "AsyncCalibration.h"
+#include "PatternDetector.h"
+#include "CalibrationCore.h"
 
 using namespace cv;
 using namespace std;
+using namespace calibcore;
 
 const char * usage =
 " \nexample command line for calibration from a live feed.\n"
@@ -94,6 +99,11 @@ static void help()
         "     [-V]                     # use a video file, and not an image list, uses\n"
         "                              # [input_data] string for the video file name\n"
         "     [-su]                    # show undistorted images after calibration\n"
+        "     [-track]                 # track circle grids between live frames instead of\n"
+        "                              # detecting them from scratch in every frame\n"
+        "     [-trace]                 # print the stages of every custom circle grid detection\n"
+        "     [-ds <pixels>]           # search chessboards and symmetric circle grids on a copy downscaled\n"
+        "                              # to this longer side and refine them at full resolution\n"
         "     [input_data]             # input data, one of the following:\n"
         "                              #  - text file with a list of the images of the board\n"
         "                              #    the text file can be generated with imagelist_creator\n"
@@ -104,223 +114,15 @@ static void help()
     printf( "\n%s", liveCaptureHelp );
 }
 
-enum { DETECTION = 0, CAPTURING = 1, CALIBRATED = 2 };
-enum Pattern { CHESSBOARD, CIRCLES_GRID, ASYMMETRIC_CIRCLES_GRID };
+enum { DETECTION = 0, CAPTURING = 1, CALIBRATED = 2, CALIBRATING = 3 };
 
 Ptr<SimpleBlobDetector> blobDetector;
 SimpleBlobDetector::Params blobParams;
 
-static double computeReprojectionErrors(
-        const vector<vector<Point3f> >& objectPoints,
-        const vector<vector<Point2f> >& imagePoints,
-        const vector<Mat>& rvecs, const vector<Mat>& tvecs,
-        const Mat& cameraMatrix, const Mat& distCoeffs,
-        vector<float>& perViewErrors )
-{
-    vector<Point2f> imagePoints2;
-    int i, totalPoints = 0;
-    double totalErr = 0, err;
-    perViewErrors.resize(objectPoints.size());
-
-    for( i = 0; i < (int)objectPoints.size(); i++ )
-    {
-        projectPoints(Mat(objectPoints[i]), rvecs[i], tvecs[i],
-                      cameraMatrix, distCoeffs, imagePoints2);
-        err = norm(Mat(imagePoints[i]), Mat(imagePoints2), CV_L2);
-        int n = (int)objectPoints[i].size();
-        perViewErrors[i] = (float)std::sqrt(err*err/n);
-        totalErr += err*err;
-        totalPoints += n;
-    }
-
-    return std::sqrt(totalErr/totalPoints);
-}
-
-static void calcChessboardCorners(Size boardSize, float squareSize, vector<Point3f>& corners, Pattern patternType = CHESSBOARD)
-{
-    corners.resize(0);
-
-    switch(patternType)
-    {
-      case CHESSBOARD:
-      case CIRCLES_GRID:
-        for( int i = 0; i < boardSize.height; i++ )
-            for( int j = 0; j < boardSize.width; j++ )
-                corners.push_back(Point3f(float(j*squareSize),
-                                          float(i*squareSize), 0));
-        break;
-
-      case ASYMMETRIC_CIRCLES_GRID:
-        for( int i = 0; i < boardSize.height; i++ )
-            for( int j = 0; j < boardSize.width; j++ )
-                corners.push_back(Point3f(float((2*j + i % 2)*squareSize),
-                                          float(i*squareSize), 0));
-        break;
-
-      default:
-        CV_Error(CV_StsBadArg, "Unknown pattern type\n");
-    }
-}
-
-static bool runCalibration( vector<vector<Point2f> > imagePoints,
-                    Size imageSize, Size boardSize, Pattern patternType,
-                    float squareSize, float aspectRatio,
-                    int flags, Mat& cameraMatrix, Mat& distCoeffs,
-                    vector<Mat>& rvecs, vector<Mat>& tvecs,
-                    vector<float>& reprojErrs,
-                    double& totalAvgErr)
-{
-    cameraMatrix = Mat::eye(3, 3, CV_64F);
-    if( flags & CV_CALIB_FIX_ASPECT_RATIO )
-        cameraMatrix.at<double>(0,0) = aspectRatio;
-
-    distCoeffs = Mat::zeros(8, 1, CV_64F);
-
-    vector<vector<Point3f> > objectPoints(1);
-    calcChessboardCorners(boardSize, squareSize, objectPoints[0], patternType);
-
-    objectPoints.resize(imagePoints.size(),objectPoints[0]);
-
-    double rms = calibrateCamera(objectPoints, imagePoints, imageSize, cameraMatrix,
-                    distCoeffs, rvecs, tvecs, flags|CV_CALIB_FIX_K4|CV_CALIB_FIX_K5);
-                    ///*|CV_CALIB_FIX_K3*/|CV_CALIB_FIX_K4|CV_CALIB_FIX_K5);
-    printf("RMS error reported by calibrateCamera: %g\n", rms);
-
-    bool ok = checkRange(cameraMatrix) && checkRange(distCoeffs);
-
-    totalAvgErr = computeReprojectionErrors(objectPoints, imagePoints,
-                rvecs, tvecs, cameraMatrix, distCoeffs, reprojErrs);
-
-    return ok;
-}
-
-
-static void saveCameraParams( const string& filename,
-                       Size imageSize, Size boardSize,
-                       float squareSize, float aspectRatio, int flags,
-                       const Mat& cameraMatrix, const Mat& distCoeffs,
-                       const vector<Mat>& rvecs, const vector<Mat>& tvecs,
-                       const vector<float>& reprojErrs,
-                       const vector<vector<Point2f> >& imagePoints,
-                       double totalAvgErr )
-{
-    FileStorage fs( filename, FileStorage::WRITE );
-
-    time_t tt;
-    time( &tt );
-    struct tm *t2 = localtime( &tt );
-    char buf[1024];
-    strftime( buf, sizeof(buf)-1, "%c", t2 );
-
-    fs << "calibration_time" << buf;
-
-    if( !rvecs.empty() || !reprojErrs.empty() )
-        fs << "nframes" << (int)std::max(rvecs.size(), reprojErrs.size());
-    fs << "image_width" << imageSize.width;
-    fs << "image_height" << imageSize.height;
-    fs << "board_width" << boardSize.width;
-    fs << "board_height" << boardSize.height;
-    fs << "square_size" << squareSize;
-
-    if( flags & CV_CALIB_FIX_ASPECT_RATIO )
-        fs << "aspectRatio" << aspectRatio;
-
-    if( flags != 0 )
-    {
-        sprintf( buf, "flags: %s%s%s%s",
-            flags & CV_CALIB_USE_INTRINSIC_GUESS ? "+use_intrinsic_guess" : "",
-            flags & CV_CALIB_FIX_ASPECT_RATIO ? "+fix_aspectRatio" : "",
-            flags & CV_CALIB_FIX_PRINCIPAL_POINT ? "+fix_principal_point" : "",
-            flags & CV_CALIB_ZERO_TANGENT_DIST ? "+zero_tangent_dist" : "" );
-        cvWriteComment( *fs, buf, 0 );
-    }
-
-    fs << "flags" << flags;
-
-    fs << "camera_matrix" << cameraMatrix;
-    fs << "distortion_coefficients" << distCoeffs;
-
-    fs << "avg_reprojection_error" << totalAvgErr;
-    if( !reprojErrs.empty() )
-        fs << "per_view_reprojection_errors" << Mat(reprojErrs);
-
-    if( !rvecs.empty() && !tvecs.empty() )
-    {
-        CV_Assert(rvecs[0].type() == tvecs[0].type());
-        Mat bigmat((int)rvecs.size(), 6, rvecs[0].type());
-        for( int i = 0; i < (int)rvecs.size(); i++ )
-        {
-            Mat r = bigmat(Range(i, i+1), Range(0,3));
-            Mat t = bigmat(Range(i, i+1), Range(3,6));
-
-            CV_Assert(rvecs[i].rows == 3 && rvecs[i].cols == 1);
-            CV_Assert(tvecs[i].rows == 3 && tvecs[i].cols == 1);
-            //*.t() is MatExpr (not Mat) so we can use assignment operator
-            r = rvecs[i].t();
-            t = tvecs[i].t();
-        }
-        cvWriteComment( *fs, "a set of 6-tuples (rotation vector + translation vector) for each view", 0 );
-        fs << "extrinsic_parameters" << bigmat;
-    }
-
-    if( !imagePoints.empty() )
-    {
-        Mat imagePtMat((int)imagePoints.size(), (int)imagePoints[0].size(), CV_32FC2);
-        for( int i = 0; i < (int)imagePoints.size(); i++ )
-        {
-            Mat r = imagePtMat.row(i).reshape(2, imagePtMat.cols);
-            Mat imgpti(imagePoints[i]);
-            imgpti.copyTo(r);
-        }
-        fs << "image_points" << imagePtMat;
-    }
-}
-
-static bool readStringList( const string& filename, vector<string>& l )
-{
-    l.resize(0);
-    FileStorage fs(filename, FileStorage::READ);
-    if( !fs.isOpened() )
-        return false;
-    FileNode n = fs.getFirstTopLevelNode();
-    if( n.type() != FileNode::SEQ )
-        return false;
-    FileNodeIterator it = n.begin(), it_end = n.end();
-    for( ; it != it_end; ++it )
-        l.push_back((string)*it);
-    return true;
-}
-
-
-static bool runAndSave(const string& outputFilename,
-                const vector<vector<Point2f> >& imagePoints,
-                Size imageSize, Size boardSize, Pattern patternType, float squareSize,
-                float aspectRatio, int flags, Mat& cameraMatrix,
-                Mat& distCoeffs, bool writeExtrinsics, bool writePoints )
-{
-    vector<Mat> rvecs, tvecs;
-    vector<float> reprojErrs;
-    double totalAvgErr = 0;
-
-    bool ok = runCalibration(imagePoints, imageSize, boardSize, patternType, squareSize,
-                   aspectRatio, flags, cameraMatrix, distCoeffs,
-                   rvecs, tvecs, reprojErrs, totalAvgErr);
-    printf("%s. avg reprojection error = %.2f\n",
-           ok ? "Calibration succeeded" : "Calibration failed",
-           totalAvgErr);
-
-    if( ok )
-        saveCameraParams( outputFilename, imageSize,
-                         boardSize, squareSize, aspectRatio,
-                         flags, cameraMatrix, distCoeffs,
-                         writeExtrinsics ? rvecs : vector<Mat>(),
-                         writeExtrinsics ? tvecs : vector<Mat>(),
-                         writeExtrinsics ? reprojErrs : vector<float>(),
-                         writePoints ? imagePoints : vector<vector<Point2f> >(),
-                         totalAvgErr );
-    return ok;
-}
-
+CirclesGridTracker *gridTracker = 0;
+CirclesGridFinder *gridFinder = 0;
+CirclesGridFinderTrace gridTrace;
+bool printTrace = false;
 
 int minThresholdValue = 70;
 int maxThresholdValue = 175;
@@ -475,8 +277,18 @@ static bool customFindAsymmCirclesGrid(cv::InputOutputArray mat, cv::Size patter
 	parameters.edgePenalty = -0.6f;
 
 	parameters.gridType = CirclesGridFinderParameters::ASYMMETRIC_GRID;
+	parameters.parallelEvaluation = true;
 	
 
+	// the finder keeps its workspace across frames
+	if (!gridFinder)
+	{
+		gridFinder = new CirclesGridFinder(patternSize, parameters);
+		if (printTrace)
+			gridFinder->setTrace(&gridTrace);
+	}
+	CirclesGridFinder &boxFinder = *gridFinder;
+
 	const int attempts = 2;
 	const size_t minHomographyPoints = 4;
 	Mat H;
@@ -484,7 +296,7 @@ static bool customFindAsymmCirclesGrid(cv::InputOutputArray mat, cv::Size patter
 	{
 		centers.clear();
 
-		CirclesGridFinder boxFinder(patternSize, points, parameters);
+		boxFinder.reset(points);
 		bool isFound = false;
 
 		
@@ -497,6 +309,12 @@ static bool customFindAsymmCirclesGrid(cv::InputOutputArray mat, cv::Size patter
 		{
 		}
 
+		if (printTrace)
+		{
+			cout << "attempt " << i << (isFound ? " found" : " failed") << endl;
+			gridTrace.write(cout);
+		}
+
 		//isFound = true;
 
 		if (isFound)
@@ -596,6 +414,13 @@ int main( int argc, char** argv )
     Pattern pattern = CHESSBOARD;
 
 	bool useEyeCam = false;
+	bool useTracking = false;
+
+	UndistortionEngine undistorter;
+	Mat undistortedView;
+	Mat solvedCameraMatrix, solvedDistCoeffs;
+	AsyncCalibration solver;
+	int maxDetectionSize = 0;
 
 	// blob detector	
 	initBlobDetectorParams();
@@ -685,6 +510,19 @@ int main( int argc, char** argv )
         {
             showUndistorted = true;
         }
+        else if( strcmp( s, "-track" ) == 0 )
+        {
+            useTracking = true;
+        }
+        else if( strcmp( s, "-trace" ) == 0 )
+        {
+            printTrace = true;
+        }
+        else if( strcmp( s, "-ds" ) == 0 )
+        {
+            if( sscanf( argv[++i], "%d", &maxDetectionSize ) != 1 || maxDetectionSize <= 0 )
+                return fprintf( stderr, "Invalid detection size\n" ), -1;
+        }
         else if( s[0] != '-' )
         {
             if( isdigit(s[0]) )
@@ -701,6 +539,7 @@ int main( int argc, char** argv )
     }
 
 	bool captureIsOpen = false;
+	PatternDetector patternDetector(maxDetectionSize);
 
     if( inputFilename )
     {
@@ -749,14 +588,24 @@ int main( int argc, char** argv )
     if( !imageList.empty() )
         nframes = (int)imageList.size();
 
+	// stored images are unrelated to each other, tracking only pays off on live frames
+	if (useTracking && imageList.empty() && pattern != CHESSBOARD)
+	{
+		CirclesGridTrackerParameters trackerParams;
+		trackerParams.blobColor = blobParams.blobColor;
+		gridTracker = new CirclesGridTracker(boardSize, pattern == ASYMMETRIC_CIRCLES_GRID, trackerParams);
+	}
+
     namedWindow( "Image View", 1 );
 
+	// the gray buffer keeps its allocation across frames
+	Mat viewGray;
 	for (i = 0;; i++)
 	{
 
 		int key = 0xff & waitKey(captureIsOpen ? 50 : 500);
 
-		Mat view, viewGray;
+		Mat view;
 		bool blink = false;
 
 		if (useEyeCam)
@@ -773,17 +622,12 @@ int main( int argc, char** argv )
 			view0.copyTo(view);
 		}
 		else if (i < (int)imageList.size())
-		{
-			//view = imread(imageList[i], 1);
-			cv::Mat origSizeImage = imread(imageList[i], 1);
-			
-			resize(origSizeImage, view, origSizeImage.size() * 3);
-		}
-			
+			view = imread(imageList[i], 1);
 
 		if (!view.data)
 		{
-			if (imagePoints.size() > 0)
+			// a solve started on the last views is taken over after the loop
+			if (mode != CALIBRATING && imagePoints.size() > 0)
 				runAndSave(outputFilename, imagePoints, imageSize,
 					boardSize, pattern, squareSize, aspectRatio,
 					flags, cameraMatrix, distCoeffs,
@@ -809,26 +653,31 @@ int main( int argc, char** argv )
 		switch (pattern)
 		{
 		case CHESSBOARD:
-			found = findChessboardCorners(view, boardSize, pointbuf,
+			found = patternDetector.findChessboard(viewGray, boardSize, pointbuf,
 				CV_CALIB_CB_ADAPTIVE_THRESH | CV_CALIB_CB_FAST_CHECK | CV_CALIB_CB_NORMALIZE_IMAGE);
 			break;
 		case CIRCLES_GRID:
-			found = findCirclesGrid(view, boardSize, pointbuf);
+			if (gridTracker && gridTracker->track(viewGray, pointbuf))
+				found = true;
+			else
+				found = patternDetector.findCirclesGrid(viewGray, boardSize, pointbuf, CALIB_CB_SYMMETRIC_GRID);
 			break;
 		case ASYMMETRIC_CIRCLES_GRID:
-			if (method == 0)
-				found = findCirclesGrid(view, boardSize, pointbuf, CALIB_CB_ASYMMETRIC_GRID, featureDetect);
+			// the blob detector is tuned in full resolution pixels on the trackbars
+			if (gridTracker && gridTracker->track(viewGray, pointbuf))
+				found = true;
+			else if (method == 0)
+				found = findCirclesGrid(viewGray, boardSize, pointbuf, CALIB_CB_ASYMMETRIC_GRID, featureDetect);
 			else
 				found = customFindAsymmCirclesGrid(view, boardSize, pointbuf, featureDetect);
 			break;
 		default:
 			return fprintf(stderr, "Unknown pattern type\n"), -1;
 		}
-				
-		// improve the found corners' coordinate accuracy
-		if (pattern == CHESSBOARD && found)
-			cornerSubPix(viewGray, pointbuf, Size(11, 11),
-				Size(-1, -1), TermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 30, 0.1));
+
+		// reseed the tracker from every full detection, it keeps its track otherwise
+		if (gridTracker && !gridTracker->isTracking() && found)
+			gridTracker->reset(pointbuf);
 
 		//if (mode == CAPTURING && found &&
 		//	(!captureIsOpen || clock() - prevTimestamp > delay*1e-3*CLOCKS_PER_SEC))
@@ -869,6 +718,8 @@ int main( int argc, char** argv )
             else
                 msg = format( "%d/%d", (int)imagePoints.size(), nframes );
         }
+        else if( mode == CALIBRATING )
+            msg = solver.progress();
 
         putText( view, msg, textOrigin, 1, 1,
                  mode != CALIBRATED ? Scalar(0,0,255) : Scalar(0,255,0));
@@ -876,24 +727,12 @@ int main( int argc, char** argv )
         if( blink )
             bitwise_not(view, view);
 
-        if( mode == CALIBRATED && undistortImage )
+        // the maps are only rebuilt when a new calibration result comes in
+        if( mode == CALIBRATED && undistortImage &&
+            undistorter.update(cameraMatrix, distCoeffs, imageSize) )
         {
-            Mat temp = view.clone();
-            //undistort(temp, view, cameraMatrix, distCoeffs);
-
-			Mat map1, map2;
-			
-			initUndistortRectifyMap(cameraMatrix, distCoeffs, Mat(), getOptimalNewCameraMatrix(cameraMatrix, distCoeffs, imageSize, 0.0), imageSize, CV_16SC2, map1, map2);
-			//remap(temp, view, map1, map2, INTER_LINEAR);
-			undistort(temp, view, cameraMatrix, distCoeffs, getOptimalNewCameraMatrix(cameraMatrix, distCoeffs, imageSize, 1.0));
-
-
-			//Mat newCamMat;
-			//fisheye::estimateNewCameraMatrixForUndistortRectify(cameraMatrix, distCoeffs, imageSize, Matx33d::eye(), newCamMat, 0);
-			//fisheye::initUndistortRectifyMap(cameraMatrix, distCoeffs, Matx33d::eye(), newCamMat, imageSize, CV_16SC2, map1, map2);
-
-			//fisheye::undistortImage(temp, view, cameraMatrix, distCoeffs);
-
+            undistorter.apply(view, undistortedView);
+            view = undistortedView;
         }
 
         cv::imshow("Image View", view);
@@ -928,19 +767,39 @@ int main( int argc, char** argv )
         if( key == 'u' && mode == CALIBRATED )
             undistortImage = !undistortImage;
 
-        if(captureIsOpen && key == 'g' )
+        // like the synchronous solve did, 'g' waits until the running solve is taken over
+        if( captureIsOpen && key == 'g' && mode != CALIBRATING )
         {
             mode = CAPTURING;
             imagePoints.clear();
         }
 
-        if( mode == CAPTURING && imagePoints.size() >= (unsigned)nframes )
+        // the solve runs next to this loop, which keeps showing and detecting frames
+        // until the new intrinsics are swapped in
+        if( mode == CAPTURING && imagePoints.size() >= (unsigned)nframes && !solver.isRunning() )
+        {
+            vector<vector<Point2f> > solvePoints = imagePoints;
+            Size solveSize = imageSize;
+            solver.start([=, &solvedCameraMatrix, &solvedDistCoeffs]()
+                {
+                    return runAndSave(outputFilename, solvePoints, solveSize,
+                               boardSize, pattern, squareSize, aspectRatio,
+                               flags, solvedCameraMatrix, solvedDistCoeffs,
+                               writeExtrinsics, writePoints);
+                }, (int)solvePoints.size());
+            mode = CALIBRATING;
+        }
+
+        // mode stays CALIBRATING until the finished solve is taken over
+        bool solved;
+        if( solver.finished(solved) && mode == CALIBRATING )
         {
-            if( runAndSave(outputFilename, imagePoints, imageSize,
-                       boardSize, pattern, squareSize, aspectRatio,
-                       flags, cameraMatrix, distCoeffs,
-                       writeExtrinsics, writePoints))
+            if( solved )
+            {
+                solvedCameraMatrix.copyTo(cameraMatrix);
+                solvedDistCoeffs.copyTo(distCoeffs);
                 mode = CALIBRATED;
+            }
             else
                 mode = DETECTION;
             if( !captureIsOpen)
@@ -948,51 +807,35 @@ int main( int argc, char** argv )
         }
     }
 
+    // a solve that is still running when the loop ends (end of the image list or
+    // ESC) is waited for, its results are taken over instead of solving again
+    if( mode == CALIBRATING )
+    {
+        solver.wait();
+        bool solved;
+        if( solver.finished(solved) && solved )
+        {
+            solvedCameraMatrix.copyTo(cameraMatrix);
+            solvedDistCoeffs.copyTo(distCoeffs);
+            mode = CALIBRATED;
+        }
+    }
+
     //if( !captureIsOpen && showUndistorted )
 	if (showUndistorted)
     {
-        Mat view, rview, map1, map2;
-        //initUndistortRectifyMap(cameraMatrix, distCoeffs, Mat(),
-        //                        getOptimalNewCameraMatrix(cameraMatrix, distCoeffs, imageSize, 1.0, imageSize, 0),
-        //                        imageSize, CV_16SC2, map1, map2);
-
-		//Mat newCamMat;
-		//fisheye::estimateNewCameraMatrixForUndistortRectify(cameraMatrix, distCoeffs, imageSize, Matx33d::eye(), newCamMat, 0);
-		//fisheye::initUndistortRectifyMap(cameraMatrix, distCoeffs, Matx33d::eye(), newCamMat, imageSize, CV_16SC2, map1, map2);
-
-
-		//Mat temp = view.clone();
-		//undistort(temp, view, cameraMatrix, distCoeffs);
-		
-		//Mat map1, map2;
-
-		initUndistortRectifyMap(cameraMatrix, distCoeffs, Mat(),
-			getOptimalNewCameraMatrix(cameraMatrix, distCoeffs, imageSize, 0.0), imageSize, CV_16SC2, map1, map2);
+        Mat view, rview;
 
+        // keeps the camera matrix, like the undistort() call this replaced
+        UndistortionEngine listUndistorter(UndistortionEngine::PINHOLE_MODEL, -1);
 
         for( i = 0; i < (int)imageList.size(); i++ )
         {
-            // view = imread(imageList[i], 1);
-
-			cv::Mat origSizeImage = imread(imageList[i], 1);
-			resize(origSizeImage, view, origSizeImage.size() * 3);
-
-
-            if(!view.data)
+            view = imread(imageList[i], 1);
+            if( !view.data || !listUndistorter.update(cameraMatrix, distCoeffs, view.size()) )
                 continue;
-            
-			undistort( view, rview, cameraMatrix, distCoeffs, cameraMatrix );
-            
-			
-
-			//remap(view, rview, map1, map2, INTER_LINEAR);
-
-			//fisheye::undistortImage(view, rview, cameraMatrix, distCoeffs);
-
-			//remap(view, rview, map1, map2, INTER_LINEAR);
 
-			//remap(temp, view, map1, map2, INTER_LINEAR);
-			//undistort(temp, view, cameraMatrix, distCoeffs, getOptimalNewCameraMatrix(cameraMatrix, distCoeffs, imageSize, 1.0));
+            listUndistorter.apply(view, rview);
 
             imshow("Image View", rview);
             int c = 0xff & waitKey();
@@ -1007,6 +850,21 @@ int main( int argc, char** argv )
 		delete pseye;
 	}
 
+	if (gridTracker)
+	{
+		printf("Circle grid tracked in %d frames, lost %d times\n",
+			(int)gridTracker->getTrackedFrames(), (int)gridTracker->getLostCount());
+		delete gridTracker;
+	}
+
+	if (gridFinder)
+	{
+		const CirclesGridFinderStatistics &stats = gridFinder->getStatistics();
+		printf("Circle grid finder ran %d detections, workspace grew %d times (last at detection %d, %d bytes)\n",
+			(int)stats.detections, (int)stats.workspaceGrowths, (int)stats.lastGrowthDetection, (int)stats.workspaceBytes);
+		delete gridFinder;
+	}
+
     return 0;
 }
 
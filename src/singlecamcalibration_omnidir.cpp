@@ -32,9 +32,16 @@
 
 #include <stdafx.h>
 #include "CameraPS3Eye.h"
+#include "CalibrationReport.h"
+#include "UndistortionEngine.h"
+#include "AsyncCalibration.h"
+#include "PatternDetector.h"
+#include "BoardPresence.h"
+#include "CalibrationCore.h"
 
 using namespace cv;
 using namespace std;
+using namespace calibcore;
 
 const char * usage =
 " \nexample command line for calibration from a live feed.\n"
@@ -91,6 +98,10 @@ static void help()
         "     [-V]                     # use a video file, and not an image list, uses\n"
         "                              # [input_data] string for the video file name\n"
         "     [-su]                    # show undistorted images after calibration\n"
+        "     [-ds <pixels>]           # search the pattern on a copy downscaled to this longer side\n"
+        "                              # and refine it at full resolution (for high-resolution input)\n"
+        "     [-headless]              # no window and no drawing, capture right away and write a\n"
+        "                              # summary report next to the output file\n"
         "     [input_data]             # input data, one of the following:\n"
         "                              #  - text file with a list of the images of the board\n"
         "                              #    the text file can be generated with imagelist_creator\n"
@@ -101,220 +112,7 @@ static void help()
     printf( "\n%s", liveCaptureHelp );
 }
 
-enum { DETECTION = 0, CAPTURING = 1, CALIBRATED = 2 };
-enum Pattern { CHESSBOARD, CIRCLES_GRID, ASYMMETRIC_CIRCLES_GRID };
-
-static double computeReprojectionErrors(
-        const vector<vector<Point3f> >& objectPoints,
-        const vector<vector<Point2f> >& imagePoints,
-        const vector<Mat>& rvecs, const vector<Mat>& tvecs,
-        const Mat& cameraMatrix, const Mat& distCoeffs,
-        vector<float>& perViewErrors )
-{
-    vector<Point2f> imagePoints2;
-    int i, totalPoints = 0;
-    double totalErr = 0, err;
-    perViewErrors.resize(objectPoints.size());
-
-    for( i = 0; i < (int)objectPoints.size(); i++ )
-    {
-        projectPoints(Mat(objectPoints[i]), rvecs[i], tvecs[i],
-                      cameraMatrix, distCoeffs, imagePoints2);
-        err = norm(Mat(imagePoints[i]), Mat(imagePoints2), CV_L2);
-        int n = (int)objectPoints[i].size();
-        perViewErrors[i] = (float)std::sqrt(err*err/n);
-        totalErr += err*err;
-        totalPoints += n;
-    }
-
-    return std::sqrt(totalErr/totalPoints);
-}
-
-static void calcChessboardCorners(Size boardSize, float squareSize, vector<Point3f>& corners, Pattern patternType = CHESSBOARD)
-{
-    corners.resize(0);
-
-    switch(patternType)
-    {
-      case CHESSBOARD:
-      case CIRCLES_GRID:
-        for( int i = 0; i < boardSize.height; i++ )
-            for( int j = 0; j < boardSize.width; j++ )
-                corners.push_back(Point3f(float(j*squareSize),
-                                          float(i*squareSize), 0));
-        break;
-
-      case ASYMMETRIC_CIRCLES_GRID:
-        for( int i = 0; i < boardSize.height; i++ )
-            for( int j = 0; j < boardSize.width; j++ )
-                corners.push_back(Point3f(float((2*j + i % 2)*squareSize),
-                                          float(i*squareSize), 0));
-        break;
-
-      default:
-        CV_Error(CV_StsBadArg, "Unknown pattern type\n");
-    }
-}
-
-static bool runCalibration( vector<vector<Point2f> > imagePoints,
-                    Size imageSize, Size boardSize, Pattern patternType,
-                    float squareSize, float aspectRatio,
-                    int flags, Mat& cameraMatrix, Mat& distCoeffs,
-                    vector<Mat>& rvecs, vector<Mat>& tvecs,
-                    vector<float>& reprojErrs,
-                    double& totalAvgErr)
-{
-    cameraMatrix = Mat::eye(3, 3, CV_64F);
-    if( flags & CV_CALIB_FIX_ASPECT_RATIO )
-        cameraMatrix.at<double>(0,0) = aspectRatio;
-
-    distCoeffs = Mat::zeros(8, 1, CV_64F);
-
-    vector<vector<Point3f> > objectPoints(1);
-    calcChessboardCorners(boardSize, squareSize, objectPoints[0], patternType);
-
-    objectPoints.resize(imagePoints.size(),objectPoints[0]);
-
-    double rms = calibrateCamera(objectPoints, imagePoints, imageSize, cameraMatrix,
-                    distCoeffs, rvecs, tvecs, flags|CV_CALIB_FIX_K4|CV_CALIB_FIX_K5);
-                    ///*|CV_CALIB_FIX_K3*/|CV_CALIB_FIX_K4|CV_CALIB_FIX_K5);
-    printf("RMS error reported by calibrateCamera: %g\n", rms);
-
-    bool ok = checkRange(cameraMatrix) && checkRange(distCoeffs);
-
-    totalAvgErr = computeReprojectionErrors(objectPoints, imagePoints,
-                rvecs, tvecs, cameraMatrix, distCoeffs, reprojErrs);
-
-    return ok;
-}
-
-
-static void saveCameraParams( const string& filename,
-                       Size imageSize, Size boardSize,
-                       float squareSize, float aspectRatio, int flags,
-                       const Mat& cameraMatrix, const Mat& distCoeffs,
-                       const vector<Mat>& rvecs, const vector<Mat>& tvecs,
-                       const vector<float>& reprojErrs,
-                       const vector<vector<Point2f> >& imagePoints,
-                       double totalAvgErr )
-{
-    FileStorage fs( filename, FileStorage::WRITE );
-
-    time_t tt;
-    time( &tt );
-    struct tm *t2 = localtime( &tt );
-    char buf[1024];
-    strftime( buf, sizeof(buf)-1, "%c", t2 );
-
-    fs << "calibration_time" << buf;
-
-    if( !rvecs.empty() || !reprojErrs.empty() )
-        fs << "nframes" << (int)std::max(rvecs.size(), reprojErrs.size());
-    fs << "image_width" << imageSize.width;
-    fs << "image_height" << imageSize.height;
-    fs << "board_width" << boardSize.width;
-    fs << "board_height" << boardSize.height;
-    fs << "square_size" << squareSize;
-
-    if( flags & CV_CALIB_FIX_ASPECT_RATIO )
-        fs << "aspectRatio" << aspectRatio;
-
-    if( flags != 0 )
-    {
-        sprintf( buf, "flags: %s%s%s%s",
-            flags & CV_CALIB_USE_INTRINSIC_GUESS ? "+use_intrinsic_guess" : "",
-            flags & CV_CALIB_FIX_ASPECT_RATIO ? "+fix_aspectRatio" : "",
-            flags & CV_CALIB_FIX_PRINCIPAL_POINT ? "+fix_principal_point" : "",
-            flags & CV_CALIB_ZERO_TANGENT_DIST ? "+zero_tangent_dist" : "" );
-        cvWriteComment( *fs, buf, 0 );
-    }
-
-    fs << "flags" << flags;
-
-    fs << "camera_matrix" << cameraMatrix;
-    fs << "distortion_coefficients" << distCoeffs;
-
-    fs << "avg_reprojection_error" << totalAvgErr;
-    if( !reprojErrs.empty() )
-        fs << "per_view_reprojection_errors" << Mat(reprojErrs);
-
-    if( !rvecs.empty() && !tvecs.empty() )
-    {
-        CV_Assert(rvecs[0].type() == tvecs[0].type());
-        Mat bigmat((int)rvecs.size(), 6, rvecs[0].type());
-        for( int i = 0; i < (int)rvecs.size(); i++ )
-        {
-            Mat r = bigmat(Range(i, i+1), Range(0,3));
-            Mat t = bigmat(Range(i, i+1), Range(3,6));
-
-            CV_Assert(rvecs[i].rows == 3 && rvecs[i].cols == 1);
-            CV_Assert(tvecs[i].rows == 3 && tvecs[i].cols == 1);
-            //*.t() is MatExpr (not Mat) so we can use assignment operator
-            r = rvecs[i].t();
-            t = tvecs[i].t();
-        }
-        cvWriteComment( *fs, "a set of 6-tuples (rotation vector + translation vector) for each view", 0 );
-        fs << "extrinsic_parameters" << bigmat;
-    }
-
-    if( !imagePoints.empty() )
-    {
-        Mat imagePtMat((int)imagePoints.size(), (int)imagePoints[0].size(), CV_32FC2);
-        for( int i = 0; i < (int)imagePoints.size(); i++ )
-        {
-            Mat r = imagePtMat.row(i).reshape(2, imagePtMat.cols);
-            Mat imgpti(imagePoints[i]);
-            imgpti.copyTo(r);
-        }
-        fs << "image_points" << imagePtMat;
-    }
-}
-
-static bool readStringList( const string& filename, vector<string>& l )
-{
-    l.resize(0);
-    FileStorage fs(filename, FileStorage::READ);
-    if( !fs.isOpened() )
-        return false;
-    FileNode n = fs.getFirstTopLevelNode();
-    if( n.type() != FileNode::SEQ )
-        return false;
-    FileNodeIterator it = n.begin(), it_end = n.end();
-    for( ; it != it_end; ++it )
-        l.push_back((string)*it);
-    return true;
-}
-
-
-static bool runAndSave(const string& outputFilename,
-                const vector<vector<Point2f> >& imagePoints,
-                Size imageSize, Size boardSize, Pattern patternType, float squareSize,
-                float aspectRatio, int flags, Mat& cameraMatrix,
-                Mat& distCoeffs, bool writeExtrinsics, bool writePoints )
-{
-    vector<Mat> rvecs, tvecs;
-    vector<float> reprojErrs;
-    double totalAvgErr = 0;
-
-    bool ok = runCalibration(imagePoints, imageSize, boardSize, patternType, squareSize,
-                   aspectRatio, flags, cameraMatrix, distCoeffs,
-                   rvecs, tvecs, reprojErrs, totalAvgErr);
-    printf("%s. avg reprojection error = %.2f\n",
-           ok ? "Calibration succeeded" : "Calibration failed",
-           totalAvgErr);
-
-    if( ok )
-        saveCameraParams( outputFilename, imageSize,
-                         boardSize, squareSize, aspectRatio,
-                         flags, cameraMatrix, distCoeffs,
-                         writeExtrinsics ? rvecs : vector<Mat>(),
-                         writeExtrinsics ? tvecs : vector<Mat>(),
-                         writeExtrinsics ? reprojErrs : vector<float>(),
-                         writePoints ? imagePoints : vector<vector<Point2f> >(),
-                         totalAvgErr );
-    return ok;
-}
-
+enum { DETECTION = 0, CAPTURING = 1, CALIBRATED = 2, CALIBRATING = 3 };
 
 int main( int argc, char** argv )
 {
@@ -345,6 +143,15 @@ int main( int argc, char** argv )
     Pattern pattern = CHESSBOARD;
 
 	bool useEyeCam = false;
+	bool headless = false;
+	int maxDetectionSize = 0;
+	double prevVideoTime = 0;
+	CalibrationReport report("singlecamcalibration_omnidir");
+	// keeps the camera matrix, like the undistort() calls this replaced
+	UndistortionEngine undistorter(UndistortionEngine::PINHOLE_MODEL, -1);
+	Mat undistortedView;
+	Mat solvedCameraMatrix, solvedDistCoeffs;
+	AsyncCalibration solver;
 
     if( argc < 2 )
     {
@@ -430,6 +237,15 @@ int main( int argc, char** argv )
         {
             showUndistorted = true;
         }
+        else if( strcmp( s, "-ds" ) == 0 )
+        {
+            if( sscanf( argv[++i], "%d", &maxDetectionSize ) != 1 || maxDetectionSize <= 0 )
+                return fprintf( stderr, "Invalid detection size\n" ), -1;
+        }
+        else if( strcmp( s, "-headless" ) == 0 )
+        {
+            headless = true;
+        }
         else if( s[0] != '-' )
         {
             if( isdigit(s[0]) )
@@ -446,6 +262,7 @@ int main( int argc, char** argv )
     }
 
 	bool captureIsOpen = false;
+	PatternDetector patternDetector(maxDetectionSize);
 
     if( inputFilename )
     {
@@ -477,7 +294,7 @@ int main( int argc, char** argv )
 	{
 		if (!capture.isOpened() && imageList.empty())
 			return fprintf(stderr, "Could not initialize video (%d) capture\n", cameraId), -2;
-		else
+		else if (!headless)
 			printf("%s", liveCaptureHelp);
 	}
 
@@ -487,11 +304,21 @@ int main( int argc, char** argv )
     if( !imageList.empty() )
         nframes = (int)imageList.size();
 
-    namedWindow( "Image View", 1 );
+    // image lists are searched in full, live and video frames without a board are skipped early
+    BoardPresence presence;
+    bool checkPresence = imageList.empty();
+
+    // nobody can press 'g' without a window
+    if( headless )
+        mode = CAPTURING;
+    else
+        namedWindow( "Image View", 1 );
 
+    // the gray buffer keeps its allocation across frames
+    Mat viewGray;
     for(i = 0;;i++)
     {
-        Mat view, viewGray;
+        Mat view;
         bool blink = false;
 
 		if (useEyeCam)
@@ -508,19 +335,30 @@ int main( int argc, char** argv )
             view0.copyTo(view);
         }
         else if( i < (int)imageList.size() )
+        {
             view = imread(imageList[i], 1);
+            if( !view.data && headless )
+            {
+                printf("%s: could not be read\n", imageList[i].c_str());
+                report.framesProcessed++;
+                report.framesUnreadable++;
+                continue;
+            }
+        }
 
         if(!view.data)
         {
-            if( imagePoints.size() > 0 )
+            // a solve started on the last views is taken over after the loop
+            if( mode != CALIBRATING && imagePoints.size() > 0 )
                 runAndSave(outputFilename, imagePoints, imageSize,
                            boardSize, pattern, squareSize, aspectRatio,
                            flags, cameraMatrix, distCoeffs,
-                           writeExtrinsics, writePoints);
+                           writeExtrinsics, writePoints, &report);
             break;
         }
 
         imageSize = view.size();
+        report.framesProcessed++;
 
         if( flipVertical )
             flip( view, view, 0 );
@@ -528,35 +366,62 @@ int main( int argc, char** argv )
         vector<Point2f> pointbuf;
         cvtColor(view, viewGray, CV_BGR2GRAY);
 
-        bool found;
-        switch( pattern )
+        bool found = false;
+        // frames without anything board-like skip the full detector
+        if( !checkPresence || presence.check( viewGray, boardSize, pattern == CHESSBOARD ) )
         {
-            case CHESSBOARD:
-                found = findChessboardCorners( view, boardSize, pointbuf,
-                    CV_CALIB_CB_ADAPTIVE_THRESH | CV_CALIB_CB_FAST_CHECK | CV_CALIB_CB_NORMALIZE_IMAGE);
-                break;
-            case CIRCLES_GRID:
-                found = findCirclesGrid( view, boardSize, pointbuf );
-                break;
-            case ASYMMETRIC_CIRCLES_GRID:
-                found = findCirclesGrid( view, boardSize, pointbuf, CALIB_CB_ASYMMETRIC_GRID );
-                break;
-            default:
-                return fprintf( stderr, "Unknown pattern type\n" ), -1;
+            switch( pattern )
+            {
+                case CHESSBOARD:
+                    found = patternDetector.findChessboard( viewGray, boardSize, pointbuf,
+                        CV_CALIB_CB_ADAPTIVE_THRESH | CV_CALIB_CB_FAST_CHECK | CV_CALIB_CB_NORMALIZE_IMAGE);
+                    break;
+                case CIRCLES_GRID:
+                    found = patternDetector.findCirclesGrid( viewGray, boardSize, pointbuf, CALIB_CB_SYMMETRIC_GRID );
+                    break;
+                case ASYMMETRIC_CIRCLES_GRID:
+                    found = patternDetector.findCirclesGrid( viewGray, boardSize, pointbuf, CALIB_CB_ASYMMETRIC_GRID );
+                    break;
+                default:
+                    return fprintf( stderr, "Unknown pattern type\n" ), -1;
+            }
         }
 
-       // improve the found corners' coordinate accuracy
-        if( pattern == CHESSBOARD && found) cornerSubPix( viewGray, pointbuf, Size(11,11),
-            Size(-1,-1), TermCriteria( CV_TERMCRIT_EPS+CV_TERMCRIT_ITER, 30, 0.1 ));
+        if( found )
+            report.framesWithPattern++;
+
+        // without waitKey the delay only makes sense for a live camera: every listed
+        // image is used and a video file is spread over its own clock
+        bool delayElapsed;
+        if( headless && !imageList.empty() )
+            delayElapsed = true;
+        else if( headless && inputFilename )
+            delayElapsed = capture.get(CAP_PROP_POS_MSEC) - prevVideoTime > delay;
+        else
+            delayElapsed = clock() - prevTimestamp > delay*1e-3*CLOCKS_PER_SEC;
 
-        if( mode == CAPTURING && found &&
-           (!captureIsOpen || clock() - prevTimestamp > delay*1e-3*CLOCKS_PER_SEC) )
+        if( mode == CAPTURING && found && (!captureIsOpen || delayElapsed) )
         {
             imagePoints.push_back(pointbuf);
             prevTimestamp = clock();
+            if( headless && inputFilename && imageList.empty() )
+                prevVideoTime = capture.get(CAP_PROP_POS_MSEC);
             blink = captureIsOpen;
         }
 
+        if( headless )
+        {
+            if( imagePoints.size() >= (unsigned)nframes )
+            {
+                runAndSave(outputFilename, imagePoints, imageSize,
+                           boardSize, pattern, squareSize, aspectRatio,
+                           flags, cameraMatrix, distCoeffs,
+                           writeExtrinsics, writePoints, &report);
+                break;
+            }
+            continue;
+        }
+
         if(found)
             drawChessboardCorners( view, boardSize, Mat(pointbuf), found );
 
@@ -573,6 +438,8 @@ int main( int argc, char** argv )
             else
                 msg = format( "%d/%d", (int)imagePoints.size(), nframes );
         }
+        else if( mode == CALIBRATING )
+            msg = solver.progress();
 
         putText( view, msg, textOrigin, 1, 1,
                  mode != CALIBRATED ? Scalar(0,0,255) : Scalar(0,255,0));
@@ -580,10 +447,11 @@ int main( int argc, char** argv )
         if( blink )
             bitwise_not(view, view);
 
-        if( mode == CALIBRATED && undistortImage )
+        if( mode == CALIBRATED && undistortImage &&
+            undistorter.update(cameraMatrix, distCoeffs, imageSize) )
         {
-            Mat temp = view.clone();
-            undistort(temp, view, cameraMatrix, distCoeffs);
+            undistorter.apply(view, undistortedView);
+            view = undistortedView;
         }
 
         imshow("Image View", view);
@@ -595,19 +463,39 @@ int main( int argc, char** argv )
         if( key == 'u' && mode == CALIBRATED )
             undistortImage = !undistortImage;
 
-        if(captureIsOpen && key == 'g' )
+        // like the synchronous solve did, 'g' waits until the running solve is taken over
+        if( captureIsOpen && key == 'g' && mode != CALIBRATING )
         {
             mode = CAPTURING;
             imagePoints.clear();
         }
 
-        if( mode == CAPTURING && imagePoints.size() >= (unsigned)nframes )
+        // the solve runs next to this loop, which keeps showing and detecting frames
+        // until the new intrinsics are swapped in
+        if( mode == CAPTURING && imagePoints.size() >= (unsigned)nframes && !solver.isRunning() )
+        {
+            vector<vector<Point2f> > solvePoints = imagePoints;
+            Size solveSize = imageSize;
+            solver.start([=, &solvedCameraMatrix, &solvedDistCoeffs, &report]()
+                {
+                    return runAndSave(outputFilename, solvePoints, solveSize,
+                               boardSize, pattern, squareSize, aspectRatio,
+                               flags, solvedCameraMatrix, solvedDistCoeffs,
+                               writeExtrinsics, writePoints, &report);
+                }, (int)solvePoints.size());
+            mode = CALIBRATING;
+        }
+
+        // mode stays CALIBRATING until the finished solve is taken over
+        bool solved;
+        if( solver.finished(solved) && mode == CALIBRATING )
         {
-            if( runAndSave(outputFilename, imagePoints, imageSize,
-                       boardSize, pattern, squareSize, aspectRatio,
-                       flags, cameraMatrix, distCoeffs,
-                       writeExtrinsics, writePoints))
+            if( solved )
+            {
+                solvedCameraMatrix.copyTo(cameraMatrix);
+                solvedDistCoeffs.copyTo(distCoeffs);
                 mode = CALIBRATED;
+            }
             else
                 mode = DETECTION;
             if( !captureIsOpen)
@@ -615,20 +503,30 @@ int main( int argc, char** argv )
         }
     }
 
-    if( !captureIsOpen && showUndistorted )
+    // a solve that is still running when the loop ends (end of the image list or
+    // ESC) is waited for, its results are taken over instead of solving again
+    if( mode == CALIBRATING )
     {
-        Mat view, rview, map1, map2;
-        initUndistortRectifyMap(cameraMatrix, distCoeffs, Mat(),
-                                getOptimalNewCameraMatrix(cameraMatrix, distCoeffs, imageSize, 1, imageSize, 0),
-                                imageSize, CV_16SC2, map1, map2);
+        solver.wait();
+        bool solved;
+        if( solver.finished(solved) && solved )
+        {
+            solvedCameraMatrix.copyTo(cameraMatrix);
+            solvedDistCoeffs.copyTo(distCoeffs);
+            mode = CALIBRATED;
+        }
+    }
+
+    if( !captureIsOpen && showUndistorted && !headless )
+    {
+        Mat view, rview;
 
         for( i = 0; i < (int)imageList.size(); i++ )
         {
             view = imread(imageList[i], 1);
-            if(!view.data)
+            if( !view.data || !undistorter.update(cameraMatrix, distCoeffs, view.size()) )
                 continue;
-            undistort( view, rview, cameraMatrix, distCoeffs, cameraMatrix );
-            //remap(view, rview, map1, map2, INTER_LINEAR);
+            undistorter.apply(view, rview);
             imshow("Image View", rview);
             int c = 0xff & waitKey();
             if( (c & 255) == 27 || c == 'q' || c == 'Q' )
@@ -642,5 +540,14 @@ int main( int argc, char** argv )
 		delete pseye;
 	}
 
+	if( checkPresence )
+	{
+		printf( "Board pre-check skipped %d of %d frames\n", presence.framesSkipped(), presence.framesChecked() );
+		report.framesSkipped = presence.framesSkipped();
+	}
+
+	if (headless)
+		report.finish(outputFilename);
+
     return 0;
 }
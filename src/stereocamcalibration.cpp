@@ -13,11 +13,16 @@
 #include <stdafx.h>
 
 #include "ThreadCamera.h"
+#include "AsyncCalibration.h"
+#include "BoardRoiTracker.h"
+#include "BoardPresence.h"
+#include "RectificationMap.h"
 
 #include <iterator>
 
 using namespace cv;
 using namespace std;
+using namespace calibcore;
 
 // ***************************************************
 // CAMERA DATA
@@ -50,9 +55,13 @@ static float squareSize = 1.f;  // Set this to your actual square size
 static Mat cameraMatrix[2], distCoeffs[2];
 static Mat R, T, E, F;
 static Mat R1, R2, P1, P2, Q;
-static Mat rmap[2][2];
 static Size imageSize;
 
+// maps of a known calibration are read from the cache and used in place, the
+// rectification goes through apply() so no header outlives a re-init
+static const char* mapCacheDirectory = "mapcache";
+static RectificationMap rectifyMap[2];
+
 // ***************************************************
 // TEMPORARY DATA
 
@@ -68,6 +77,13 @@ static Mat canvasPart_right;
 
 static bool switchCameras = false;
 
+// search the board around its last corners first (-roi)
+static bool useRoi = false;
+static BoardRoiTracker roiTracker[2];
+
+// frames without a board skip the full search
+static BoardPresence presence[2];
+
 const char * usage =
 " \nexample command line for stereo calibration from camera feed.\n"
 "   stereocamcalibration -calibrate\n"
@@ -82,6 +98,7 @@ static void help()
 		"     -verify                  # rectify camera data using calibration provided in the application path\n"
 		"     -calibrate               # create new calibration using a 9x6 checkerboard pattern\n"
         "     -sw                      # switch cameras\n"
+        "     -roi                     # search the checkerboard around its corners of the last frame first\n"
 		"\n");
 	printf("\n%s", usage);
 }
@@ -179,6 +196,30 @@ void receiveCameraFrames()
 
 }
 
+static bool findCorners(int camera, const Mat& image, vector<Point2f>& corners)
+{
+	BoardRoiTracker::Finder finder = [](const Mat& region, vector<Point2f>& regionCorners)
+	{
+		return findChessboardCorners(region, boardSize, regionCorners,
+			CV_CALIB_CB_ADAPTIVE_THRESH | CV_CALIB_CB_NORMALIZE_IMAGE);
+	};
+
+	if (!useRoi || !roiTracker[camera].isTracking())
+	{
+		Mat gray;
+		cvtColor(image, gray, CV_BGR2GRAY);
+		if (!presence[camera].check(gray, boardSize, true))
+		{
+			corners.clear();
+			return false;
+		}
+	}
+
+	if (!useRoi)
+		return finder(image, corners);
+	return roiTracker[camera].find(image, corners, finder);
+}
+
 void checkCameraFrames(vector<Point2f> &corners_left, vector<Point2f> &corners_right, cv::Mat &left, cv::Mat &right, cv::Mat &combined) {
 
 
@@ -196,8 +237,7 @@ void checkCameraFrames(vector<Point2f> &corners_left, vector<Point2f> &corners_r
 		// clear corner points of calibration pattern for left camera
 		corners_left.clear();
 
-		bool found = findChessboardCorners(left_checker, boardSize, corners_left,
-			CV_CALIB_CB_ADAPTIVE_THRESH | CV_CALIB_CB_NORMALIZE_IMAGE);
+		bool found = findCorners(0, left_checker, corners_left);
 
 		// draw chessboard corners if find function was successful
 		if (found) { drawChessboardCorners(left_checker, boardSize, corners_left, found); }
@@ -211,8 +251,7 @@ void checkCameraFrames(vector<Point2f> &corners_left, vector<Point2f> &corners_r
 		// clear corner points of calibration pattern for right camera
 		corners_right.clear();
 
-		bool found = findChessboardCorners(right_checker, boardSize, corners_right,
-			CV_CALIB_CB_ADAPTIVE_THRESH | CV_CALIB_CB_NORMALIZE_IMAGE);
+		bool found = findCorners(1, right_checker, corners_right);
 
 		// draw chessboard corners if find function was successful
 		if (found) { drawChessboardCorners(right_checker, boardSize, corners_right, found);	}
@@ -226,6 +265,14 @@ void checkCameraFrames(vector<Point2f> &corners_left, vector<Point2f> &corners_r
 	return;
 }
 
+// builds the rectification maps, or maps them from the map cache when this
+// calibration was used before
+static void buildRectificationMaps()
+{
+	rectifyMap[0].init(mapCacheDirectory, cameraMatrix[0], distCoeffs[0], R1, P1, imageSize);
+	rectifyMap[1].init(mapCacheDirectory, cameraMatrix[1], distCoeffs[1], R2, P2, imageSize);
+}
+
 static void StereoCalibOnline()
 {
 
@@ -287,6 +334,14 @@ static void StereoCalibOnline()
 
 	} while (numsamples < nimages);
 
+	if (useRoi)
+		for (int c = 0; c < 2; c++)
+			printf("camera %d: checkerboard found in its region in %d frames, full searches %d\n",
+				c, (int)roiTracker[c].roiFrames(), (int)roiTracker[c].fullFrames());
+	for (int c = 0; c < 2; c++)
+		printf("camera %d: board pre-check skipped %d of %d frames\n",
+			c, presence[c].framesSkipped(), presence[c].framesChecked());
+
 	// *******************************************************************************
 	// STEREO CALIBRATION
 
@@ -326,27 +381,56 @@ static void StereoCalibOnline()
 	cameraMatrix[0] = Mat::eye(3, 3, CV_64F);
 	cameraMatrix[1] = Mat::eye(3, 3, CV_64F);
 
-	double rms = stereoCalibrate(
-		objectPoints,					// Vector of vectors of the calibration pattern points
-		imagePoints[0],					// Vector of vectors of the projections of the calibration pattern points, observed by the first camera
-		imagePoints[1],					// Vector of vectors of the projections of the calibration pattern points, observed by the second camera
-		cameraMatrix[0],				// Input/output first camera matrix
-		distCoeffs[0],					// Input/output vector of distortion coefficients 
-		cameraMatrix[1],				// input / output second camera matrix.The parameter is similar to cameraMatrix1
-		distCoeffs[1],					// 	Input/output lens distortion coefficients for the second camera. The parameter is similar to distCoeffs1
-		imageSize,						// Size of the image used only to initialize intrinsic camera matrix.
-		R,								// Output rotation matrix between the 1st and the 2nd camera coordinate systems.
-		T,								// Output translation vector between the coordinate systems of the cameras.
-		E,								// Output essential matrix.
-		F,								// Output fundamental matrix.
-		CV_CALIB_FIX_ASPECT_RATIO +
-		CV_CALIB_ZERO_TANGENT_DIST +	// Set tangential distortion coefficients for each camera to zeros and fix there.
-		CV_CALIB_SAME_FOCAL_LENGTH +	// Enforce f(0)x=f(1)x and f(0)y=f(1)y .
-		CV_CALIB_RATIONAL_MODEL +		// Enable coefficients k4, k5, and k6.
-		CV_CALIB_FIX_K3 + CV_CALIB_FIX_K4 + CV_CALIB_FIX_K5	// Do not change the corresponding radial distortion coefficient during the optimization.
-		//+CV_CALIB_FIX_INTRINSIC
-		,TermCriteria(CV_TERMCRIT_ITER + CV_TERMCRIT_EPS, 100, 1e-5)	// Termination criteria for the iterative optimization algorithm.
-		);
+	// the solve runs on a worker thread while the camera feed keeps being shown
+	double rms = 0;
+	AsyncCalibration solver;
+	solver.start([&]()
+	{
+		rms = stereoCalibrate(
+			objectPoints,					// Vector of vectors of the calibration pattern points
+			imagePoints[0],					// Vector of vectors of the projections of the calibration pattern points, observed by the first camera
+			imagePoints[1],					// Vector of vectors of the projections of the calibration pattern points, observed by the second camera
+			cameraMatrix[0],				// Input/output first camera matrix
+			distCoeffs[0],					// Input/output vector of distortion coefficients 
+			cameraMatrix[1],				// input / output second camera matrix.The parameter is similar to cameraMatrix1
+			distCoeffs[1],					// 	Input/output lens distortion coefficients for the second camera. The parameter is similar to distCoeffs1
+			imageSize,						// Size of the image used only to initialize intrinsic camera matrix.
+			R,								// Output rotation matrix between the 1st and the 2nd camera coordinate systems.
+			T,								// Output translation vector between the coordinate systems of the cameras.
+			E,								// Output essential matrix.
+			F,								// Output fundamental matrix.
+			CV_CALIB_FIX_ASPECT_RATIO +
+			CV_CALIB_ZERO_TANGENT_DIST +	// Set tangential distortion coefficients for each camera to zeros and fix there.
+			CV_CALIB_SAME_FOCAL_LENGTH +	// Enforce f(0)x=f(1)x and f(0)y=f(1)y .
+			CV_CALIB_RATIONAL_MODEL +		// Enable coefficients k4, k5, and k6.
+			CV_CALIB_FIX_K3 + CV_CALIB_FIX_K4 + CV_CALIB_FIX_K5	// Do not change the corresponding radial distortion coefficient during the optimization.
+			//+CV_CALIB_FIX_INTRINSIC
+			,TermCriteria(CV_TERMCRIT_ITER + CV_TERMCRIT_EPS, 100, 1e-5)	// Termination criteria for the iterative optimization algorithm.
+			);
+		return true;
+	}, nimages);
+
+	int64 lastReport = getTickCount();
+	while (solver.isRunning())
+	{
+		vector<Point2f> corners_left, corners_right;
+		checkCameraFrames(corners_left, corners_right, left, right, combined);
+
+		if ((getTickCount() - lastReport) / getTickFrequency() >= 1.)
+		{
+			cout << solver.progress() << endl;
+			lastReport = getTickCount();
+		}
+	}
+
+	bool solved = false;
+	solver.wait();
+	solver.finished(solved);
+	if (!solved)
+	{
+		cout << "Error: stereo calibration failed, nothing is saved\n";
+		return;
+	}
 	cout << "done with RMS error=" << rms << endl;
 
 
@@ -459,18 +543,13 @@ static void StereoCalibOnline()
 		P2 = cameraMatrix[1];
 	}
 
-	//Precompute maps for cv::remap()
-	initUndistortRectifyMap(cameraMatrix[0], distCoeffs[0], R1, P1, imageSize, CV_16SC2, rmap[0][0], rmap[0][1]);
-	initUndistortRectifyMap(cameraMatrix[1], distCoeffs[1], R2, P2, imageSize, CV_16SC2, rmap[1][0], rmap[1][1]);
+	//Precompute maps for cv::remap(), they are stored in the binary map cache
+	buildRectificationMaps();
 
 	fs.open("rectification.yml", CV_STORAGE_WRITE);
 	if (fs.isOpened())
 	{
-		fs << "rmap00" << rmap[0][0]
-			<< "rmap01" << rmap[0][1]
-			<< "rmap10" << rmap[1][0]
-			<< "rmap11" << rmap[1][1]
-			<< "imageSize" << imageSize;
+		fs << "imageSize" << imageSize;
 		fs.release();
 	}
 	else
@@ -525,14 +604,10 @@ static bool readCalibration() {
 		return false;
 	}
 
-	// load rectification map
+	// load the image size of the rectification, the maps themselves come from the map cache
 	fs.open("rectification.yml", CV_STORAGE_READ);
 	if (fs.isOpened())
 	{
-		fs["rmap00"] >> rmap[0][0];
-		fs["rmap01"] >> rmap[0][1];
-		fs["rmap10"] >> rmap[1][0];
-		fs["rmap11"] >> rmap[1][1];
 		fs["imageSize"] >> imageSize;
 		fs.release();
 	}
@@ -541,6 +616,7 @@ static bool readCalibration() {
 		return false;
 	}
 
+	buildRectificationMaps();
 	return true;
 }
 
@@ -564,8 +640,8 @@ static bool rectifyCameraImages() {
 	newframe_left = false;
 	newframe_right = false;
 
-	remap(current_frame_left, rimg_l, rmap[0][0], rmap[0][1], CV_INTER_LINEAR);
-	remap(current_frame_right, rimg_r, rmap[1][0], rmap[1][1], CV_INTER_LINEAR);
+	rectifyMap[0].apply(current_frame_left, rimg_l);
+	rectifyMap[1].apply(current_frame_right, rimg_r);
 
 	rimg_l.copyTo(canvasPart_left);
 	rimg_r.copyTo(canvasPart_right);
@@ -605,6 +681,10 @@ int main(int argc, char** argv)
         else if (strcmp(s, "-sw") == 0)
         {
             switchCameras = true;
+        }
+        else if (strcmp(s, "-roi") == 0)
+        {
+            useRoi = true;
         }
 		else
 			return fprintf(stderr, "Unknown option %s", s), -1;
@@ -13,9 +13,11 @@
 #include <stdafx.h>
 
 #include "CameraPS3Eye.h"
+#include "RectificationMap.h"
 
 using namespace cv;
 using namespace std;
+using namespace calibcore;
 
 SHORT WINAPI GetAsyncKeyState(
 	_In_ int vKey
@@ -52,9 +54,13 @@ static float squareSize = 1.f;  // Set this to your actual square size
 static Mat cameraMatrix[2], distCoeffs[2];
 static Mat R, T, E, F;
 static Mat R1, R2, P1, P2, Q;
-static Mat rmap[2][2];
 static Size imageSize;
 
+// maps of a known calibration are read from the cache and used in place, the
+// rectification goes through apply() so no header outlives a re-init
+static const char* mapCacheDirectory = "mapcache";
+static RectificationMap rectifyMap[2];
+
 // ***************************************************
 // TEMPORARY DATA
 
@@ -122,6 +128,14 @@ void receiveCameraFrames()
 
 }
 
+// builds the rectification maps, or maps them from the map cache when this
+// calibration was used before
+static void buildRectificationMaps()
+{
+	rectifyMap[0].init(mapCacheDirectory, cameraMatrix[0], distCoeffs[0], R1, P1, imageSize);
+	rectifyMap[1].init(mapCacheDirectory, cameraMatrix[1], distCoeffs[1], R2, P2, imageSize);
+}
+
 static bool readCalibration() {
 
 	// load intrinsics
@@ -158,14 +172,10 @@ static bool readCalibration() {
 		return false;
 	}
 
-	// load rectification map
+	// load the image size of the rectification, the maps themselves come from the map cache
 	fs.open("rectification.yml", CV_STORAGE_READ);
 	if (fs.isOpened())
 	{
-		fs["rmap00"] >> rmap[0][0];
-		fs["rmap01"] >> rmap[0][1];
-		fs["rmap10"] >> rmap[1][0];
-		fs["rmap11"] >> rmap[1][1];
 		fs["imageSize"] >> imageSize;
 		fs.release();
 	}
@@ -174,6 +184,7 @@ static bool readCalibration() {
 		return false;
 	}
 
+	buildRectificationMaps();
 	return true;
 }
 
@@ -188,12 +199,6 @@ static void initRectification() {
 	canvasPart_right = canvas(Rect(w, 0, w, h));
 
 
-	// recompute rectification
-
-	//Precompute maps for cv::remap()
-	initUndistortRectifyMap(cameraMatrix[0], distCoeffs[0], R1, P1, imageSize, CV_16SC2, rmap[0][0], rmap[0][1]);
-	initUndistortRectifyMap(cameraMatrix[1], distCoeffs[1], R2, P2, imageSize, CV_16SC2, rmap[1][0], rmap[1][1]);
-
 }
 
 static bool rectifyCameraImages() {
@@ -204,8 +209,8 @@ static bool rectifyCameraImages() {
 	newframe_left = false;
 	newframe_right = false;
 
-	remap(current_frame_left, rimg_l, rmap[0][0], rmap[0][1], CV_INTER_LINEAR);
-	remap(current_frame_right, rimg_r, rmap[1][0], rmap[1][1], CV_INTER_LINEAR);
+	rectifyMap[0].apply(current_frame_left, rimg_l);
+	rectifyMap[1].apply(current_frame_right, rimg_r);
 
 	rimg_l.copyTo(canvasPart_left);
 	rimg_r.copyTo(canvasPart_right);